@@ -0,0 +1,16 @@
+#ifndef BINARY_DETECT_H
+#define BINARY_DETECT_H
+
+#include <stddef.h>
+
+/* Only the start of a file is probed, so detection costs the same for any size. */
+#define BINARY_PROBE_SIZE (32 * 1024)
+
+/*
+ * A file is binary when a NUL byte appears in its first BINARY_PROBE_SIZE
+ * bytes, the same rule grep uses. The probe runs on the active SIMD
+ * kernel: byte compares against zero ORed together a block at a time.
+ */
+int binary_detect(const char* data, size_t size);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CASEFOLD_H
+#define CASEFOLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes that don't start a valid UTF-8 sequence decode to CASEFOLD_RAW_BASE + byte. */
+#define CASEFOLD_RAW_BASE 0x110000
+/* Stretches of text with multibyte sequences end at this many ASCII bytes in a row. */
+#define CASEFOLD_ASCII_RUN 64
+
+typedef struct {
+    uint32_t* folded;
+    size_t count;
+
+    /* ascii[i] is folded[i] when that is ASCII, 0 otherwise. */
+    unsigned char* ascii;
+    size_t ascii_prefix;
+    int all_ascii;
+
+    /* First bytes of every encoding whose fold equals folded[0]. */
+    unsigned char lead[256];
+} CaseNeedle;
+
+uint32_t casefold_codepoint(uint32_t cp);
+size_t casefold_decode(const char* data, size_t avail, uint32_t* cp);
+int casefold_needs_unicode(const char* str, size_t len);
+
+CaseNeedle* case_needle_create(const char* needle, size_t len);
+void case_needle_free(CaseNeedle* needle);
+size_t case_needle_match(const CaseNeedle* needle, const char* data, size_t size, size_t pos);
+
+size_t casefold_next_non_ascii(const char* data, size_t size, size_t pos);
+size_t casefold_stretch_end(const char* data, size_t size, size_t start);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CHUNK_READER_H
+#define CHUNK_READER_H
+
+#include <stddef.h>
+#include "file_reader.h"
+
+#define CHUNK_WINDOW_SIZE (8 * 1024 * 1024)
+/* Window size when windows are searched in parallel; several are in flight at once. */
+#define CHUNK_BLOCK_SIZE (2 * 1024 * 1024)
+
+/*
+ * Reads a file descriptor as a series of newline-aligned windows through
+ * one reused buffer. A window ends just after a '\n' (or at the end of
+ * the input) and the partial line behind it is carried to the front of
+ * the next window, so lines are never split and memory stays at one
+ * window plus the longest line, whatever the file size.
+ */
+typedef struct {
+    char* buffer;
+    size_t capacity;
+    size_t window_size;
+    size_t used;
+    int fd;
+    int owns_fd;
+    int eof;
+    int error;
+    /* Read until the window is full rather than handing on the first complete line. */
+    int fill;
+
+    /* The current window: data[0, size), starting at offset in the input. */
+    const char* data;
+    size_t size;
+    size_t offset;
+    /* Line number of the window's first line; only kept up with count_lines. */
+    size_t first_line;
+    int count_lines;
+    /* Set from the first window, like FileData.is_binary. */
+    int is_binary;
+} ChunkReader;
+
+ChunkReader* chunk_reader_create(size_t window_size, int count_lines);
+void chunk_reader_free(ChunkReader* reader);
+
+ReadStatus chunk_reader_open(ChunkReader* reader, const char* filepath);
+void chunk_reader_attach(ChunkReader* reader, int fd);
+void chunk_reader_close(ChunkReader* reader);
+
+int chunk_reader_next(ChunkReader* reader);
+char* chunk_reader_swap(ChunkReader* reader, char* spare, size_t* capacity);
+
+#endif
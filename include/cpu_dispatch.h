@@ -0,0 +1,32 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+/*
+ * Every kernel variant is compiled into the binary with a per-function
+ * target attribute; the one to run is chosen once at startup from cpuid.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#define TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#endif
+
+typedef enum {
+    KERNEL_SCALAR,
+    KERNEL_SSE42,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_COUNT
+} KernelLevel;
+
+KernelLevel cpu_detect_kernel(void);
+int cpu_kernel_supported(KernelLevel level);
+
+const char* kernel_name(KernelLevel level);
+int kernel_parse(const char* name, KernelLevel* level);
+
+void kernel_select(KernelLevel level);
+KernelLevel kernel_active(void);
+
+#endif
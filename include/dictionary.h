@@ -0,0 +1,48 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DICTIONARY_KEY_MAX 8
+
+typedef struct {
+    char* arena;
+    size_t* offsets;
+    uint32_t* lengths;
+    size_t count;
+    /* Bytes hashed per long entry; entries shorter than this are kept apart. */
+    size_t key_len;
+    int case_insensitive;
+
+    /* Blocked Bloom filter over long entry keys: both probe bits share one word. */
+    uint64_t* bloom;
+    size_t bloom_mask;
+
+    /* Long entries bucketed by key hash, each bucket in pattern order. */
+    size_t bucket_shift;
+    uint32_t* bucket_start;
+    uint32_t* bucket_members;
+
+    /*
+     * Short entries are screened exactly by their first byte (one-byte
+     * entries) or first two bytes, then bucketed by a hash of those, so a
+     * few of them don't shorten the key every long entry is hashed at.
+     */
+    size_t short_count;
+    uint64_t short_single[4];
+    uint64_t* short_pairs;
+    size_t short_shift;
+    uint32_t* short_start;
+    uint32_t* short_members;
+
+    size_t memory_bytes;
+} Dictionary;
+
+Dictionary* dictionary_create(const char* const* entries, size_t count, int case_insensitive);
+void dictionary_free(Dictionary* dict);
+
+size_t dictionary_find_candidate(const Dictionary* dict, const char* data, size_t size, size_t pos);
+size_t dictionary_next_match(const Dictionary* dict, const char* data, size_t size, size_t pos, size_t* cursor);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef DIR_WALKER_H
+#define DIR_WALKER_H
+
+#include <stddef.h>
+
+/* Directories held open for their children to be opened relative to; the rest reopen by path. */
+#define WALK_MAX_OPEN_DIRS 128
+#define WALK_BUFFER_SIZE (32 * 1024)
+
+/*
+ * Gets each regular file as it is found. With more than one walker it is
+ * called from several threads at once. Returns 0 to stop the walk.
+ */
+typedef int (*WalkCallback)(const char* filepath, void* userdata);
+
+typedef struct {
+    size_t directories;
+    size_t files;
+    /* Entries d_type left as DT_UNKNOWN. */
+    size_t stat_calls;
+} WalkStats;
+
+/*
+ * Walks root with num_threads walkers, the calling thread being one of
+ * them; one walker visits in a fixed order. Subdirectories are only
+ * entered when recursive is set. Symlinks found inside root are skipped,
+ * like grep -r; root itself may be one. Adds to stats if given. Returns
+ * 0 if root can't be opened.
+ */
+int walk_directory(const char* root, int recursive, size_t num_threads, WalkCallback callback, void* userdata,
+                   WalkStats* stats);
+
+#endif
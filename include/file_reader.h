@@ -12,14 +12,27 @@ typedef enum {
     READ_ERROR_STAT,
     READ_ERROR_DIRECTORY,
     READ_ERROR_MEMORY,
-    READ_ERROR_UNSUPPORTED
+    READ_ERROR_UNSUPPORTED,
+    /* Left unread by file_read_batch() to stay within its byte budget. */
+    READ_DEFERRED
 } ReadStatus;
 
+/* How a pipeline reads its files; AUTO takes io_uring where the kernel allows it. */
+typedef enum {
+    READ_BACKEND_AUTO,
+    READ_BACKEND_SYNC,
+    READ_BACKEND_URING
+} ReadBackend;
+
+/* The io_uring file_read_batch() reads through; created by uring_reader_create(). */
+typedef struct UringReader UringReader;
+
 typedef struct {
     char* data;
     size_t size;
     int fd;
     int is_mapped;
+    int is_binary;
     char* filepath;
 } FileData;
 
@@ -29,19 +42,19 @@ typedef struct {
     size_t capacity;
 } FileList;
 
-typedef void (*FileCallback)(const char* filepath, void* userdata);
-
 FileData* file_open(const char* filepath);
 void file_close(FileData* file);
 ReadStatus file_read(FileData* file);
+ReadStatus file_read_fd(FileData* file, int fd);
+ReadStatus file_load_fd(FileData* file, int fd, size_t size);
+ReadBackend file_read_batch(FileData** files, size_t count, UringReader* reader, size_t max_bytes, ReadStatus* statuses,
+                            int* errors);
 
 FileList* filelist_create(void);
 void filelist_free(FileList* list);
 int filelist_add(FileList* list, FileData* file);
 int filelist_add_path(FileList* list, const char* filepath);
 
-int traverse_directory(const char* dirpath, int recursive, FileCallback callback, void* userdata);
-
 size_t count_lines(const char* data, size_t size);
 const char* find_line_start(const char* data, size_t size, size_t pos);
 const char* find_line_end(const char* data, size_t size, size_t pos);
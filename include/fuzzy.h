@@ -0,0 +1,26 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bit 0 of the Bitap state is the empty prefix, so needles fill bits 1..63. */
+#define FUZZY_MAX_LEN 63
+#define FUZZY_MAX_ERRORS 8
+
+typedef struct {
+    size_t len;
+    int max_errors;
+    int case_insensitive;
+
+    /* Bit i + 1 is set where needle[i] (forward) or needle[len - 1 - i] (reverse) can match the byte. */
+    uint64_t masks[256];
+    uint64_t reverse_masks[256];
+} Fuzzy;
+
+Fuzzy* fuzzy_create(const char* needle, size_t len, int max_errors, int case_insensitive);
+void fuzzy_free(Fuzzy* fuzzy);
+
+size_t fuzzy_find(const Fuzzy* fuzzy, const char* data, size_t size, size_t pos, size_t* match_end);
+
+#endif
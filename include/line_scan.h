@@ -0,0 +1,16 @@
+#ifndef LINE_SCAN_H
+#define LINE_SCAN_H
+
+#include <stddef.h>
+
+/*
+ * Newline primitives shared by the output path and the file_reader line
+ * helpers. Counting runs on the active SIMD kernel: a byte compare
+ * against '\n' whose mask is popcounted a block at a time.
+ */
+size_t line_count_newlines(const char* data, size_t from, size_t to);
+
+size_t line_find_start(const char* data, size_t pos);
+size_t line_find_end(const char* data, size_t size, size_t pos);
+
+#endif
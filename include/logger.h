@@ -2,6 +2,7 @@
 #define LOGGER_H
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <sys/time.h>
 
 typedef enum {
@@ -26,6 +27,7 @@ void logger_set_output(Logger* logger, FILE* output);
 void logger_enable(Logger* logger, int enabled);
 
 void logger_log(Logger* logger, LogLevel level, const char* format, ...);
+void logger_vlog(Logger* logger, LogLevel level, const char* format, va_list args);
 void logger_debug(Logger* logger, const char* format, ...);
 void logger_info(Logger* logger, const char* format, ...);
 void logger_warn(Logger* logger, const char* format, ...);
@@ -34,5 +36,6 @@ void logger_error(Logger* logger, const char* format, ...);
 void logger_timer_start(Logger* logger);
 void logger_timer_stop(Logger* logger);
 void logger_timer_print(Logger* logger);
+double logger_timer_elapsed(Logger* logger);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef MULTI_LITERAL_H
+#define MULTI_LITERAL_H
+
+#include <stddef.h>
+
+#define TEDDY_BUCKETS 8
+#define TEDDY_MAX_FINGERPRINT 3
+#define TEDDY_MAX_LITERALS 256
+
+typedef struct {
+    char** literals;
+    char** folded;
+    size_t* lengths;
+    size_t count;
+    size_t min_len;
+    int case_insensitive;
+
+    /* Teddy prefilter: per fingerprint byte, bucket bits indexed by nibble. */
+    int use_teddy;
+    size_t fingerprint_len;
+    unsigned char lo_masks[TEDDY_MAX_FINGERPRINT][16];
+    unsigned char hi_masks[TEDDY_MAX_FINGERPRINT][16];
+
+    /*
+     * Verification index: literals hashed on their first key_len (folded)
+     * bytes, stored per bucket in pattern order. first_bytes backs the
+     * scalar prefilter.
+     */
+    size_t key_len;
+    size_t bucket_mask;
+    size_t* bucket_start;
+    size_t* bucket_members;
+    unsigned char first_bytes[256];
+    size_t empty_count;
+    size_t* empty_members;
+} MultiLiteral;
+
+MultiLiteral* multi_literal_create(const char* const* literals, size_t count, int case_insensitive);
+void multi_literal_free(MultiLiteral* ml);
+
+size_t multi_literal_find_candidate(const MultiLiteral* ml, const char* data, size_t size, size_t pos);
+size_t multi_literal_next_match(const MultiLiteral* ml, const char* data, size_t size, size_t pos, size_t* cursor);
+
+#endif
@@ -33,12 +33,18 @@ void output_set_color(OutputConfig* config, int enable);
 void output_set_line_numbers(OutputConfig* config, int enable);
 void output_set_show_filename(OutputConfig* config, int enable);
 void output_set_quiet(OutputConfig* config, int enable);
+void output_set_line_buffered(OutputConfig* config, int enable);
 
 void output_color_start(OutputConfig* config, ColorCode color);
 void output_color_end(OutputConfig* config);
 
 void output_match(OutputConfig* config, const char* filepath, const char* data, size_t size, const Match* match);
 void output_matches(OutputConfig* config, const char* filepath, const char* data, size_t size, const MatchList* matches);
+void output_matches_from(OutputConfig* config, const char* filepath, const char* data, size_t size,
+                         const MatchList* matches, size_t first_line);
+void output_count(OutputConfig* config, const char* filepath, size_t count);
+void output_filename(OutputConfig* config, const char* filepath);
+void output_binary_match(OutputConfig* config, const char* filepath);
 
 void output_error(const char* message);
 void output_info(const char* message);
@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "../include/file_reader.h"
+#include "../include/search.h"
+#include "../include/uring_reader.h"
+
+/* Default caps on files between submit and output, and on their loaded bytes. */
+#define PIPELINE_MAX_FILES 512
+#define PIPELINE_MAX_BYTES (64 * 1024 * 1024)
+/* Most files handed to one file_read_batch() call. */
+#define PIPELINE_READ_BATCH 64
+/* The reader waits up to PIPELINE_GATHER_US for this many queued files before it reads. */
+#define PIPELINE_READ_MIN 16
+#define PIPELINE_GATHER_US 1000
+
+/*
+ * Gets each file once it has been searched, in submission order. status
+ * and error are the read result; matches is NULL when the read failed.
+ * named is what the file was submitted with. The file is closed when the
+ * callback returns. Returns 0 to stop the pipeline.
+ */
+typedef int (*PipelineCallback)(const FileData* file, ReadStatus status, int error, int named,
+                                const MatchList* matches, void* userdata);
+
+typedef struct {
+    size_t num_threads;
+    size_t max_files;
+    /* Reading pauses while the files in flight hold this many bytes; 0 means no cap. */
+    size_t max_bytes;
+    ReadBackend backend;
+    /* Files are read and reported but not searched (-m 0). */
+    int skip_search;
+} PipelineConfig;
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_READ,
+    SLOT_DONE
+} SlotState;
+
+typedef struct {
+    FileData* file;
+    MatchList* matches;
+    ReadStatus status;
+    int error;
+    int named;
+    /* Counted against max_bytes from read to output. */
+    size_t bytes;
+    SlotState state;
+} PipelineSlot;
+
+/*
+ * Slots form a ring indexed by submission number, like the blocks of a
+ * parallel stream: the caller queues opened files, the reader thread
+ * reads them in batches, workers search them, and whichever worker finds
+ * the oldest slot DONE reports the run of finished files from there and
+ * frees them. A full ring holds up the caller and a full byte budget
+ * holds up the reader, so memory stays bounded while every stage runs.
+ */
+typedef struct {
+    const Pattern* pattern;
+    const SearchOptions* options;
+    PipelineConfig config;
+    PipelineCallback callback;
+    void* userdata;
+
+    PipelineSlot* slots;
+    size_t slot_count;
+
+    /* One condition per kind of waiter, signalled only when someone waits, to keep handoffs cheap. */
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;
+    pthread_cond_t readable;
+    pthread_cond_t space;
+    int reader_waiting;
+    size_t submit_waiting;
+    size_t next_submit;
+    size_t next_read;
+    size_t next_search;
+    size_t next_output;
+    size_t bytes_in_flight;
+    int finished;
+    int reading_done;
+    int stop;
+    int draining;
+    /* Set on the first hit under -q; read by the kernels between blocks. */
+    int cancelled;
+
+    pthread_t reader;
+    /* Only the reader thread touches this, until file_pipeline_free() releases it. */
+    UringReader* uring;
+    int uring_tried;
+    pthread_t* workers;
+    size_t worker_count;
+    int reader_started;
+
+    /* Read back after file_pipeline_finish(). */
+    ReadBackend backend_used;
+    size_t peak_files;
+    size_t peak_bytes;
+} FilePipeline;
+
+void pipeline_config_init(PipelineConfig* config);
+
+FilePipeline* file_pipeline_create(const Pattern* pattern, const SearchOptions* options, const PipelineConfig* config,
+                                   PipelineCallback callback, void* userdata);
+int file_pipeline_submit(FilePipeline* pipeline, FileData* file, int named);
+void file_pipeline_finish(FilePipeline* pipeline);
+void file_pipeline_free(FilePipeline* pipeline);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef REGEX_DFA_H
+#define REGEX_DFA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DFA_MAX_NFA_STATES 20000
+#define DFA_MAX_REPEAT 255
+#define DFA_CACHE_STATES 2048
+#define DFA_MAX_LITERAL 255
+#define DFA_TABLE_MAX_STATES 256
+
+#define DFA_FLAG_ACCEPT 1
+#define DFA_FLAG_ACCEPT_EOL 2
+#define DFA_FLAG_DEAD 4
+
+typedef enum {
+    RNODE_EMPTY,
+    RNODE_SET,
+    RNODE_CONCAT,
+    RNODE_ALT,
+    RNODE_REPEAT,
+    RNODE_BOL,
+    RNODE_EOL
+} RegexNodeType;
+
+typedef struct {
+    RegexNodeType type;
+    int set;
+    int literal;
+    int min;
+    int max;
+    int left;
+    int right;
+} RegexNode;
+
+typedef enum {
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_EPSILON,
+    NFA_BOL,
+    NFA_EOL,
+    NFA_MATCH
+} NFAStateType;
+
+typedef struct {
+    NFAStateType type;
+    int set;
+    int out;
+    int out1;
+} NFAState;
+
+typedef struct DFACache DFACache;
+typedef struct RegexJit RegexJit;
+
+/*
+ * The unanchored automaton expanded ahead of time: next[state * 256 + byte]
+ * for every byte except '\n', which always ends the line. start[bol] is
+ * the state at the beginning of a scan.
+ */
+typedef struct {
+    size_t state_count;
+    int32_t* next;
+    unsigned char* flags;
+    int start[2];
+} DFATable;
+
+typedef struct RegexDFA {
+    RegexNode* nodes;
+    size_t node_count;
+    int root;
+
+    uint64_t (*sets)[4];
+    size_t set_count;
+
+    NFAState* nfa;
+    size_t nfa_count;
+    int nfa_start;
+
+    unsigned char byte_class[256];
+    unsigned char class_rep[256];
+    size_t class_count;
+
+    pthread_mutex_t pool_mutex;
+    DFACache** pool;
+    size_t pool_count;
+    size_t pool_capacity;
+
+    RegexJit* jit;
+
+    /*
+     * The same pattern read right to left (concatenations reversed, ^ and
+     * $ swapped), scanned backwards over a line to mark where matches
+     * start. It has no nodes or pool of its own.
+     */
+    struct RegexDFA* reverse;
+} RegexDFA;
+
+RegexDFA* regex_dfa_compile(const char* pattern, int case_insensitive);
+void regex_dfa_free(RegexDFA* dfa);
+
+char* regex_dfa_required_literal(const RegexDFA* dfa);
+
+DFACache* regex_dfa_acquire(RegexDFA* dfa);
+void regex_dfa_release(RegexDFA* dfa, DFACache* cache);
+
+DFATable* regex_dfa_table_create(const RegexDFA* dfa, size_t max_states);
+void regex_dfa_table_free(DFATable* table);
+
+int regex_dfa_enable_jit(RegexDFA* dfa);
+
+int regex_dfa_find(const RegexDFA* dfa, DFACache* cache, const char* data, size_t size, size_t from,
+                   size_t* match_start, size_t* match_end);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef REGEX_JIT_H
+#define REGEX_JIT_H
+
+#include "regex_dfa.h"
+#include <stddef.h>
+
+#define REGEX_JIT_NO_MATCH ((size_t)-1)
+
+/*
+ * Scans data[from, size) across lines and returns the earliest position
+ * where a match ends (a '\n' index for matches ending at end of line),
+ * or REGEX_JIT_NO_MATCH. bol says whether from starts a line.
+ */
+typedef size_t (*RegexJitScan)(const unsigned char* data, size_t from, size_t size, int bol);
+
+struct RegexJit {
+    void* code;
+    size_t size;
+    RegexJitScan scan;
+};
+
+int regex_jit_available(void);
+
+RegexJit* regex_jit_compile(const DFATable* table);
+void regex_jit_free(RegexJit* jit);
+
+#endif
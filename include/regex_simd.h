@@ -3,39 +3,117 @@
 
 #include <stddef.h>
 #include <regex.h>
+#include "../include/multi_literal.h"
+#include "../include/dictionary.h"
+#include "../include/regex_dfa.h"
+#include "../include/two_way.h"
+#include "../include/casefold.h"
+#include "../include/fuzzy.h"
+#include "../include/cpu_dispatch.h"
 
 typedef enum {
     MATCH_ASCII,
-    MATCH_REGEX
+    MATCH_REGEX,
+    MATCH_MULTI,
+    MATCH_DICT,
+    MATCH_FUZZY
 } MatchType;
 
-typedef struct {
+typedef struct Pattern {
     char* pattern;
+    char* folded;
     size_t pattern_len;
     int case_insensitive;
     MatchType type;
     regex_t regex_compiled;
     int is_regex_compiled;
+    MultiLiteral* multi;
+    Dictionary* dict;
+    RegexDFA* dfa;
+    struct Pattern* prefilter;
+    TwoWay* two_way;
+    CaseNeedle* casefold;
+    Fuzzy* fuzzy;
+
+    /* -w / -x: occurrences must sit on word or line boundaries. */
+    int match_words;
+    int match_lines;
 } Pattern;
 
+/*
+ * MATCH_MODE_ALL records every occurrence. MATCH_MODE_LINES records each
+ * matching line once, as [line start, line end), with its occurrences as
+ * highlight spans when those are asked for. MATCH_MODE_COUNT only tallies
+ * matching lines in count and stores nothing.
+ *
+ * Inverted lists (search_pattern() only) select the lines that don't
+ * match: LINES records are then the gaps between matching lines, each
+ * spanning whole lines, and COUNT counts the non-matching lines.
+ */
+typedef enum {
+    MATCH_MODE_ALL,
+    MATCH_MODE_LINES,
+    MATCH_MODE_COUNT
+} MatchMode;
+
 typedef struct {
     size_t start;
     size_t end;
+} Span;
+
+typedef struct {
+    size_t start;
+    size_t end;
+    /* 0 from the searches; output_matches() fills it in when -n is on. */
     size_t line_num;
+    /*
+     * Which of the literals or dictionary entries matched. Regex sets are
+     * joined into one alternation, so their matches always report 0.
+     */
+    size_t pattern_index;
+    /* Line mode: this line's run of MatchList.spans. */
+    size_t span_index;
+    size_t span_count;
 } Match;
 
 typedef struct {
     Match* matches;
     size_t count;
     size_t capacity;
+
+    MatchMode mode;
+    int highlight;
+    Span* spans;
+    size_t span_total;
+    size_t span_capacity;
+
+    int invert;
+    /* Stop scanning once count reaches limit; 0 means no limit. Not applied when inverted. */
+    size_t limit;
+    /* End of the last matching line, for COUNT mode and inverted gaps. */
+    size_t line_end;
+    int line_seen;
+
+    /* Shared flag; once another thread sets it, search_pattern() stops at the next block. */
+    const int* cancel;
 } MatchList;
 
 Pattern* pattern_create(const char* pattern_str, int case_insensitive, int use_regex);
+Pattern* pattern_create_multi(const char* const* patterns, size_t count, int case_insensitive, int use_regex);
+Pattern* pattern_create_fuzzy(const char* pattern_str, int max_errors, int case_insensitive);
 void pattern_free(Pattern* pattern);
+void pattern_set_boundaries(Pattern* pattern, int match_words, int match_lines);
+int pattern_enable_jit(Pattern* pattern);
 
 MatchList* matchlist_create(void);
 void matchlist_free(MatchList* list);
+void matchlist_clear(MatchList* list);
+void matchlist_set_mode(MatchList* list, MatchMode mode, int highlight);
+void matchlist_set_invert(MatchList* list, int invert);
+void matchlist_set_limit(MatchList* list, size_t limit);
+void matchlist_set_cancel(MatchList* list, const int* cancel);
 int matchlist_add(MatchList* list, size_t start, size_t end, size_t line_num);
+int matchlist_add_indexed(MatchList* list, size_t start, size_t end, size_t line_num, size_t pattern_index);
 
 int pattern_match_ascii(const Pattern* pattern, const char* data, size_t size, size_t pos);
 int pattern_match_ascii_case(const Pattern* pattern, const char* data, size_t size, size_t pos);
@@ -43,14 +121,17 @@ int pattern_match_regex(const Pattern* pattern, const char* data, size_t size, s
 
 int search_pattern(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
 int search_pattern_ascii(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_fuzzy(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_casefold(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_two_way(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
 int search_pattern_regex(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_multi(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_dict(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
 
-#ifdef __SSE4_2__
+#ifdef CPU_X86
 int search_pattern_sse42(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
-#endif
-
-#ifdef __AVX2__
 int search_pattern_avx2(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+int search_pattern_avx512(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
 #endif
 
 int is_simd_available(void);
@@ -4,43 +4,39 @@
 #include <pthread.h>
 #include <stddef.h>
 #include "../include/file_reader.h"
+#include "../include/chunk_reader.h"
 #include "../include/regex_simd.h"
 
 typedef struct {
-    const Pattern* pattern;
-    const FileData* file;
-    MatchList* matches;
-    int file_index;
-} SearchTask;
-
-typedef struct {
-    SearchTask* tasks;
-    size_t count;
-    size_t capacity;
-    pthread_mutex_t mutex;
-    size_t next_task;
-} TaskQueue;
-
-typedef struct {
-    TaskQueue* queue;
-    pthread_t* threads;
-    size_t num_threads;
-    size_t files_searched;
-    size_t total_matches;
-    pthread_mutex_t result_mutex;
-} SearchContext;
-
-TaskQueue* taskqueue_create(void);
-void taskqueue_free(TaskQueue* queue);
-int taskqueue_add(TaskQueue* queue, const Pattern* pattern, const FileData* file, int file_index);
-SearchTask* taskqueue_get_next(TaskQueue* queue);
-
-SearchContext* search_context_create(size_t num_threads);
-void search_context_free(SearchContext* context);
-int search_context_run(SearchContext* context, TaskQueue* queue);
-void* search_worker(void* arg);
+    MatchMode mode;
+    int highlight;
+    int invert;
+    /* Per-file cap on matches or lines; 0 means none. */
+    size_t limit;
+    /* Cancel every worker once one file has a hit (-q). */
+    int stop_on_match;
+    /* Binary files are never searched and count as having no selected lines. */
+    int skip_binary;
+    /* Binary files stop at their first selected line: only "binary file matches" is printed. */
+    int binary_summary;
+} SearchOptions;
+
+/*
+ * Gets each streamed window with its records, whose offsets are relative
+ * to data, before the buffer is reused. first_line is the window's first
+ * line number when the reader counts lines. A record's pattern_index
+ * names the -f literal that hit; regex pattern files always give 0.
+ * Returns 0 to stop reading.
+ */
+typedef int (*StreamCallback)(const char* data, size_t size, size_t first_line, const MatchList* matches,
+                              void* userdata);
+
+void search_options_init(SearchOptions* options);
 
 int search_single_file(const Pattern* pattern, const FileData* file, MatchList* matches);
-int search_multiple_files(const Pattern* pattern, const FileList* files, size_t num_threads, MatchList*** results);
+int search_stream(const Pattern* pattern, ChunkReader* reader, const SearchOptions* options,
+                  StreamCallback callback, void* userdata, size_t* selected);
+int search_stream_parallel(const Pattern* pattern, ChunkReader* reader, const SearchOptions* options,
+                           size_t num_threads, StreamCallback callback, void* userdata, size_t* selected);
 
 #endif
\ No newline at end of file
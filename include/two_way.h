@@ -0,0 +1,25 @@
+#ifndef TWO_WAY_H
+#define TWO_WAY_H
+
+#include <stddef.h>
+
+typedef struct {
+    unsigned char* needle;
+    size_t len;
+    int case_insensitive;
+
+    /* Critical factorization: needle = needle[0, suffix) . needle[suffix, len). */
+    size_t suffix;
+    size_t period;
+    int periodic;
+
+    /* Horspool shift on the byte under the needle's last position. */
+    size_t shift[256];
+} TwoWay;
+
+TwoWay* two_way_create(const char* needle, size_t len, int case_insensitive);
+void two_way_free(TwoWay* tw);
+
+size_t two_way_find(const TwoWay* tw, const char* data, size_t size, size_t pos);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef URING_READER_H
+#define URING_READER_H
+
+#include <stddef.h>
+#include "file_reader.h"
+
+/* Ring depth, and how many files may be between open and close at once. */
+#define URING_ENTRIES 256
+#define URING_MAX_FILES 96
+
+int uring_reader_available(void);
+
+/*
+ * Sets up the ring uring_read_files() works through, once per reading
+ * thread rather than per batch. Returns NULL if io_uring can't be used here.
+ */
+UringReader* uring_reader_create(void);
+void uring_reader_free(UringReader* reader);
+
+/*
+ * Reads files[0..count) through the reader's ring: opens and statx calls
+ * go out in batches, each completed pair queues the read, and each read
+ * queues the close, so the only syscalls are the batched enters. Files
+ * larger than max_size come back as READ_ERROR_UNSUPPORTED, still open
+ * on file->fd with file->size set, for the caller to map; any other file
+ * left unread has no descriptor. With max_bytes set, the first file whose
+ * statx size would take the batch past it (never files[0]) and all after
+ * it come back READ_DEFERRED, untouched. errors[i] gets the errno of a
+ * failed file. Returns 0, touching nothing, if the ring can't be used
+ * (any more). One thread at a time per reader.
+ */
+int uring_read_files(UringReader* reader, FileData** files, size_t count, size_t max_size, size_t max_bytes,
+                     ReadStatus* statuses, int* errors);
+
+#endif
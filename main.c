@@ -1,6 +1,9 @@
 #include "include/file_reader.h"
+#include "include/chunk_reader.h"
 #include "include/regex_simd.h"
 #include "include/search.h"
+#include "include/pipeline.h"
+#include "include/dir_walker.h"
 #include "include/output.h"
 #include "include/logger.h"
 #include <stdio.h>
@@ -12,19 +15,47 @@
 
 #define VERSION "1.0.1"
 
+typedef enum {
+    BINARY_FILES_BINARY,
+    BINARY_FILES_WITHOUT_MATCH,
+    BINARY_FILES_TEXT
+} BinaryFilesMode;
+
 typedef struct {
     char** paths;
     size_t path_count;
     char* pattern;
+    char** patterns;
+    size_t pattern_count;
+    size_t pattern_capacity;
+    int pattern_file_used;
     int recursive;
     int ignore_case;
     int use_regex;
+    int word_regexp;
+    int line_regexp;
+    int fuzzy_errors;
+    int jit;
+    int stream;
+    ReadBackend read_backend;
+    size_t inflight_files;
+    size_t inflight_bytes;
+    int line_buffered;
+    int invert;
+    int count;
+    int files_with_matches;
+    int files_without_match;
+    long max_count;
+    BinaryFilesMode binary_files;
     int color;
     int line_numbers;
     int show_filename;
     int quiet;
     int verbose;
     size_t num_threads;
+    size_t walkers;
+    KernelLevel kernel;
+    int kernel_set;
     int color_set;
     int line_numbers_set;
 } Config;
@@ -33,15 +64,37 @@ void config_init(Config* config) {
     config->paths = NULL;
     config->path_count = 0;
     config->pattern = NULL;
+    config->patterns = NULL;
+    config->pattern_count = 0;
+    config->pattern_capacity = 0;
+    config->pattern_file_used = 0;
     config->recursive = 0;
     config->ignore_case = 0;
     config->use_regex = 0;
+    config->word_regexp = 0;
+    config->line_regexp = 0;
+    config->fuzzy_errors = -1;
+    config->jit = 0;
+    config->stream = 0;
+    config->read_backend = READ_BACKEND_AUTO;
+    config->inflight_files = PIPELINE_MAX_FILES;
+    config->inflight_bytes = PIPELINE_MAX_BYTES;
+    config->line_buffered = 0;
+    config->invert = 0;
+    config->count = 0;
+    config->files_with_matches = 0;
+    config->files_without_match = 0;
+    config->max_count = -1;
+    config->binary_files = BINARY_FILES_BINARY;
     config->color = 0;
     config->line_numbers = 0;
     config->show_filename = 0;
     config->quiet = 0;
     config->verbose = 0;
     config->num_threads = 1;
+    config->walkers = 0;
+    config->kernel = KERNEL_SCALAR;
+    config->kernel_set = 0;
     config->color_set = 0;
     config->line_numbers_set = 0;
 }
@@ -59,29 +112,104 @@ void config_free(Config* config) {
     if (config->pattern) {
         free(config->pattern);
     }
+
+    if (config->patterns) {
+        for (size_t i = 0; i < config->pattern_count; i++) {
+            free(config->patterns[i]);
+        }
+        free(config->patterns);
+    }
+}
+
+int load_pattern_file(Config* config, const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "fgrep: %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &line_capacity, fp)) >= 0) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+
+        if (config->pattern_count >= config->pattern_capacity) {
+            size_t new_capacity = config->pattern_capacity == 0 ? 16 : config->pattern_capacity * 2;
+            char** new_patterns = (char**)realloc(config->patterns, sizeof(char*) * new_capacity);
+            if (!new_patterns) {
+                free(line);
+                fclose(fp);
+                fprintf(stderr, "Memory allocation error\n");
+                return 0;
+            }
+            config->patterns = new_patterns;
+            config->pattern_capacity = new_capacity;
+        }
+
+        config->patterns[config->pattern_count] = strdup(line);
+        if (!config->patterns[config->pattern_count]) {
+            free(line);
+            fclose(fp);
+            fprintf(stderr, "Memory allocation error\n");
+            return 0;
+        }
+        config->pattern_count++;
+    }
+
+    free(line);
+    fclose(fp);
+    config->pattern_file_used = 1;
+    return 1;
 }
 
 void print_usage(const char* program_name) {
     printf("fastgrep %s - Ultra-fast grep replacement\n", VERSION);
     printf("Usage: %s [OPTIONS] PATTERN [FILE...]\n", program_name);
+    printf("       %s [OPTIONS] -f PATTERN_FILE [FILE...]\n", program_name);
     printf("\n");
     printf("Pattern Matching:\n");
     printf("  -e, --regex            Use regex matching (default: ASCII substring)\n");
     printf("  -i, --ignore-case      Case-insensitive search\n");
+    printf("  -f, --file <FILE>      Read patterns from FILE, one per line (repeatable)\n");
+    printf("  -w, --word-regexp      Only match whole words\n");
+    printf("  -x, --line-regexp      Only match whole lines (overrides -w)\n");
+    printf("  -v, --invert-match     Select non-matching lines\n");
+    printf("      --fuzzy=<K>        Match the literal with up to K edits (at most %d, pattern up to %d bytes)\n",
+           FUZZY_MAX_ERRORS, FUZZY_MAX_LEN);
+    printf("      --jit              Compile -e patterns to x86-64 machine code (falls back to the DFA interpreter)\n");
     printf("\n");
     printf("Search Options:\n");
     printf("  -r, --recursive        Recursively search directories\n");
+    printf("      --binary-files=<TYPE>  Files with a NUL byte: binary (report a match), without-match (skip), text\n");
     printf("      --threads <N>      Number of threads (default: 1)\n");
+    printf("      --walkers=<N>      Directory walker threads for -r (default: --threads; 1 keeps a fixed order)\n");
+    printf("      --io=<MODE>        Read files with auto, uring (io_uring batches) or sync (read() per file)\n");
+    printf("      --inflight-files=<N>  Files between traversal and output at once (default: %d)\n",
+           PIPELINE_MAX_FILES);
+    printf("      --inflight-mb=<N>  Pause reading while loaded files hold N MB (default: %d, 0 = no cap)\n",
+           PIPELINE_MAX_BYTES / (1024 * 1024));
+    printf("      --stream           Read files in %d MB windows instead of whole (bounded memory, one file at a time)\n",
+           CHUNK_WINDOW_SIZE / (1024 * 1024));
     printf("\n");
     printf("Output Options:\n");
     printf("  -n, --line-number      Show line numbers\n");
     printf("      --no-line-number    Don't show line numbers\n");
     printf("      --color            Highlight matches (default when TTY)\n");
     printf("      --no-color          Don't highlight matches\n");
-    printf("  -q, --quiet            Quiet mode (only exit code matters)\n");
+    printf("  -c, --count            Print only a count of selected lines per file\n");
+    printf("  -l, --files-with-matches  Print only names of files with selected lines\n");
+    printf("  -L, --files-without-match Print only names of files with no selected lines\n");
+    printf("  -m, --max-count <NUM>  Stop reading a file after NUM selected lines\n");
+    printf("      --line-buffered    Flush output after every line (for tail -f pipelines)\n");
+    printf("  -q, --quiet            Quiet mode (only exit code matters; stops at the first match)\n");
     printf("\n");
     printf("Other Options:\n");
-    printf("  -v, --verbose          Verbose output\n");
+    printf("      --verbose          Verbose output\n");
+    printf("      --kernel=<NAME>    Force a matching kernel: scalar, sse4.2, avx2, avx512bw (default: best for this CPU)\n");
     printf("  -h, --help             Show this help message\n");
     printf("      --version          Show version information\n");
     printf("\n");
@@ -91,6 +219,7 @@ void print_usage(const char* program_name) {
     printf("  %s -i -n pattern file.txt\n", program_name);
     printf("  %s -e 'error.*[0-9]+' file.txt\n", program_name);
     printf("  %s --threads 4 pattern *.log\n", program_name);
+    printf("  %s -f signatures.txt /var/log/app\n", program_name);
 }
 
 int parse_arguments(int argc, char** argv, Config* config) {
@@ -121,6 +250,72 @@ int parse_arguments(int argc, char** argv, Config* config) {
             config->ignore_case = 1;
         } else if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--regex") == 0) {
             config->use_regex = 1;
+        } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--word-regexp") == 0) {
+            config->word_regexp = 1;
+        } else if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--line-regexp") == 0) {
+            config->line_regexp = 1;
+        } else if (strncmp(argv[i], "--fuzzy=", 8) == 0) {
+            char* end;
+            long errors = strtol(argv[i] + 8, &end, 10);
+            if (end == argv[i] + 8 || *end != '\0' || errors < 0 || errors > FUZZY_MAX_ERRORS) {
+                fprintf(stderr, "Error: --fuzzy takes a number of edits from 0 to %d\n", FUZZY_MAX_ERRORS);
+                return 0;
+            }
+            config->fuzzy_errors = (int)errors;
+        } else if (strncmp(argv[i], "--binary-files=", 15) == 0) {
+            const char* type = argv[i] + 15;
+            if (strcmp(type, "binary") == 0) {
+                config->binary_files = BINARY_FILES_BINARY;
+            } else if (strcmp(type, "without-match") == 0) {
+                config->binary_files = BINARY_FILES_WITHOUT_MATCH;
+            } else if (strcmp(type, "text") == 0) {
+                config->binary_files = BINARY_FILES_TEXT;
+            } else {
+                fprintf(stderr, "Error: --binary-files takes binary, without-match or text\n");
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--io=", 5) == 0) {
+            const char* mode = argv[i] + 5;
+            if (strcmp(mode, "auto") == 0) {
+                config->read_backend = READ_BACKEND_AUTO;
+            } else if (strcmp(mode, "uring") == 0) {
+                config->read_backend = READ_BACKEND_URING;
+            } else if (strcmp(mode, "sync") == 0) {
+                config->read_backend = READ_BACKEND_SYNC;
+            } else {
+                fprintf(stderr, "Error: --io takes auto, uring or sync\n");
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--walkers=", 10) == 0) {
+            char* end;
+            long walkers = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || walkers < 1) {
+                fprintf(stderr, "Error: --walkers takes a number of threads (at least 1)\n");
+                return 0;
+            }
+            config->walkers = (size_t)walkers;
+        } else if (strncmp(argv[i], "--inflight-files=", 17) == 0) {
+            char* end;
+            long files = strtol(argv[i] + 17, &end, 10);
+            if (end == argv[i] + 17 || *end != '\0' || files < 1) {
+                fprintf(stderr, "Error: --inflight-files takes a number of files (at least 1)\n");
+                return 0;
+            }
+            config->inflight_files = (size_t)files;
+        } else if (strncmp(argv[i], "--inflight-mb=", 14) == 0) {
+            char* end;
+            long megabytes = strtol(argv[i] + 14, &end, 10);
+            if (end == argv[i] + 14 || *end != '\0' || megabytes < 0) {
+                fprintf(stderr, "Error: --inflight-mb takes a size in MB (0 for no cap)\n");
+                return 0;
+            }
+            config->inflight_bytes = (size_t)megabytes * 1024 * 1024;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            config->stream = 1;
+        } else if (strcmp(argv[i], "--line-buffered") == 0) {
+            config->line_buffered = 1;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            config->jit = 1;
         } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--line-number") == 0) {
             config->line_numbers = 1;
             config->line_numbers_set = 1;
@@ -135,8 +330,39 @@ int parse_arguments(int argc, char** argv, Config* config) {
             config->color_set = 1;
         } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0) {
             config->quiet = 1;
-        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--invert-match") == 0) {
+            config->invert = 1;
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0) {
+            config->count = 1;
+        } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--files-with-matches") == 0) {
+            config->files_with_matches = 1;
+            config->files_without_match = 0;
+        } else if (strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "--files-without-match") == 0) {
+            config->files_without_match = 1;
+            config->files_with_matches = 0;
+        } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--max-count") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires an argument\n", argv[i]);
+                return 0;
+            }
+            char* end;
+            config->max_count = strtol(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || config->max_count < 0) {
+                fprintf(stderr, "Error: invalid max count '%s'\n", argv[i + 1]);
+                return 0;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
             config->verbose = 1;
+        } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires an argument\n", argv[i]);
+                return 0;
+            }
+            if (!load_pattern_file(config, argv[i + 1])) {
+                return 0;
+            }
+            i++;
         } else if (strcmp(argv[i], "--threads") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --threads requires an argument\n");
@@ -144,11 +370,17 @@ int parse_arguments(int argc, char** argv, Config* config) {
             }
             config->num_threads = (size_t)atoi(argv[i + 1]);
             i++;
+        } else if (strncmp(argv[i], "--kernel=", 9) == 0) {
+            if (!kernel_parse(argv[i] + 9, &config->kernel)) {
+                fprintf(stderr, "Error: Unknown kernel '%s'\n", argv[i] + 9);
+                return 0;
+            }
+            config->kernel_set = 1;
         } else if (argv[i][0] == '-' && strlen(argv[i]) > 1) {
             fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
             return 0;
         } else {
-            if (!config->pattern) {
+            if (!config->pattern && !config->pattern_file_used) {
                 config->pattern = strdup(argv[i]);
             } else {
                 config->paths[config->path_count++] = strdup(argv[i]);
@@ -157,15 +389,36 @@ int parse_arguments(int argc, char** argv, Config* config) {
         i++;
     }
 
-    if (!config->pattern) {
+    if (config->pattern && config->pattern_file_used) {
+        memmove(config->paths + 1, config->paths, sizeof(char*) * config->path_count);
+        config->paths[0] = config->pattern;
+        config->path_count++;
+        config->pattern = NULL;
+    }
+
+    if (!config->pattern && !config->pattern_file_used) {
         fprintf(stderr, "Error: No pattern specified\n");
         return 0;
     }
 
+    if (config->fuzzy_errors >= 0 && (config->use_regex || config->pattern_file_used)) {
+        fprintf(stderr, "Error: --fuzzy takes a single literal pattern\n");
+        return 0;
+    }
+
     if (config->path_count == 0) {
         config->paths[config->path_count++] = strdup("-");
     }
 
+    /* Stdin on its own is searched as it arrives, so `tail -f | fstgrep` prints matches as they happen. */
+    if (config->path_count == 1 && strcmp(config->paths[0], "-") == 0) {
+        config->stream = 1;
+    }
+
+    if (config->walkers == 0) {
+        config->walkers = config->num_threads > 0 ? config->num_threads : 1;
+    }
+
     if (!config->color_set) {
         config->color = isatty(fileno(stdout)) ? 1 : 0;
     }
@@ -187,208 +440,469 @@ int is_directory(const char* path) {
     return S_ISDIR(st.st_mode);
 }
 
-typedef struct {
-    FileList* filelist;
-    int error;
-} DirectoryTraversalData;
-
-void add_file_to_list(const char* filepath, void* userdata) {
-    DirectoryTraversalData* data = (DirectoryTraversalData*)userdata;
-
-    FileData* file = file_open(filepath);
-    if (!file) {
-        data->error = 1;
-        return;
+/*
+ * Per-file output once a file's search is done: -l/-L names, -c counts,
+ * or the note for a matching binary file. Returns 0 when the file's lines
+ * are to be printed instead.
+ */
+static int report_file(const Config* config, OutputConfig* output_config, const SearchOptions* search_options,
+                       const char* filepath, int is_binary, size_t count) {
+    if (config->files_with_matches || config->files_without_match) {
+        if ((count > 0) == config->files_with_matches) {
+            output_filename(output_config, filepath);
+        }
+        return 1;
     }
-
-    ReadStatus status = file_read(file);
-    if (status != READ_SUCCESS) {
-        file_close(file);
-        return;
+    if (config->count) {
+        output_count(output_config, filepath, count);
+        return 1;
     }
-
-    filelist_add(data->filelist, file);
+    if (count > 0 && search_options->binary_summary && is_binary) {
+        output_binary_match(output_config, filepath);
+        return 1;
+    }
+    return 0;
 }
 
-int main(int argc, char** argv) {
-    Config config;
-    config_init(&config);
-
-    if (!parse_arguments(argc, argv, &config)) {
-        config_free(&config);
-        return 2;
+typedef struct {
+    const Config* config;
+    const Pattern* pattern;
+    const SearchOptions* search_options;
+    OutputConfig* output_config;
+    ChunkReader* reader;
+    const char* filepath;
+    size_t files;
+    size_t total_matches;
+    size_t binary_count;
+    size_t binary_skipped;
+    WalkStats walk;
+    int done;
+} StreamContext;
+
+/* Prints a window's lines while they are still in the reader's buffer. */
+static int stream_window(const char* data, size_t size, size_t first_line, const MatchList* matches, void* userdata) {
+    StreamContext* stream = (StreamContext*)userdata;
+
+    if (matches->mode == MATCH_MODE_LINES && matches->count > 0) {
+        output_matches_from(stream->output_config, stream->filepath, data, size, matches, first_line);
     }
+    return 1;
+}
 
-    Logger* logger = logger_create(config.verbose ? LOG_DEBUG : LOG_WARN);
-    logger_enable(logger, config.verbose);
+/* Searches the input the reader was just opened on, reports it and closes it. */
+static void stream_input(StreamContext* stream, const char* filepath) {
+    const Config* config = stream->config;
+    size_t count = 0;
 
-    if (config.verbose) {
-        logger_info(logger, "fastgrep %s starting", VERSION);
-        logger_info(logger, "Pattern: %s", config.pattern);
-        logger_info(logger, "Recursive: %s", config.recursive ? "yes" : "no");
-        logger_info(logger, "Case insensitive: %s", config.ignore_case ? "yes" : "no");
-        logger_info(logger, "Regex mode: %s", config.use_regex ? "yes" : "no");
-        logger_info(logger, "Threads: %zu", config.num_threads);
+    stream->filepath = filepath;
+    if (config->max_count != 0 &&
+        !search_stream_parallel(stream->pattern, stream->reader, stream->search_options, config->num_threads,
+                                stream_window, stream, &count)) {
+        fprintf(stderr, "fgrep: %s: %s\n", filepath, strerror(errno));
     }
 
-    FileList* filelist = filelist_create();
-    if (!filelist) {
-        output_error("Memory allocation error");
-        config_free(&config);
-        logger_free(logger);
-        return 2;
+    if (stream->reader->is_binary) {
+        stream->binary_count++;
+        if (stream->search_options->skip_binary) {
+            stream->binary_skipped++;
+        }
+    }
+    /* As in pipeline_report(): -m 0 selects no lines, so only -L has anything to say. */
+    if (config->max_count == 0) {
+        if (config->files_without_match && !config->quiet) {
+            output_filename(stream->output_config, filepath);
+        }
+    } else if (!config->quiet) {
+        report_file(config, stream->output_config, stream->search_options, filepath, stream->reader->is_binary,
+                    count);
     }
 
-    DirectoryTraversalData traversal_data;
-    traversal_data.filelist = filelist;
-    traversal_data.error = 0;
+    stream->files++;
+    stream->total_matches += count;
+    if (config->quiet && count > 0) {
+        stream->done = 1;
+    }
+    chunk_reader_close(stream->reader);
+}
 
-    for (size_t i = 0; i < config.path_count; i++) {
-        const char* path = config.paths[i];
+int stream_file(const char* filepath, void* userdata) {
+    StreamContext* stream = (StreamContext*)userdata;
 
-        if (strcmp(path, "-") == 0) {
-            char buffer[8192];
-            size_t total_size = 0;
-            size_t buffer_capacity = 8192;
-            char* content = (char*)malloc(buffer_capacity);
-
-            while (fgets(buffer, sizeof(buffer), stdin)) {
-                size_t len = strlen(buffer);
-                if (total_size + len >= buffer_capacity) {
-                    buffer_capacity *= 2;
-                    char* new_content = (char*)realloc(content, buffer_capacity);
-                    if (!new_content) {
-                        free(content);
-                        output_error("Memory allocation error");
-                        config_free(&config);
-                        logger_free(logger);
-                        return 2;
-                    }
-                    content = new_content;
-                }
-                memcpy(content + total_size, buffer, len);
-                total_size += len;
-            }
-
-            FileData* file = file_open("(stdin)");
-            if (!file) {
-                free(content);
-                output_error("Memory allocation error");
-                config_free(&config);
-                logger_free(logger);
-                return 2;
-            }
+    if (!stream->done && chunk_reader_open(stream->reader, filepath) == READ_SUCCESS) {
+        stream_input(stream, filepath);
+    }
+    return !stream->done;
+}
 
-            file->data = content;
-            file->size = total_size;
-            file->is_mapped = 0;
-            file->fd = -1;
+/*
+ * --stream: each input is searched as it is opened, one window at a time,
+ * and closed before the next, so memory holds one window whatever the
+ * input sizes. Returns 2 on a usage error, otherwise 1.
+ */
+static int stream_paths(const Config* config, StreamContext* stream) {
+    for (size_t i = 0; i < config->path_count && !stream->done; i++) {
+        const char* path = config->paths[i];
 
-            filelist_add(filelist, file);
+        if (strcmp(path, "-") == 0) {
+            chunk_reader_attach(stream->reader, STDIN_FILENO);
+            stream_input(stream, "(stdin)");
         } else if (is_directory(path)) {
-            if (!config.recursive) {
+            if (!config->recursive) {
                 output_error("Path is a directory, use -r to search recursively");
-                config_free(&config);
-                logger_free(logger);
-                filelist_free(filelist);
                 return 2;
             }
-            traverse_directory(path, config.recursive, add_file_to_list, &traversal_data);
+            /* One walker: files are streamed on the calling thread as they are found. */
+            walk_directory(path, config->recursive, 1, stream_file, stream, &stream->walk);
         } else {
-            FileData* file = file_open(path);
-            if (!file) {
-                fprintf(stderr, "fgrep: %s: %s\n", path, strerror(errno));
-                continue;
-            }
-
-            ReadStatus status = file_read(file);
+            ReadStatus status = chunk_reader_open(stream->reader, path);
             if (status != READ_SUCCESS) {
                 if (status == READ_ERROR_DIRECTORY) {
                     fprintf(stderr, "fgrep: %s: is a directory\n", path);
                 } else {
                     fprintf(stderr, "fgrep: %s: %s\n", path, strerror(errno));
                 }
+                continue;
+            }
+            stream_input(stream, path);
+        }
+    }
+    return 1;
+}
+
+typedef struct {
+    const Config* config;
+    const SearchOptions* search_options;
+    OutputConfig* output_config;
+    FilePipeline* pipeline;
+    size_t files;
+    size_t total_matches;
+    size_t binary_count;
+    WalkStats walk;
+    /* Set by any walker once the pipeline turns a file away. */
+    int stopped;
+} PipelineContext;
+
+/*
+ * Prints one file's results as the pipeline hands them over in input
+ * order. Read errors are reported for named paths only; files found by
+ * traversal are skipped quietly.
+ */
+static int pipeline_report(const FileData* file, ReadStatus status, int error, int named, const MatchList* matches,
+                           void* userdata) {
+    PipelineContext* run = (PipelineContext*)userdata;
+    const Config* config = run->config;
+
+    if (status != READ_SUCCESS) {
+        if (named && status == READ_ERROR_DIRECTORY) {
+            fprintf(stderr, "fgrep: %s: is a directory\n", file->filepath);
+        } else if (named) {
+            fprintf(stderr, "fgrep: %s: %s\n", file->filepath, strerror(error));
+        }
+        return 1;
+    }
+
+    run->files++;
+    if (file->is_binary) {
+        run->binary_count++;
+    }
+
+    /* -m 0 reads nothing: no file has a selected line. */
+    if (config->max_count == 0) {
+        if (config->files_without_match) {
+            output_filename(run->output_config, file->filepath);
+        }
+        return 1;
+    }
+
+    size_t count = matches->count;
+    if (!config->quiet &&
+        !report_file(config, run->output_config, run->search_options, file->filepath, file->is_binary, count) &&
+        count > 0) {
+        output_matches(run->output_config, file->filepath, file->data, file->size, matches);
+    }
+    run->total_matches += count;
+    return !(config->quiet && count > 0);
+}
+
+/* Called by every walker thread; the pipeline serializes the submits. */
+int submit_file(const char* filepath, void* userdata) {
+    PipelineContext* run = (PipelineContext*)userdata;
+
+    FileData* file = file_open(filepath);
+    if (file && !file_pipeline_submit(run->pipeline, file, 0)) {
+        __atomic_store_n(&run->stopped, 1, __ATOMIC_RELAXED);
+    }
+    return !__atomic_load_n(&run->stopped, __ATOMIC_RELAXED);
+}
+
+/*
+ * Feeds every input to the pipeline as it is found: named files and
+ * stdin in argument order, directories as they are walked. With several
+ * walkers, files from one directory tree arrive in no fixed order. Stdin
+ * is read whole here, since it can't be batched with the rest.
+ */
+static void submit_paths(const Config* config, PipelineContext* run) {
+    for (size_t i = 0; i < config->path_count && !__atomic_load_n(&run->stopped, __ATOMIC_RELAXED); i++) {
+        const char* path = config->paths[i];
+        FileData* file;
+
+        if (strcmp(path, "-") == 0) {
+            file = file_open("(stdin)");
+            if (file && file_read_fd(file, STDIN_FILENO) != READ_SUCCESS) {
+                fprintf(stderr, "fgrep: (stdin): %s\n", strerror(errno));
                 file_close(file);
                 continue;
             }
+        } else if (is_directory(path)) {
+            walk_directory(path, config->recursive, config->walkers, submit_file, run, &run->walk);
+            continue;
+        } else {
+            file = file_open(path);
+        }
+
+        if (!file) {
+            output_error("Memory allocation error");
+            continue;
+        }
+        if (!file_pipeline_submit(run->pipeline, file, 1)) {
+            __atomic_store_n(&run->stopped, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    config_init(&config);
 
-            filelist_add(filelist, file);
+    if (!parse_arguments(argc, argv, &config)) {
+        config_free(&config);
+        return 2;
+    }
+
+    if (config.kernel_set) {
+        if (!cpu_kernel_supported(config.kernel)) {
+            fprintf(stderr, "Error: Kernel '%s' is not supported on this CPU\n", kernel_name(config.kernel));
+            config_free(&config);
+            return 2;
         }
+        kernel_select(config.kernel);
     }
 
+    Logger* logger = logger_create(config.verbose ? LOG_DEBUG : LOG_WARN);
+    logger_enable(logger, config.verbose);
+
     if (config.verbose) {
-        logger_info(logger, "Loaded %zu files", filelist->count);
+        logger_info(logger, "fastgrep %s starting", VERSION);
+        if (config.pattern_file_used) {
+            logger_info(logger, "Patterns: %zu (from file)", config.pattern_count);
+        } else {
+            logger_info(logger, "Pattern: %s", config.pattern);
+        }
+        logger_info(logger, "Recursive: %s", config.recursive ? "yes" : "no");
+        logger_info(logger, "Case insensitive: %s", config.ignore_case ? "yes" : "no");
+        logger_info(logger, "Regex mode: %s", config.use_regex ? "yes" : "no");
+        logger_info(logger, "Threads: %zu", config.num_threads);
+        logger_info(logger, "Kernel: %s (%s; CPU supports up to %s)", kernel_name(kernel_active()),
+                    config.kernel_set ? "forced" : "auto", kernel_name(cpu_detect_kernel()));
     }
 
-    if (filelist->count == 0) {
-        output_error("No files to search");
+    if (config.pattern_file_used && config.pattern_count == 0) {
         config_free(&config);
         logger_free(logger);
-        filelist_free(filelist);
         return 1;
     }
 
-    Pattern* pattern = pattern_create(config.pattern, config.ignore_case, config.use_regex);
+    Pattern* pattern;
+    logger_timer_start(logger);
+    if (config.fuzzy_errors >= 0) {
+        pattern = pattern_create_fuzzy(config.pattern, config.fuzzy_errors, config.ignore_case);
+    } else if (config.pattern_file_used) {
+        pattern = pattern_create_multi((const char* const*)config.patterns, config.pattern_count,
+                                       config.ignore_case, config.use_regex);
+    } else {
+        pattern = pattern_create(config.pattern, config.ignore_case, config.use_regex);
+    }
     if (!pattern) {
-        output_error("Invalid pattern");
+        if (config.fuzzy_errors >= 0) {
+            fprintf(stderr, "Error: --fuzzy=%d needs a pattern of %d to %d bytes\n", config.fuzzy_errors,
+                    config.fuzzy_errors + 1, FUZZY_MAX_LEN);
+        } else {
+            output_error("Invalid pattern");
+        }
         config_free(&config);
         logger_free(logger);
-        filelist_free(filelist);
         return 2;
     }
 
+    pattern_set_boundaries(pattern, config.word_regexp, config.line_regexp);
+    int jit = config.jit && pattern_enable_jit(pattern);
+    if (config.verbose && config.jit && !jit) {
+        logger_info(logger, "JIT: not available for this pattern, using the interpreter");
+    }
+
+    if (config.verbose && pattern->dict) {
+        logger_info(logger, "Dictionary: %zu entries (%zu short), %zu-byte keys, %.1f MB, built in %.2f ms",
+                    pattern->dict->count, pattern->dict->short_count, pattern->dict->key_len,
+                    pattern->dict->memory_bytes / (1024.0 * 1024.0), logger_timer_elapsed(logger));
+    } else if (config.verbose && pattern->multi) {
+        logger_info(logger, "Multi-literal: %zu literals (%s), built in %.2f ms",
+                    pattern->multi->count, pattern->multi->use_teddy ? "teddy" : "scalar",
+                    logger_timer_elapsed(logger));
+    } else if (config.verbose && pattern->fuzzy) {
+        logger_info(logger, "Fuzzy: up to %d edits, prefilter: %s", pattern->fuzzy->max_errors,
+                    pattern->prefilter ? "needle pieces" : "none");
+    } else if (config.verbose && pattern->casefold) {
+        logger_info(logger, "Case folding: Unicode simple folding, %zu code points%s",
+                    pattern->casefold->count, pattern->casefold->all_ascii ? ", ASCII kernels on ASCII text" : "");
+    } else if (config.verbose && pattern->type == MATCH_REGEX) {
+        logger_info(logger, "Regex engine: %s, prefilter literal: %s",
+                    jit ? "JIT-compiled DFA" : pattern->dfa ? "lazy DFA" : "regexec",
+                    pattern->prefilter ? pattern->prefilter->pattern : "none");
+    }
+
     OutputConfig output_config;
     output_init(&output_config);
     output_set_color(&output_config, config.color);
     output_set_line_numbers(&output_config, config.line_numbers);
     output_set_show_filename(&output_config, config.show_filename);
     output_set_quiet(&output_config, config.quiet);
+    output_set_line_buffered(&output_config, config.line_buffered);
+
+    /*
+     * Normal output prints each matching line once, so the scan skips to the
+     * next line after a hit. -c only needs the tally and -l/-L only whether
+     * there is one line, so those searches store nothing.
+     */
+    int list_files = config.files_with_matches || config.files_without_match;
+    SearchOptions search_options;
+    search_options_init(&search_options);
+    search_options.mode = list_files || config.count ? MATCH_MODE_COUNT : MATCH_MODE_LINES;
+    search_options.highlight = config.color && !config.quiet && !config.invert;
+    search_options.invert = config.invert;
+    search_options.limit = list_files ? 1 : config.max_count > 0 ? (size_t)config.max_count : 0;
+    search_options.skip_binary = config.binary_files == BINARY_FILES_WITHOUT_MATCH;
+    search_options.binary_summary = config.binary_files == BINARY_FILES_BINARY && !list_files && !config.count;
+
+    /* -q only needs one selected line anywhere: each file stops at its first and the rest are cancelled. */
+    if (config.quiet) {
+        search_options.mode = MATCH_MODE_COUNT;
+        search_options.highlight = 0;
+        search_options.limit = 1;
+        search_options.stop_on_match = 1;
+    }
 
-    MatchList** results = NULL;
-    logger_timer_start(logger);
+    if (config.stream) {
+        StreamContext stream;
+        memset(&stream, 0, sizeof(stream));
+        stream.config = &config;
+        stream.pattern = pattern;
+        stream.search_options = &search_options;
+        stream.output_config = &output_config;
+        size_t window_size = config.num_threads > 1 ? CHUNK_BLOCK_SIZE : CHUNK_WINDOW_SIZE;
+        stream.reader = chunk_reader_create(window_size, config.line_numbers);
+        if (!stream.reader) {
+            output_error("Memory allocation error");
+            pattern_free(pattern);
+            config_free(&config);
+            logger_free(logger);
+            return 2;
+        }
+        /* Parallel blocks are worth filling; --line-buffered still wants each line handed on at once. */
+        stream.reader->fill = config.num_threads > 1 && !config.line_buffered;
 
-    int success = search_multiple_files(pattern, filelist, config.num_threads, &results);
+        logger_timer_start(logger);
+        int status = stream_paths(&config, &stream);
+        logger_timer_stop(logger);
 
-    logger_timer_stop(logger);
+        int exit_code = status == 2 ? 2 : stream.total_matches > 0 ? 0 : 1;
+        if (status != 2 && stream.files == 0) {
+            output_error("No files to search");
+        }
+        if (config.verbose) {
+            if (stream.walk.directories > 0) {
+                logger_info(logger, "Walked %zu directories: %zu files, %zu stat calls", stream.walk.directories,
+                            stream.walk.files, stream.walk.stat_calls);
+            }
+            logger_info(logger, "Streamed %zu files in %zu MB windows%s", stream.files, window_size / (1024 * 1024),
+                        config.num_threads > 1 ? ", searched in parallel" : "");
+            logger_info(logger, "Binary files: %zu detected, %zu skipped", stream.binary_count,
+                        stream.binary_skipped);
+            logger_timer_print(logger);
+            logger_info(logger, "Found %zu %s lines", stream.total_matches,
+                        config.invert ? "non-matching" : "matching");
+        }
 
-    if (config.verbose) {
-        logger_timer_print(logger);
+        chunk_reader_free(stream.reader);
+        pattern_free(pattern);
+        config_free(&config);
+        logger_free(logger);
+        return exit_code;
     }
 
-    int exit_code = 1;
-    if (success && results) {
-        size_t total_matches = 0;
-        for (size_t i = 0; i < filelist->count; i++) {
-            if (results[i] && results[i]->count > 0) {
-                if (!config.quiet) {
-                    output_matches(&output_config,
-                                   filelist->files[i]->filepath,
-                                   filelist->files[i]->data,
-                                   filelist->files[i]->size,
-                                   results[i]);
-                }
-                total_matches += results[i]->count;
-            }
-            if (results[i]) {
-                matchlist_free(results[i]);
-            }
+    /* Checked up front, so a usage error stops the run before anything is printed. */
+    for (size_t i = 0; i < config.path_count && !config.recursive; i++) {
+        if (strcmp(config.paths[i], "-") != 0 && is_directory(config.paths[i])) {
+            output_error("Path is a directory, use -r to search recursively");
+            pattern_free(pattern);
+            config_free(&config);
+            logger_free(logger);
+            return 2;
         }
+    }
 
-        if (total_matches > 0) {
-            exit_code = 0;
-        }
+    PipelineConfig pipeline_config;
+    pipeline_config_init(&pipeline_config);
+    pipeline_config.num_threads = config.num_threads;
+    pipeline_config.max_files = config.inflight_files;
+    pipeline_config.max_bytes = config.inflight_bytes;
+    pipeline_config.backend = config.read_backend;
+    pipeline_config.skip_search = config.max_count == 0;
+
+    PipelineContext run;
+    memset(&run, 0, sizeof(run));
+    run.config = &config;
+    run.search_options = &search_options;
+    run.output_config = &output_config;
+    run.pipeline = file_pipeline_create(pattern, &search_options, &pipeline_config, pipeline_report, &run);
+    if (!run.pipeline) {
+        output_error("Failed to start search threads");
+        pattern_free(pattern);
+        config_free(&config);
+        logger_free(logger);
+        return 2;
+    }
 
-        if (config.verbose) {
-            logger_info(logger, "Found %zu matches", total_matches);
-        }
+    logger_timer_start(logger);
+    submit_paths(&config, &run);
+    file_pipeline_finish(run.pipeline);
+    logger_timer_stop(logger);
+
+    int exit_code = run.total_matches > 0 ? 0 : 1;
+    if (run.files == 0) {
+        output_error("No files to search");
+    }
 
-        free(results);
+    if (config.verbose) {
+        if (run.walk.directories > 0) {
+            logger_info(logger, "Walked %zu directories with %zu walkers: %zu files, %zu stat calls",
+                        run.walk.directories, config.walkers, run.walk.files, run.walk.stat_calls);
+        }
+        logger_info(logger, "Searched %zu files (%s); at most %zu files and %.1f MB in flight", run.files,
+                    run.pipeline->backend_used == READ_BACKEND_URING ? "io_uring batches" : "synchronous reads",
+                    run.pipeline->peak_files, run.pipeline->peak_bytes / (1024.0 * 1024.0));
+        if (config.read_backend == READ_BACKEND_URING && run.pipeline->backend_used != READ_BACKEND_URING) {
+            logger_info(logger, "io_uring: not available, fell back to synchronous reads");
+        }
+        logger_info(logger, "Binary files: %zu detected, %zu skipped", run.binary_count,
+                    search_options.skip_binary ? run.binary_count : 0);
+        logger_timer_print(logger);
+        logger_info(logger, "Found %zu %s lines", run.total_matches, config.invert ? "non-matching" : "matching");
     }
 
+    file_pipeline_free(run.pipeline);
     pattern_free(pattern);
     config_free(&config);
     logger_free(logger);
-    filelist_free(filelist);
 
     return exit_code;
-}
\ No newline at end of file
+}
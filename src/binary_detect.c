@@ -0,0 +1,87 @@
+#include "../include/binary_detect.h"
+#include "../include/cpu_dispatch.h"
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static int has_nul_scalar(const char* data, size_t size) {
+    return memchr(data, '\0', size) != NULL;
+}
+
+#ifdef CPU_X86
+TARGET_SSE42
+static int has_nul_sse42(const char* data, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t pos = 0;
+
+    /* Four blocks per test: the probe is short and almost always clean, so branches stay rare. */
+    for (; pos + 64 <= size; pos += 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos)), zero);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 16)), zero);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 32)), zero);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 48)), zero);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) {
+            return 1;
+        }
+    }
+
+    return has_nul_scalar(data + pos, size - pos);
+}
+
+TARGET_AVX2
+static int has_nul_avx2(const char* data, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t pos = 0;
+
+    for (; pos + 128 <= size; pos += 128) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos)), zero);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos + 32)), zero);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos + 64)), zero);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos + 96)), zero);
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d)))) {
+            return 1;
+        }
+    }
+
+    return has_nul_scalar(data + pos, size - pos);
+}
+
+TARGET_AVX512
+static int has_nul_avx512(const char* data, size_t size) {
+    for (size_t pos = 0; pos < size; pos += 64) {
+        size_t remaining = size - pos;
+        __mmask64 lanes = remaining >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << remaining) - 1);
+        __m512i block = _mm512_maskz_loadu_epi8(lanes, data + pos);
+        if (_mm512_mask_test_epi8_mask(lanes, block, block) != lanes) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int binary_detect(const char* data, size_t size) {
+    if (!data || size == 0) return 0;
+
+    if (size > BINARY_PROBE_SIZE) {
+        size = BINARY_PROBE_SIZE;
+    }
+
+#ifdef CPU_X86
+    switch (kernel_active()) {
+        case KERNEL_AVX512:
+            return has_nul_avx512(data, size);
+        case KERNEL_AVX2:
+            return has_nul_avx2(data, size);
+        case KERNEL_SSE42:
+            return has_nul_sse42(data, size);
+        default:
+            break;
+    }
+#endif
+
+    return has_nul_scalar(data, size);
+}
@@ -0,0 +1,352 @@
+#include "../include/casefold.h"
+#include "../include/cpu_dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define HIGH_BITS 0x8080808080808080ULL
+
+static inline unsigned char ascii_fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+/* Lowercases the ASCII letters of eight packed ASCII bytes at once. */
+static inline uint64_t fold_word(uint64_t x) {
+    uint64_t ge_a = x + 0x3F3F3F3F3F3F3F3FULL;
+    uint64_t gt_z = x + 0x2525252525252525ULL;
+    return x | (((ge_a ^ gt_z) & HIGH_BITS) >> 2);
+}
+
+/* Upper case at the even code point of each pair in [first, last]. */
+static inline int pair_upper_even(uint32_t cp, uint32_t first, uint32_t last) {
+    return cp >= first && cp <= last && !(cp & 1);
+}
+
+static inline int pair_upper_odd(uint32_t cp, uint32_t first, uint32_t last) {
+    return cp >= first && cp <= last && (cp & 1);
+}
+
+/*
+ * Unicode simple case folding (CaseFolding.txt status C and S) for the
+ * Latin, Greek, Cyrillic and Armenian blocks plus the letterlike and
+ * fullwidth forms; other code points fold to themselves. Turkish dotted
+ * and dotless i have no simple folding and stay distinct from i.
+ */
+uint32_t casefold_codepoint(uint32_t cp) {
+    if (cp < 0x80) {
+        return ascii_fold((unsigned char)cp);
+    }
+
+    if (cp < 0x100) {
+        if (cp == 0xB5) return 0x3BC;
+        if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 0x20;
+        return cp;
+    }
+
+    if (cp < 0x180) {
+        if (cp == 0x130 || cp == 0x131 || cp == 0x138 || cp == 0x149) return cp;
+        if (cp == 0x178) return 0xFF;
+        if (cp == 0x17F) return 's';
+        if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) {
+            return (cp & 1) ? cp + 1 : cp;
+        }
+        return (cp & 1) ? cp : cp + 1;
+    }
+
+    if (cp < 0x250) {
+        if (pair_upper_odd(cp, 0x1CD, 0x1DC) || pair_upper_even(cp, 0x1DE, 0x1EF) ||
+            pair_upper_even(cp, 0x1F8, 0x21F) || pair_upper_even(cp, 0x222, 0x233)) {
+            return cp + 1;
+        }
+        return cp;
+    }
+
+    if (cp >= 0x370 && cp < 0x400) {
+        if (cp == 0x386) return 0x3AC;
+        if (cp >= 0x388 && cp <= 0x38A) return cp + 0x25;
+        if (cp == 0x38C) return 0x3CC;
+        if (cp == 0x38E || cp == 0x38F) return cp + 0x3F;
+        if ((cp >= 0x391 && cp <= 0x3A1) || (cp >= 0x3A3 && cp <= 0x3AB)) return cp + 0x20;
+        if (cp == 0x3C2) return 0x3C3;
+        return cp;
+    }
+
+    if (cp >= 0x400 && cp < 0x530) {
+        if (cp < 0x410) return cp + 0x50;
+        if (cp < 0x430) return cp + 0x20;
+        if (cp == 0x4C0) return 0x4CF;
+        if (pair_upper_even(cp, 0x460, 0x481) || pair_upper_even(cp, 0x48A, 0x4BF) ||
+            pair_upper_odd(cp, 0x4C1, 0x4CE) || pair_upper_even(cp, 0x4D0, 0x52F)) {
+            return cp + 1;
+        }
+        return cp;
+    }
+
+    if (cp >= 0x531 && cp <= 0x556) return cp + 0x30;
+
+    if (cp >= 0x1E00 && cp < 0x1F00) {
+        if (cp == 0x1E9E) return 0xDF;
+        if (pair_upper_even(cp, 0x1E00, 0x1E95) || pair_upper_even(cp, 0x1EA0, 0x1EFF)) return cp + 1;
+        return cp;
+    }
+
+    if (cp == 0x2126) return 0x3C9;
+    if (cp == 0x212A) return 'k';
+    if (cp == 0x212B) return 0xE5;
+    if (cp >= 0xFF21 && cp <= 0xFF3A) return cp + 0x20;
+
+    return cp;
+}
+
+/*
+ * Decodes one code point. Invalid, overlong and truncated sequences yield
+ * their first byte as CASEFOLD_RAW_BASE + byte, so they only match the
+ * same raw byte in the needle.
+ */
+size_t casefold_decode(const char* data, size_t avail, uint32_t* cp) {
+    const unsigned char* s = (const unsigned char*)data;
+    unsigned char b = s[0];
+    size_t len;
+    uint32_t value;
+    uint32_t min;
+
+    if (b < 0x80) {
+        *cp = b;
+        return 1;
+    } else if (b >= 0xC2 && b <= 0xDF) {
+        len = 2;
+        value = b & 0x1F;
+        min = 0x80;
+    } else if (b >= 0xE0 && b <= 0xEF) {
+        len = 3;
+        value = b & 0x0F;
+        min = 0x800;
+    } else if (b >= 0xF0 && b <= 0xF4) {
+        len = 4;
+        value = b & 0x07;
+        min = 0x10000;
+    } else {
+        *cp = CASEFOLD_RAW_BASE + b;
+        return 1;
+    }
+
+    if (len > avail) {
+        *cp = CASEFOLD_RAW_BASE + b;
+        return 1;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *cp = CASEFOLD_RAW_BASE + b;
+            return 1;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+
+    if (value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        *cp = CASEFOLD_RAW_BASE + b;
+        return 1;
+    }
+
+    *cp = value;
+    return len;
+}
+
+/*
+ * ASCII needles only need Unicode folding if they contain k or s, whose
+ * folds are shared with the Kelvin sign and long s.
+ */
+int casefold_needs_unicode(const char* str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = ascii_fold((unsigned char)str[i]);
+        if (c >= 0x80 || c == 'k' || c == 's') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned char lead_byte(uint32_t cp) {
+    if (cp < 0x80) return (unsigned char)cp;
+    if (cp < 0x800) return (unsigned char)(0xC0 | (cp >> 6));
+    if (cp < 0x10000) return (unsigned char)(0xE0 | (cp >> 12));
+    if (cp < CASEFOLD_RAW_BASE) return (unsigned char)(0xF0 | (cp >> 18));
+    return (unsigned char)(cp - CASEFOLD_RAW_BASE);
+}
+
+CaseNeedle* case_needle_create(const char* needle, size_t len) {
+    if (!needle || len == 0) return NULL;
+
+    CaseNeedle* cn = (CaseNeedle*)calloc(1, sizeof(CaseNeedle));
+    if (!cn) return NULL;
+
+    cn->folded = (uint32_t*)malloc(sizeof(uint32_t) * len);
+    cn->ascii = (unsigned char*)malloc(len);
+    if (!cn->folded || !cn->ascii) {
+        case_needle_free(cn);
+        return NULL;
+    }
+
+    cn->all_ascii = 1;
+    for (size_t pos = 0; pos < len;) {
+        uint32_t cp;
+        pos += casefold_decode(needle + pos, len - pos, &cp);
+        cp = casefold_codepoint(cp);
+
+        cn->folded[cn->count] = cp;
+        cn->ascii[cn->count] = cp < 0x80 ? (unsigned char)cp : 0;
+        if (cp >= 0x80) {
+            cn->all_ascii = 0;
+        } else if (cn->all_ascii) {
+            cn->ascii_prefix++;
+        }
+        cn->count++;
+    }
+
+    /* Every other code point that folds like the first one can start a match. */
+    uint32_t first = cn->folded[0];
+    cn->lead[lead_byte(first)] = 1;
+    for (uint32_t cp = 0; cp < 0x10000; cp++) {
+        if ((cp < 0xD800 || cp > 0xDFFF) && casefold_codepoint(cp) == first) {
+            cn->lead[lead_byte(cp)] = 1;
+        }
+    }
+
+    return cn;
+}
+
+void case_needle_free(CaseNeedle* needle) {
+    if (!needle) return;
+
+    free(needle->folded);
+    free(needle->ascii);
+    free(needle);
+}
+
+/*
+ * Returns the end of the match starting at pos, or 0 if there is none.
+ * Runs of eight ASCII text bytes against ASCII needle code points are
+ * compared a word at a time; only multibyte sequences are decoded.
+ */
+size_t case_needle_match(const CaseNeedle* needle, const char* data, size_t size, size_t pos) {
+    size_t q = pos;
+    size_t i = 0;
+
+    while (i < needle->count) {
+        if (i + 8 <= needle->count && q + 8 <= size) {
+            uint64_t text, want;
+            memcpy(&text, data + q, 8);
+            memcpy(&want, needle->ascii + i, 8);
+            int want_ascii = !((want - 0x0101010101010101ULL) & ~want & HIGH_BITS);
+
+            if (want_ascii && !(text & HIGH_BITS)) {
+                if (fold_word(text) != want) return 0;
+                i += 8;
+                q += 8;
+                continue;
+            }
+        }
+
+        if (q >= size) return 0;
+
+        uint32_t cp;
+        unsigned char b = (unsigned char)data[q];
+        if (b < 0x80) {
+            cp = ascii_fold(b);
+            q++;
+        } else {
+            q += casefold_decode(data + q, size - q, &cp);
+            cp = casefold_codepoint(cp);
+        }
+
+        if (cp != needle->folded[i]) return 0;
+        i++;
+    }
+
+    return q;
+}
+
+static size_t next_non_ascii_scalar(const char* data, size_t size, size_t pos) {
+    for (; pos + 8 <= size; pos += 8) {
+        uint64_t word;
+        memcpy(&word, data + pos, 8);
+        if (word & HIGH_BITS) break;
+    }
+
+    for (; pos < size; pos++) {
+        if ((unsigned char)data[pos] >= 0x80) break;
+    }
+    return pos;
+}
+
+#ifdef CPU_X86
+TARGET_SSE42
+static size_t next_non_ascii_sse42(const char* data, size_t size, size_t pos) {
+    for (; pos + 16 <= size; pos += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + pos)));
+        if (mask) return pos + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return next_non_ascii_scalar(data, size, pos);
+}
+
+TARGET_AVX2
+static size_t next_non_ascii_avx2(const char* data, size_t size, size_t pos) {
+    for (; pos + 32 <= size; pos += 32) {
+        int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(data + pos)));
+        if (mask) return pos + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return next_non_ascii_scalar(data, size, pos);
+}
+
+TARGET_AVX512
+static size_t next_non_ascii_avx512(const char* data, size_t size, size_t pos) {
+    for (; pos < size; pos += 64) {
+        size_t remaining = size - pos;
+        __mmask64 lanes = remaining >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << remaining) - 1);
+        __mmask64 mask = _mm512_movepi8_mask(_mm512_maskz_loadu_epi8(lanes, data + pos)) & lanes;
+        if (mask) return pos + (size_t)__builtin_ctzll(mask);
+    }
+    return size;
+}
+#endif
+
+/* Position of the first byte at or after pos with the high bit set, or size. */
+size_t casefold_next_non_ascii(const char* data, size_t size, size_t pos) {
+    if (!data || pos >= size) return size;
+
+#ifdef CPU_X86
+    switch (kernel_active()) {
+        case KERNEL_AVX512:
+            return next_non_ascii_avx512(data, size, pos);
+        case KERNEL_AVX2:
+            return next_non_ascii_avx2(data, size, pos);
+        case KERNEL_SSE42:
+            return next_non_ascii_sse42(data, size, pos);
+        default:
+            break;
+    }
+#endif
+
+    return next_non_ascii_scalar(data, size, pos);
+}
+
+/*
+ * End of the stretch with multibyte sequences that begins at start: the
+ * first position followed by CASEFOLD_ASCII_RUN ASCII bytes, or size.
+ */
+size_t casefold_stretch_end(const char* data, size_t size, size_t start) {
+    size_t q = start;
+
+    while (q < size) {
+        size_t next = casefold_next_non_ascii(data, size, q + 1);
+        if (next >= size || next - (q + 1) >= CASEFOLD_ASCII_RUN) {
+            return q + 1;
+        }
+        q = next;
+    }
+
+    return size;
+}
@@ -0,0 +1,218 @@
+#include "../include/chunk_reader.h"
+#include "../include/binary_detect.h"
+#include "../include/line_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ChunkReader* chunk_reader_create(size_t window_size, int count_lines) {
+    ChunkReader* reader = (ChunkReader*)calloc(1, sizeof(ChunkReader));
+    if (!reader) return NULL;
+
+    reader->window_size = window_size > 0 ? window_size : CHUNK_WINDOW_SIZE;
+    reader->buffer = (char*)malloc(reader->window_size);
+    if (!reader->buffer) {
+        free(reader);
+        return NULL;
+    }
+
+    reader->capacity = reader->window_size;
+    reader->fd = -1;
+    reader->count_lines = count_lines;
+    return reader;
+}
+
+void chunk_reader_free(ChunkReader* reader) {
+    if (!reader) return;
+
+    chunk_reader_close(reader);
+    free(reader->buffer);
+    free(reader);
+}
+
+/* Starts a new input in the same buffer; one that grew for a long line is shrunk back first. */
+static void chunk_reader_reset(ChunkReader* reader, int fd, int owns_fd) {
+    if (reader->capacity > reader->window_size) {
+        char* buffer = (char*)realloc(reader->buffer, reader->window_size);
+        if (buffer) {
+            reader->buffer = buffer;
+            reader->capacity = reader->window_size;
+        }
+    }
+
+    reader->fd = fd;
+    reader->owns_fd = owns_fd;
+    reader->used = 0;
+    reader->eof = 0;
+    reader->error = 0;
+    reader->data = reader->buffer;
+    reader->size = 0;
+    reader->offset = 0;
+    reader->first_line = 1;
+    reader->is_binary = 0;
+}
+
+ReadStatus chunk_reader_open(ChunkReader* reader, const char* filepath) {
+    if (!reader || !filepath) return READ_ERROR_OPEN;
+
+    chunk_reader_close(reader);
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        return READ_ERROR_OPEN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return READ_ERROR_STAT;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
+        return READ_ERROR_DIRECTORY;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    chunk_reader_reset(reader, fd, 1);
+    return READ_SUCCESS;
+}
+
+/* Reads from a descriptor the caller keeps, such as stdin. */
+void chunk_reader_attach(ChunkReader* reader, int fd) {
+    if (!reader) return;
+
+    chunk_reader_close(reader);
+    chunk_reader_reset(reader, fd, 0);
+}
+
+void chunk_reader_close(ChunkReader* reader) {
+    if (!reader) return;
+
+    if (reader->owns_fd && reader->fd >= 0) {
+        close(reader->fd);
+    }
+    reader->fd = -1;
+    reader->owns_fd = 0;
+}
+
+static int chunk_reader_grow(ChunkReader* reader) {
+    size_t new_capacity = reader->capacity * 2;
+    char* buffer = (char*)realloc(reader->buffer, new_capacity);
+    if (!buffer) return 0;
+
+    reader->buffer = buffer;
+    reader->capacity = new_capacity;
+    return 1;
+}
+
+/* Moves the counters past the current window; the caller moves the carried bytes. */
+static void chunk_reader_retire(ChunkReader* reader) {
+    if (reader->count_lines) {
+        reader->first_line += line_count_newlines(reader->data, 0, reader->size);
+    }
+    /* Searched once and done with: don't let a huge file push everything else out of the page cache. */
+    if (reader->owns_fd) {
+        posix_fadvise(reader->fd, (off_t)reader->offset, (off_t)reader->size, POSIX_FADV_DONTNEED);
+    }
+    reader->offset += reader->size;
+    reader->used -= reader->size;
+}
+
+/*
+ * Moves to the next window; returns 0 at the end of the input or on a read
+ * error (error is set). The previous window's data is gone afterwards.
+ */
+int chunk_reader_next(ChunkReader* reader) {
+    if (!reader || reader->fd < 0 || reader->error) return 0;
+
+    /* Retire the previous window and carry its trailing partial line to the front. */
+    if (reader->size > 0) {
+        size_t size = reader->size;
+        chunk_reader_retire(reader);
+        memmove(reader->buffer, reader->buffer + size, reader->used);
+        reader->size = 0;
+    }
+
+    /*
+     * The carried bytes hold no newline, so the window ends at the last one
+     * read after them. A read from a file fills the buffer; a pipe returns
+     * what it has, and any complete line is worth handing on at once
+     * unless the reader is set to fill its windows.
+     */
+    size_t end = 0;
+    while (!reader->eof && (end == 0 || (reader->fill && reader->used < reader->capacity))) {
+        if (reader->used == reader->capacity && !chunk_reader_grow(reader)) {
+            reader->error = 1;
+            return 0;
+        }
+
+        ssize_t n = read(reader->fd, reader->buffer + reader->used, reader->capacity - reader->used);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            reader->error = 1;
+            return 0;
+        }
+        if (n == 0) {
+            reader->eof = 1;
+            break;
+        }
+
+        const char* newline = (const char*)memrchr(reader->buffer + reader->used, '\n', (size_t)n);
+        reader->used += (size_t)n;
+        if (newline) {
+            end = (size_t)(newline - reader->buffer) + 1;
+        }
+    }
+
+    /* At the end of the input the last line needn't end in a newline. */
+    if (end == 0) {
+        end = reader->used;
+    }
+    if (end == 0) {
+        return 0;
+    }
+
+    reader->data = reader->buffer;
+    reader->size = end;
+    if (reader->offset == 0) {
+        reader->is_binary = binary_detect(reader->data, reader->size);
+    }
+    return 1;
+}
+
+/*
+ * Hands over the buffer holding the current window (its first size bytes)
+ * in exchange for spare, which takes the partial line carried into the
+ * next window. The window can then be searched elsewhere while reading
+ * goes on. *capacity is spare's size on entry and the returned buffer's
+ * on return. Returns NULL, with spare untouched, if spare is too small
+ * for the carry and can't be grown.
+ */
+char* chunk_reader_swap(ChunkReader* reader, char* spare, size_t* capacity) {
+    if (!reader || !spare || !capacity || reader->size == 0) return NULL;
+
+    size_t carry = reader->used - reader->size;
+    size_t spare_capacity = *capacity;
+    if (carry > spare_capacity) {
+        char* grown = (char*)realloc(spare, reader->capacity);
+        if (!grown) return NULL;
+        spare = grown;
+        spare_capacity = reader->capacity;
+    }
+    memcpy(spare, reader->buffer + reader->size, carry);
+
+    char* window = reader->buffer;
+    size_t window_capacity = reader->capacity;
+    chunk_reader_retire(reader);
+
+    reader->buffer = spare;
+    reader->capacity = spare_capacity;
+    reader->data = spare;
+    reader->size = 0;
+    *capacity = window_capacity;
+    return window;
+}
@@ -0,0 +1,94 @@
+#include "../include/cpu_dispatch.h"
+#include <pthread.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <cpuid.h>
+#endif
+
+static const char* KERNEL_NAMES[KERNEL_COUNT] = {
+    "scalar",
+    "sse4.2",
+    "avx2",
+    "avx512bw"
+};
+
+static KernelLevel active_kernel = KERNEL_SCALAR;
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+
+#ifdef CPU_X86
+/* XCR0: which register state the OS saves across context switches. */
+static unsigned read_xcr0(void) {
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    (void)hi;
+    return lo;
+}
+#endif
+
+KernelLevel cpu_detect_kernel(void) {
+#ifdef CPU_X86
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return KERNEL_SCALAR;
+    }
+
+    /* The Teddy shuffles need SSSE3 and the newline counters POPCNT; every SSE4.2 part has both. */
+    if (!(ecx & bit_SSE4_2) || !(ecx & bit_SSSE3) || !(ecx & bit_POPCNT)) {
+        return KERNEL_SCALAR;
+    }
+
+    /* Bits 1-2 cover XMM/YMM; bits 5-7 the opmask and ZMM registers. */
+    unsigned xcr0 = (ecx & bit_OSXSAVE) ? read_xcr0() : 0;
+    int avx_usable = (ecx & bit_AVX) && (xcr0 & 0x6) == 0x6;
+    int avx512_usable = avx_usable && (xcr0 & 0xE0) == 0xE0;
+
+    if (avx_usable && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2)) {
+        if (avx512_usable && (ebx & bit_AVX512F) && (ebx & bit_AVX512BW)) {
+            return KERNEL_AVX512;
+        }
+        return KERNEL_AVX2;
+    }
+
+    return KERNEL_SSE42;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+int cpu_kernel_supported(KernelLevel level) {
+    return level < KERNEL_COUNT && level <= cpu_detect_kernel();
+}
+
+const char* kernel_name(KernelLevel level) {
+    return level < KERNEL_COUNT ? KERNEL_NAMES[level] : "unknown";
+}
+
+int kernel_parse(const char* name, KernelLevel* level) {
+    if (!name || !level) return 0;
+
+    for (int i = 0; i < KERNEL_COUNT; i++) {
+        if (strcmp(name, KERNEL_NAMES[i]) == 0) {
+            *level = (KernelLevel)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void detect_active_kernel(void) {
+    active_kernel = cpu_detect_kernel();
+}
+
+/* Must be called before any search threads start. */
+void kernel_select(KernelLevel level) {
+    pthread_once(&active_once, detect_active_kernel);
+    if (cpu_kernel_supported(level)) {
+        active_kernel = level;
+    }
+}
+
+KernelLevel kernel_active(void) {
+    pthread_once(&active_once, detect_active_kernel);
+    return active_kernel;
+}
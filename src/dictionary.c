@@ -0,0 +1,348 @@
+#include "../include/dictionary.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOOM_BITS_PER_ENTRY 16
+/* One bit for each possible leading byte pair of a short entry. */
+#define SHORT_PAIR_WORDS (65536 / 64)
+
+static inline unsigned char ascii_fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+/* Lowercases the ASCII letters of eight packed bytes at once. */
+static inline uint64_t fold_key(uint64_t x) {
+    const uint64_t high = 0x8080808080808080ULL;
+    uint64_t low7 = x & ~high;
+    uint64_t ge_a = low7 + 0x3F3F3F3F3F3F3F3FULL;
+    uint64_t gt_z = low7 + 0x2525252525252525ULL;
+    uint64_t upper = (ge_a ^ gt_z) & ~x & high;
+    return x | (upper >> 2);
+}
+
+static inline uint64_t load_key(const char* p, size_t avail, size_t key_len, int fold) {
+    uint64_t key = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (avail >= 8) {
+        memcpy(&key, p, 8);
+        if (key_len < 8) {
+            key &= (1ULL << (8 * key_len)) - 1;
+        }
+        return fold ? fold_key(key) : key;
+    }
+#else
+    (void)avail;
+#endif
+
+    for (size_t i = 0; i < key_len; i++) {
+        key |= (uint64_t)(unsigned char)p[i] << (8 * i);
+    }
+    return fold ? fold_key(key) : key;
+}
+
+/* Multiplicative hash: the upper bits pick the bucket and Bloom word, the middle bits the Bloom bits. */
+static inline uint64_t mix_key(uint64_t z) {
+    return z * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline uint64_t bloom_bits(uint64_t h) {
+    return (1ULL << ((h >> 20) & 63)) | (1ULL << ((h >> 26) & 63));
+}
+
+static inline int bloom_test(const Dictionary* dict, uint64_t h) {
+    uint64_t bits = bloom_bits(h);
+    return (dict->bloom[(h >> 32) & dict->bloom_mask] & bits) == bits;
+}
+
+/* Short entries hash their one- or two-byte lead, tagged by length so the two kinds never share a key. */
+static inline uint64_t short_key(const unsigned char* p, size_t len) {
+    return len == 1 ? 0x10000 | p[0] : p[0] | (uint64_t)p[1] << 8;
+}
+
+static uint64_t entry_hash(const Dictionary* dict, size_t index) {
+    const char* entry = dict->arena + dict->offsets[index];
+    size_t len = dict->lengths[index];
+
+    if (len < dict->key_len) {
+        return mix_key(short_key((const unsigned char*)entry, len));
+    }
+    return mix_key(load_key(entry, len, dict->key_len, 0));
+}
+
+/*
+ * Buckets the short or long entries by hash, each bucket in pattern
+ * order, with at least as many buckets as entries. Returns the bucket
+ * count, or 0 if out of memory.
+ */
+static size_t bucket_entries(const Dictionary* dict, size_t members, int short_entries, size_t* shift,
+                             uint32_t** start, uint32_t** member_list) {
+    size_t buckets = 16;
+    size_t bucket_bits = 4;
+    while (buckets < members) {
+        buckets *= 2;
+        bucket_bits++;
+    }
+    *shift = 64 - bucket_bits;
+    *start = (uint32_t*)calloc(buckets + 1, sizeof(uint32_t));
+    *member_list = (uint32_t*)malloc(sizeof(uint32_t) * (members > 0 ? members : 1));
+    uint32_t* fill = (uint32_t*)malloc(sizeof(uint32_t) * buckets);
+    if (!*start || !*member_list || !fill) {
+        free(fill);
+        return 0;
+    }
+
+    for (size_t i = 0; i < dict->count; i++) {
+        if ((dict->lengths[i] < dict->key_len) != short_entries) continue;
+        (*start)[(entry_hash(dict, i) >> *shift) + 1]++;
+    }
+
+    for (size_t b = 0; b < buckets; b++) {
+        (*start)[b + 1] += (*start)[b];
+        fill[b] = (*start)[b];
+    }
+
+    for (size_t i = 0; i < dict->count; i++) {
+        if ((dict->lengths[i] < dict->key_len) != short_entries) continue;
+        (*member_list)[fill[entry_hash(dict, i) >> *shift]++] = (uint32_t)i;
+    }
+    free(fill);
+
+    return buckets;
+}
+
+Dictionary* dictionary_create(const char* const* entries, size_t count, int case_insensitive) {
+    if (!entries || count == 0 || count > UINT32_MAX) return NULL;
+
+    Dictionary* dict = (Dictionary*)calloc(1, sizeof(Dictionary));
+    if (!dict) return NULL;
+
+    dict->count = count;
+    dict->case_insensitive = case_insensitive;
+    dict->offsets = (size_t*)malloc(sizeof(size_t) * count);
+    dict->lengths = (uint32_t*)malloc(sizeof(uint32_t) * count);
+    if (!dict->offsets || !dict->lengths) {
+        dictionary_free(dict);
+        return NULL;
+    }
+
+    size_t arena_size = 0;
+    dict->key_len = DICTIONARY_KEY_MAX;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(entries[i]);
+        if (len == 0 || len > UINT32_MAX) {
+            dictionary_free(dict);
+            return NULL;
+        }
+        dict->offsets[i] = arena_size;
+        dict->lengths[i] = (uint32_t)len;
+        arena_size += len;
+        if (len < dict->key_len) {
+            dict->short_count++;
+        }
+    }
+    size_t long_count = count - dict->short_count;
+
+    dict->arena = (char*)malloc(arena_size + 1);
+    if (!dict->arena) {
+        dictionary_free(dict);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        char* dst = dict->arena + dict->offsets[i];
+        for (size_t j = 0; j < dict->lengths[i]; j++) {
+            unsigned char c = (unsigned char)entries[i][j];
+            dst[j] = (char)(case_insensitive ? ascii_fold(c) : c);
+        }
+    }
+
+    size_t words = 64;
+    while (words * 64 < long_count * BLOOM_BITS_PER_ENTRY) {
+        words *= 2;
+    }
+    dict->bloom_mask = words - 1;
+    dict->bloom = (uint64_t*)calloc(words, sizeof(uint64_t));
+    if (!dict->bloom) {
+        dictionary_free(dict);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (dict->lengths[i] < dict->key_len) continue;
+
+        uint64_t h = entry_hash(dict, i);
+        dict->bloom[(h >> 32) & dict->bloom_mask] |= bloom_bits(h);
+    }
+
+    size_t buckets = bucket_entries(dict, long_count, 0, &dict->bucket_shift, &dict->bucket_start,
+                                    &dict->bucket_members);
+    size_t short_buckets = 0;
+    if (buckets > 0 && dict->short_count > 0) {
+        dict->short_pairs = (uint64_t*)calloc(SHORT_PAIR_WORDS, sizeof(uint64_t));
+        short_buckets = dict->short_pairs ? bucket_entries(dict, dict->short_count, 1, &dict->short_shift,
+                                                           &dict->short_start, &dict->short_members)
+                                          : 0;
+    }
+    if (buckets == 0 || (dict->short_count > 0 && short_buckets == 0)) {
+        dictionary_free(dict);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char* entry = (const unsigned char*)dict->arena + dict->offsets[i];
+        if (dict->lengths[i] == 1) {
+            dict->short_single[entry[0] >> 6] |= 1ULL << (entry[0] & 63);
+        } else if (dict->lengths[i] < dict->key_len) {
+            size_t pair = entry[0] | (size_t)entry[1] << 8;
+            dict->short_pairs[pair >> 6] |= 1ULL << (pair & 63);
+        }
+    }
+
+    dict->memory_bytes = sizeof(Dictionary) + arena_size + 1 + count * (sizeof(size_t) + sizeof(uint32_t) * 2) +
+                         words * sizeof(uint64_t) + (buckets + 1) * sizeof(uint32_t);
+    if (dict->short_count > 0) {
+        dict->memory_bytes += SHORT_PAIR_WORDS * sizeof(uint64_t) + (short_buckets + 1) * sizeof(uint32_t);
+    }
+
+    return dict;
+}
+
+void dictionary_free(Dictionary* dict) {
+    if (!dict) return;
+
+    free(dict->arena);
+    free(dict->offsets);
+    free(dict->lengths);
+    free(dict->bloom);
+    free(dict->bucket_start);
+    free(dict->bucket_members);
+    free(dict->short_pairs);
+    free(dict->short_start);
+    free(dict->short_members);
+    free(dict);
+}
+
+static inline unsigned char data_byte(const Dictionary* dict, const char* data, size_t pos) {
+    unsigned char c = (unsigned char)data[pos];
+    return dict->case_insensitive ? ascii_fold(c) : c;
+}
+
+/* Exact test for a one-byte entry, or a short entry starting with the pair, at the low bytes of key. */
+static inline int short_lead(const Dictionary* dict, uint64_t key, int has_pair) {
+    size_t first = key & 0xFF;
+    if (dict->short_single[first >> 6] & (1ULL << (first & 63))) return 1;
+    if (!has_pair) return 0;
+
+    size_t pair = key & 0xFFFF;
+    return (dict->short_pairs[pair >> 6] >> (pair & 63)) & 1;
+}
+
+/*
+ * Hashes the key_len bytes at every position and probes the Bloom filter;
+ * with short entries the leading bytes of the same key are screened too,
+ * and the last few positions for them alone. Only positions that pass are
+ * handed to dictionary_next_match().
+ */
+size_t dictionary_find_candidate(const Dictionary* dict, const char* data, size_t size, size_t pos) {
+    if (!dict || !data) return size;
+
+    size_t keyed_end = size >= dict->key_len ? size - dict->key_len + 1 : 0;
+    if (dict->short_count == 0) {
+        for (; pos < keyed_end; pos++) {
+            uint64_t h = mix_key(load_key(data + pos, size - pos, dict->key_len, dict->case_insensitive));
+            if (bloom_test(dict, h)) {
+                return pos;
+            }
+        }
+        return size;
+    }
+
+    for (; pos < keyed_end; pos++) {
+        uint64_t key = load_key(data + pos, size - pos, dict->key_len, dict->case_insensitive);
+        if (short_lead(dict, key, 1) || bloom_test(dict, mix_key(key))) {
+            return pos;
+        }
+    }
+
+    for (; pos < size; pos++) {
+        uint64_t key = data_byte(dict, data, pos);
+        if (pos + 1 < size) {
+            key |= (uint64_t)data_byte(dict, data, pos + 1) << 8;
+        }
+        if (short_lead(dict, key, pos + 1 < size)) return pos;
+    }
+
+    return size;
+}
+
+static int entry_matches_at(const Dictionary* dict, size_t index, const char* data, size_t size, size_t pos) {
+    size_t len = dict->lengths[index];
+    if (pos + len > size) return 0;
+
+    const char* entry = dict->arena + dict->offsets[index];
+    if (!dict->case_insensitive) {
+        return memcmp(data + pos, entry, len) == 0;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (ascii_fold((unsigned char)data[pos + i]) != (unsigned char)entry[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Tries the members of one bucket whose length is in [min_len, max_len]; *cursor counts across buckets. */
+static size_t next_in_bucket(const Dictionary* dict, const uint32_t* start, const uint32_t* members, size_t bucket,
+                             size_t min_len, size_t max_len, const char* data, size_t size, size_t pos,
+                             size_t* cursor, size_t* offset) {
+    size_t group_start = start[bucket];
+    size_t group_size = start[bucket + 1] - group_start;
+
+    while (*cursor < *offset + group_size) {
+        size_t index = members[group_start + *cursor - *offset];
+        (*cursor)++;
+        size_t len = dict->lengths[index];
+        if (len >= min_len && len <= max_len && entry_matches_at(dict, index, data, size, pos)) {
+            return index;
+        }
+    }
+    *offset += group_size;
+
+    return dict->count;
+}
+
+/*
+ * Returns the next entry matching at pos, or dict->count when exhausted.
+ * *cursor must start at 0 for each position; one-byte entries come first,
+ * then the other short entries, then long ones, each group in pattern order.
+ */
+size_t dictionary_next_match(const Dictionary* dict, const char* data, size_t size, size_t pos, size_t* cursor) {
+    if (!dict || !data || !cursor || pos >= size) return dict ? dict->count : 0;
+
+    size_t offset = 0;
+    size_t index;
+
+    if (dict->short_count > 0) {
+        unsigned char lead[2] = {data_byte(dict, data, pos), 0};
+        index = next_in_bucket(dict, dict->short_start, dict->short_members,
+                               (size_t)(mix_key(short_key(lead, 1)) >> dict->short_shift), 1, 1, data, size, pos,
+                               cursor, &offset);
+        if (index < dict->count) return index;
+
+        if (pos + 1 < size) {
+            lead[1] = data_byte(dict, data, pos + 1);
+            index = next_in_bucket(dict, dict->short_start, dict->short_members,
+                                   (size_t)(mix_key(short_key(lead, 2)) >> dict->short_shift), 2,
+                                   dict->key_len - 1, data, size, pos, cursor, &offset);
+            if (index < dict->count) return index;
+        }
+    }
+
+    if (pos + dict->key_len > size) return dict->count;
+
+    uint64_t h = mix_key(load_key(data + pos, size - pos, dict->key_len, dict->case_insensitive));
+    return next_in_bucket(dict, dict->bucket_start, dict->bucket_members, (size_t)(h >> dict->bucket_shift),
+                          dict->key_len, UINT32_MAX, data, size, pos, cursor, &offset);
+}
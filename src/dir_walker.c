@@ -0,0 +1,372 @@
+#include "../include/dir_walker.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_getdents64)
+#define HAVE_GETDENTS64 1
+#endif
+#endif
+
+#ifdef HAVE_GETDENTS64
+/* The kernel's record; glibc only exposes it through readdir(). */
+struct walk_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+typedef struct {
+    char* path;
+    size_t length;
+    /* Opened relative to the parent while it was open, or -1 to open by path. */
+    int fd;
+} WalkDir;
+
+/* Owner pushes and pops at the back; thieves take from the front, where the oldest (largest) subtrees are. */
+typedef struct {
+    WalkDir* items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t mutex;
+} WalkDeque;
+
+typedef struct {
+    WalkCallback callback;
+    void* userdata;
+    int recursive;
+
+    WalkDeque* deques;
+    size_t worker_count;
+
+    /* Counters are atomics; the mutex only guards sleeping. */
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t work;
+    size_t pending;
+    size_t queued;
+    size_t sleepers;
+    size_t open_dirs;
+    int stop;
+} DirWalker;
+
+typedef struct {
+    DirWalker* walker;
+    size_t index;
+    char* path;
+    size_t path_capacity;
+    char* buffer;
+    WalkStats stats;
+} WalkWorker;
+
+static int deque_push(WalkDeque* deque, const WalkDir* dir) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        size_t new_capacity = deque->capacity ? deque->capacity * 2 : 64;
+        WalkDir* items = (WalkDir*)malloc(sizeof(WalkDir) * new_capacity);
+        if (!items) {
+            pthread_mutex_unlock(&deque->mutex);
+            return 0;
+        }
+        for (size_t i = 0; i < deque->count; i++) {
+            items[i] = deque->items[(deque->head + i) % deque->capacity];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->capacity = new_capacity;
+    }
+    deque->items[(deque->head + deque->count) % deque->capacity] = *dir;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+    return 1;
+}
+
+static int deque_take(WalkDeque* deque, WalkDir* dir, int front) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == 0) {
+        pthread_mutex_unlock(&deque->mutex);
+        return 0;
+    }
+    if (front) {
+        *dir = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+    } else {
+        *dir = deque->items[(deque->head + deque->count - 1) % deque->capacity];
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->mutex);
+    return 1;
+}
+
+static int walk_stopped(const DirWalker* walker) {
+    return __atomic_load_n(&walker->stop, __ATOMIC_RELAXED);
+}
+
+/* pending counts the directory before it is visible, so the walk can't look finished in between. */
+static void walk_push(WalkWorker* worker, WalkDir* dir) {
+    DirWalker* walker = worker->walker;
+
+    __atomic_add_fetch(&walker->pending, 1, __ATOMIC_SEQ_CST);
+    if (!deque_push(&walker->deques[worker->index], dir)) {
+        if (dir->fd >= 0) {
+            close(dir->fd);
+            __atomic_sub_fetch(&walker->open_dirs, 1, __ATOMIC_RELAXED);
+        }
+        free(dir->path);
+        __atomic_sub_fetch(&walker->pending, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+    __atomic_add_fetch(&walker->queued, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&walker->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&walker->idle_mutex);
+        pthread_cond_signal(&walker->work);
+        pthread_mutex_unlock(&walker->idle_mutex);
+    }
+}
+
+/* The newest directory of our own deque, else the oldest of someone else's. */
+static int walk_take(WalkWorker* worker, WalkDir* dir) {
+    DirWalker* walker = worker->walker;
+
+    int found = deque_take(&walker->deques[worker->index], dir, 0);
+    for (size_t i = 1; !found && i < walker->worker_count; i++) {
+        found = deque_take(&walker->deques[(worker->index + i) % walker->worker_count], dir, 1);
+    }
+    if (found) {
+        __atomic_sub_fetch(&walker->queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+/* Builds parent/name in the worker's path buffer; the old 4 KB stack buffer truncated deep paths. */
+static int walk_join(WalkWorker* worker, const WalkDir* dir, const char* name, size_t* length) {
+    size_t name_length = strlen(name);
+    size_t needed = dir->length + 1 + name_length + 1;
+    if (needed > worker->path_capacity) {
+        size_t new_capacity = worker->path_capacity * 2 > needed ? worker->path_capacity * 2 : needed;
+        char* path = (char*)realloc(worker->path, new_capacity);
+        if (!path) return 0;
+        worker->path = path;
+        worker->path_capacity = new_capacity;
+    }
+    memcpy(worker->path, dir->path, dir->length);
+    worker->path[dir->length] = '/';
+    memcpy(worker->path + dir->length + 1, name, name_length + 1);
+    *length = dir->length + 1 + name_length;
+    return 1;
+}
+
+static void walk_entry(WalkWorker* worker, const WalkDir* dir, int dir_fd, const char* name, unsigned char type) {
+    DirWalker* walker = worker->walker;
+
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) return;
+
+    /* d_type answers without a stat on most filesystems; symlinks met on the way are skipped, as grep -r does. */
+    if (type == DT_UNKNOWN) {
+        struct stat st;
+        worker->stats.stat_calls++;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+        type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+    }
+    if (type != DT_REG && !(type == DT_DIR && walker->recursive)) return;
+
+    size_t length;
+    if (!walk_join(worker, dir, name, &length)) return;
+
+    if (type == DT_REG) {
+        worker->stats.files++;
+        if (!walker->callback(worker->path, walker->userdata)) {
+            __atomic_store_n(&walker->stop, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    WalkDir child;
+    child.length = length;
+    child.path = (char*)malloc(length + 1);
+    if (!child.path) return;
+    memcpy(child.path, worker->path, length + 1);
+
+    child.fd = -1;
+    if (__atomic_add_fetch(&walker->open_dirs, 1, __ATOMIC_RELAXED) <= WALK_MAX_OPEN_DIRS) {
+        child.fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (child.fd < 0) {
+        __atomic_sub_fetch(&walker->open_dirs, 1, __ATOMIC_RELAXED);
+    }
+    walk_push(worker, &child);
+}
+
+static void walk_visit(WalkWorker* worker, WalkDir* dir) {
+    DirWalker* walker = worker->walker;
+    int fd = dir->fd;
+
+    if (fd >= 0) {
+        __atomic_sub_fetch(&walker->open_dirs, 1, __ATOMIC_RELAXED);
+    } else if (!walk_stopped(walker)) {
+        fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (fd < 0 || walk_stopped(walker)) {
+        if (fd >= 0) close(fd);
+        free(dir->path);
+        return;
+    }
+    worker->stats.directories++;
+
+#ifdef HAVE_GETDENTS64
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, worker->buffer, WALK_BUFFER_SIZE);
+        if (n <= 0) break;
+        for (long offset = 0; offset < n && !walk_stopped(walker);) {
+            struct walk_dirent64* entry = (struct walk_dirent64*)(worker->buffer + offset);
+            walk_entry(worker, dir, fd, entry->d_name, entry->d_type);
+            offset += entry->d_reclen;
+        }
+        if (walk_stopped(walker)) break;
+    }
+    close(fd);
+#else
+    DIR* stream = fdopendir(fd);
+    if (!stream) {
+        close(fd);
+        free(dir->path);
+        return;
+    }
+    struct dirent* entry;
+    while (!walk_stopped(walker) && (entry = readdir(stream)) != NULL) {
+        walk_entry(worker, dir, dirfd(stream), entry->d_name, entry->d_type);
+    }
+    closedir(stream);
+#endif
+
+    free(dir->path);
+}
+
+static void* walk_worker(void* arg) {
+    WalkWorker* worker = (WalkWorker*)arg;
+    DirWalker* walker = worker->walker;
+
+    for (;;) {
+        WalkDir dir;
+        if (walk_take(worker, &dir)) {
+            walk_visit(worker, &dir);
+            if (__atomic_sub_fetch(&walker->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+                pthread_mutex_lock(&walker->idle_mutex);
+                pthread_cond_broadcast(&walker->work);
+                pthread_mutex_unlock(&walker->idle_mutex);
+            }
+            continue;
+        }
+
+        /* Nothing to take: sleep until a directory is queued or the last one is done. */
+        pthread_mutex_lock(&walker->idle_mutex);
+        __atomic_add_fetch(&walker->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&walker->queued, __ATOMIC_SEQ_CST) == 0 &&
+               __atomic_load_n(&walker->pending, __ATOMIC_SEQ_CST) > 0) {
+            pthread_cond_wait(&walker->work, &walker->idle_mutex);
+        }
+        __atomic_sub_fetch(&walker->sleepers, 1, __ATOMIC_SEQ_CST);
+        int done = __atomic_load_n(&walker->pending, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&walker->idle_mutex);
+        if (done) break;
+    }
+
+    return NULL;
+}
+
+int walk_directory(const char* root, int recursive, size_t num_threads, WalkCallback callback, void* userdata,
+                   WalkStats* stats) {
+    if (!root || !callback) return 0;
+
+    WalkDir first;
+    first.fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (first.fd < 0) return 0;
+    first.length = strlen(root);
+    first.path = strdup(root);
+
+    size_t count = num_threads > 0 ? num_threads : 1;
+    DirWalker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.callback = callback;
+    walker.userdata = userdata;
+    walker.recursive = recursive;
+    walker.worker_count = count;
+    walker.open_dirs = 1;
+    walker.deques = (WalkDeque*)calloc(count, sizeof(WalkDeque));
+    WalkWorker* workers = (WalkWorker*)calloc(count, sizeof(WalkWorker));
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * count);
+
+    /* A deque's mutex is set up only once its worker has its buffers, so a failure destroys just those. */
+    int ok = first.path && walker.deques && workers && threads;
+    size_t ready = 0;
+    for (; ok && ready < count; ready++) {
+        WalkWorker* worker = &workers[ready];
+        worker->walker = &walker;
+        worker->index = ready;
+        worker->path_capacity = 4096;
+        worker->path = (char*)malloc(worker->path_capacity);
+        worker->buffer = (char*)malloc(WALK_BUFFER_SIZE);
+        ok = worker->path && worker->buffer;
+        if (!ok) break;
+        pthread_mutex_init(&walker.deques[ready].mutex, NULL);
+    }
+    if (!ok) {
+        for (size_t i = 0; workers && i < count; i++) {
+            free(workers[i].path);
+            free(workers[i].buffer);
+        }
+        for (size_t i = 0; i < ready; i++) {
+            pthread_mutex_destroy(&walker.deques[i].mutex);
+        }
+        free(workers);
+        free(threads);
+        free(walker.deques);
+        free(first.path);
+        close(first.fd);
+        return 0;
+    }
+    pthread_mutex_init(&walker.idle_mutex, NULL);
+    pthread_cond_init(&walker.work, NULL);
+
+    walk_push(&workers[0], &first);
+
+    /* The caller is walker 0; the others steal from it as soon as it queues subdirectories. */
+    size_t started = 1;
+    while (started < count && pthread_create(&threads[started], NULL, walk_worker, &workers[started]) == 0) {
+        started++;
+    }
+    walk_worker(&workers[0]);
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (stats) {
+            stats->directories += workers[i].stats.directories;
+            stats->files += workers[i].stats.files;
+            stats->stat_calls += workers[i].stats.stat_calls;
+        }
+        free(workers[i].path);
+        free(workers[i].buffer);
+        free(walker.deques[i].items);
+        pthread_mutex_destroy(&walker.deques[i].mutex);
+    }
+    free(workers);
+    free(threads);
+    free(walker.deques);
+    pthread_cond_destroy(&walker.work);
+    pthread_mutex_destroy(&walker.idle_mutex);
+    return 1;
+}
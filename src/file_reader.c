@@ -1,4 +1,7 @@
 #include "../include/file_reader.h"
+#include "../include/binary_detect.h"
+#include "../include/line_scan.h"
+#include "../include/uring_reader.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,10 +10,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
-#include <dirent.h>
 
 #define SMALL_FILE_THRESHOLD (1 * 1024 * 1024)
 #define INITIAL_FILE_CAPACITY 1024
+#define STREAM_READ_SIZE (1 * 1024 * 1024)
 
 FileData* file_open(const char* filepath) {
     FileData* file = (FileData*)malloc(sizeof(FileData));
@@ -20,6 +23,7 @@ FileData* file_open(const char* filepath) {
     file->size = 0;
     file->fd = -1;
     file->is_mapped = 0;
+    file->is_binary = 0;
     file->filepath = strdup(filepath);
 
     return file;
@@ -49,30 +53,48 @@ void file_close(FileData* file) {
     free(file);
 }
 
-ReadStatus file_read(FileData* file) {
+/* file_read(), except that a file larger than budget is closed again and left unread. */
+static ReadStatus file_read_within(FileData* file, size_t budget) {
     if (!file || !file->filepath) {
         return READ_ERROR_OPEN;
     }
 
-    file->fd = open(file->filepath, O_RDONLY);
-    if (file->fd < 0) {
+    int fd = open(file->filepath, O_RDONLY);
+    if (fd < 0) {
         return READ_ERROR_OPEN;
     }
 
     struct stat st;
-    if (fstat(file->fd, &st) != 0) {
-        close(file->fd);
-        file->fd = -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
         return READ_ERROR_STAT;
     }
 
     if (S_ISDIR(st.st_mode)) {
-        close(file->fd);
-        file->fd = -1;
+        close(fd);
         return READ_ERROR_DIRECTORY;
     }
 
-    file->size = st.st_size;
+    if ((size_t)st.st_size > budget) {
+        close(fd);
+        return READ_DEFERRED;
+    }
+
+    return file_load_fd(file, fd, st.st_size);
+}
+
+ReadStatus file_read(FileData* file) {
+    return file_read_within(file, SIZE_MAX);
+}
+
+/*
+ * Loads a regular file already open on fd whose size has been looked up:
+ * mapped past SMALL_FILE_THRESHOLD, read into a buffer below it. The file
+ * takes over fd, which is closed on failure.
+ */
+ReadStatus file_load_fd(FileData* file, int fd, size_t size) {
+    file->fd = fd;
+    file->size = size;
 
     if (file->size > SMALL_FILE_THRESHOLD) {
         file->data = (char*)mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
@@ -105,9 +127,104 @@ ReadStatus file_read(FileData* file) {
         file->fd = -1;
     }
 
+    file->is_binary = binary_detect(file->data, file->size);
+
     return READ_SUCCESS;
 }
 
+/*
+ * Reads a descriptor that can't be mapped or sized up front, such as a
+ * pipe, straight into a doubling buffer until end of input.
+ */
+ReadStatus file_read_fd(FileData* file, int fd) {
+    if (!file) return READ_ERROR_OPEN;
+
+    size_t capacity = STREAM_READ_SIZE;
+    size_t size = 0;
+    char* data = (char*)malloc(capacity + 1);
+    if (!data) return READ_ERROR_MEMORY;
+
+    for (;;) {
+        if (size == capacity) {
+            char* new_data = (char*)realloc(data, capacity * 2 + 1);
+            if (!new_data) {
+                free(data);
+                return READ_ERROR_MEMORY;
+            }
+            data = new_data;
+            capacity *= 2;
+        }
+
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(data);
+            return READ_ERROR_OPEN;
+        }
+        if (n == 0) break;
+        size += (size_t)n;
+    }
+
+    data[size] = '\0';
+    file->data = data;
+    file->size = size;
+    file->fd = -1;
+    file->is_mapped = 0;
+    file->is_binary = binary_detect(data, size);
+    return READ_SUCCESS;
+}
+
+/*
+ * Reads a batch of opened but unread files, filling statuses[i] (and the
+ * errno in errors[i]) as file_read() would. Small files go through
+ * reader's ring when one is given; large ones and everything on the
+ * synchronous path use file_read(). With max_bytes set, reading stops at
+ * the first file that would take the batch's bytes past it, sized from
+ * the open the read makes anyway; that file and the rest are
+ * READ_DEFERRED. files[0] is always read. Returns the backend that was used.
+ */
+ReadBackend file_read_batch(FileData** files, size_t count, UringReader* reader, size_t max_bytes, ReadStatus* statuses,
+                            int* errors) {
+    if (!files || !statuses || !errors) return READ_BACKEND_SYNC;
+
+    int uring =
+        reader && uring_read_files(reader, files, count, SMALL_FILE_THRESHOLD, max_bytes, statuses, errors);
+
+    size_t loaded = 0;
+    for (size_t i = 0; uring && i < count; i++) {
+        if (statuses[i] == READ_SUCCESS) loaded += files[i]->size;
+    }
+
+    int deferring = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (uring && statuses[i] != READ_ERROR_UNSUPPORTED) {
+            deferring = deferring || statuses[i] == READ_DEFERRED;
+            continue;
+        }
+        if (deferring) {
+            statuses[i] = READ_DEFERRED;
+            errors[i] = 0;
+            continue;
+        }
+
+        /* A large file the ring opened and sized is mapped from that descriptor; the ring budgeted it already. */
+        errno = 0;
+        if (uring && files[i]->fd >= 0) {
+            statuses[i] = file_load_fd(files[i], files[i]->fd, files[i]->size);
+        } else {
+            size_t budget = max_bytes == 0 || i == 0 ? SIZE_MAX : max_bytes > loaded ? max_bytes - loaded : 0;
+            statuses[i] = file_read_within(files[i], budget);
+        }
+        if (statuses[i] == READ_SUCCESS) {
+            loaded += files[i]->size;
+        }
+        deferring = statuses[i] == READ_DEFERRED;
+        errors[i] = statuses[i] == READ_SUCCESS || deferring ? 0 : errno;
+    }
+
+    return uring ? READ_BACKEND_URING : READ_BACKEND_SYNC;
+}
+
 FileList* filelist_create(void) {
     FileList* list = (FileList*)malloc(sizeof(FileList));
     if (!list) return NULL;
@@ -170,49 +287,11 @@ int filelist_add_path(FileList* list, const char* filepath) {
     return 1;
 }
 
-int traverse_directory(const char* dirpath, int recursive, FileCallback callback, void* userdata) {
-    DIR* dir = opendir(dirpath);
-    if (!dir) return 0;
-
-    struct dirent* entry;
-    char path[4096];
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        snprintf(path, sizeof(path), "%s/%s", dirpath, entry->d_name);
-
-        struct stat st;
-        if (stat(path, &st) != 0) {
-            continue;
-        }
-
-        if (S_ISREG(st.st_mode)) {
-            if (callback) {
-                callback(path, userdata);
-            }
-        } else if (recursive && S_ISDIR(st.st_mode)) {
-            traverse_directory(path, recursive, callback, userdata);
-        }
-    }
-
-    closedir(dir);
-    return 1;
-}
-
 size_t count_lines(const char* data, size_t size) {
     if (!data || size == 0) return 0;
 
-    size_t count = 0;
-    for (size_t i = 0; i < size; i++) {
-        if (data[i] == '\n') {
-            count++;
-        }
-    }
-
-    if (size > 0 && data[size - 1] != '\n') {
+    size_t count = line_count_newlines(data, 0, size);
+    if (data[size - 1] != '\n') {
         count++;
     }
 
@@ -222,34 +301,17 @@ size_t count_lines(const char* data, size_t size) {
 const char* find_line_start(const char* data, size_t size, size_t pos) {
     if (!data || pos >= size) return data;
 
-    size_t i = pos;
-    while (i > 0 && data[i - 1] != '\n') {
-        i--;
-    }
-
-    return data + i;
+    return data + line_find_start(data, pos);
 }
 
 const char* find_line_end(const char* data, size_t size, size_t pos) {
     if (!data || pos >= size) return data + size;
 
-    size_t i = pos;
-    while (i < size && data[i] != '\n') {
-        i++;
-    }
-
-    return data + i;
+    return data + line_find_end(data, size, pos);
 }
 
 size_t get_line_number(const char* data, size_t size, size_t pos) {
     if (!data || pos >= size) return 0;
 
-    size_t line = 1;
-    for (size_t i = 0; i < pos && i < size; i++) {
-        if (data[i] == '\n') {
-            line++;
-        }
-    }
-
-    return line;
-}
\ No newline at end of file
+    return 1 + line_count_newlines(data, 0, pos);
+}
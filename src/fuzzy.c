@@ -0,0 +1,133 @@
+#include "../include/fuzzy.h"
+#include <stdlib.h>
+
+Fuzzy* fuzzy_create(const char* needle, size_t len, int max_errors, int case_insensitive) {
+    if (!needle || len == 0 || len > FUZZY_MAX_LEN) return NULL;
+    if (max_errors < 0 || max_errors > FUZZY_MAX_ERRORS || (size_t)max_errors >= len) return NULL;
+
+    Fuzzy* fuzzy = (Fuzzy*)calloc(1, sizeof(Fuzzy));
+    if (!fuzzy) return NULL;
+
+    fuzzy->len = len;
+    fuzzy->max_errors = max_errors;
+    fuzzy->case_insensitive = case_insensitive;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)needle[i];
+        uint64_t forward = 1ULL << (i + 1);
+        uint64_t reverse = 1ULL << (len - i);
+
+        fuzzy->masks[c] |= forward;
+        fuzzy->reverse_masks[c] |= reverse;
+        if (case_insensitive && (unsigned char)((c | 0x20) - 'a') < 26) {
+            fuzzy->masks[c ^ 0x20] |= forward;
+            fuzzy->reverse_masks[c ^ 0x20] |= reverse;
+        }
+    }
+
+    /* Matches never span lines. */
+    fuzzy->masks['\n'] = 0;
+    fuzzy->reverse_masks['\n'] = 0;
+
+    return fuzzy;
+}
+
+void fuzzy_free(Fuzzy* fuzzy) {
+    free(fuzzy);
+}
+
+/* Prefixes of length 0..d need d deletions at most. */
+static inline void bitap_reset(uint64_t* state, int max_errors) {
+    for (int d = 0; d <= max_errors; d++) {
+        state[d] = (2ULL << d) - 1;
+    }
+}
+
+/*
+ * One Wu-Manber step: state[d] bit j means needle[0, j) aligns with the
+ * text read so far with at most d edits. fresh re-seeds the empty prefix
+ * at every position (search); without it the alignment is anchored.
+ */
+static inline void bitap_step(const uint64_t* masks, uint64_t* state, int max_errors, unsigned char c,
+                              uint64_t fresh) {
+    uint64_t mask = masks[c];
+    uint64_t prev_old = state[0];
+
+    state[0] = ((state[0] << 1) & mask) | fresh;
+    for (int d = 1; d <= max_errors; d++) {
+        uint64_t old = state[d];
+        state[d] = ((old << 1) & mask) | (prev_old << 1) | prev_old | (state[d - 1] << 1) | fresh;
+        prev_old = old;
+    }
+}
+
+static inline int fewest_errors(const uint64_t* state, int max_errors, uint64_t accept) {
+    for (int d = 0; d <= max_errors; d++) {
+        if (state[d] & accept) return d;
+    }
+    return max_errors + 1;
+}
+
+/*
+ * Walks back from end with the reversed needle, anchored at end, and
+ * returns the earliest start that still aligns within errors edits.
+ */
+static size_t fuzzy_match_start(const Fuzzy* fuzzy, const char* data, size_t pos, size_t end, int errors) {
+    uint64_t state[FUZZY_MAX_ERRORS + 1];
+    uint64_t accept = 1ULL << fuzzy->len;
+    size_t start = end > fuzzy->len + pos ? end - fuzzy->len : pos;
+
+    bitap_reset(state, errors);
+    for (size_t j = end; j > pos; j--) {
+        bitap_step(fuzzy->reverse_masks, state, errors, (unsigned char)data[j - 1], 0);
+        if (state[errors] & accept) {
+            start = j - 1;
+        }
+        if (!state[errors]) break;
+    }
+
+    return start;
+}
+
+/*
+ * Returns the start of the first match ending at or after pos within
+ * data[pos, size), or size if there is none. Of the ends reachable within
+ * max_errors bytes of the first one, the one with the fewest edits wins.
+ */
+size_t fuzzy_find(const Fuzzy* fuzzy, const char* data, size_t size, size_t pos, size_t* match_end) {
+    if (!fuzzy || !data || !match_end) return size;
+
+    uint64_t state[FUZZY_MAX_ERRORS + 1];
+    uint64_t accept = 1ULL << fuzzy->len;
+    int k = fuzzy->max_errors;
+    size_t line_start = pos;
+
+    bitap_reset(state, k);
+    for (size_t i = pos; i < size; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '\n') {
+            bitap_reset(state, k);
+            line_start = i + 1;
+            continue;
+        }
+
+        bitap_step(fuzzy->masks, state, k, c, 1);
+        if (!(state[k] & accept)) continue;
+
+        int best = fewest_errors(state, k, accept);
+        size_t best_end = i + 1;
+        for (size_t j = i + 1; best > 0 && j < size && j <= i + (size_t)k && data[j] != '\n'; j++) {
+            bitap_step(fuzzy->masks, state, k, (unsigned char)data[j], 1);
+            int errors = fewest_errors(state, k, accept);
+            if (errors <= best) {
+                best = errors;
+                best_end = j + 1;
+            }
+        }
+
+        *match_end = best_end;
+        return fuzzy_match_start(fuzzy, data, line_start, best_end, best);
+    }
+
+    return size;
+}
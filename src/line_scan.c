@@ -0,0 +1,109 @@
+#include "../include/line_scan.h"
+#include "../include/cpu_dispatch.h"
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static size_t count_newlines_scalar(const char* data, size_t from, size_t to) {
+    size_t count = 0;
+    for (size_t i = from; i < to; i++) {
+        if (data[i] == '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+
+#ifdef CPU_X86
+TARGET_SSE42
+static size_t count_newlines_sse42(const char* data, size_t from, size_t to) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t pos = from;
+
+    for (; pos + 16 <= to; pos += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + pos));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+    }
+
+    return count + count_newlines_scalar(data, pos, to);
+}
+
+TARGET_AVX2
+static size_t count_newlines_avx2(const char* data, size_t from, size_t to) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t pos = from;
+
+    /* Two blocks per iteration so the popcounts of one overlap the loads of the next. */
+    for (; pos + 64 <= to; pos += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(data + pos));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(data + pos + 32));
+        unsigned lo_mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline));
+        unsigned hi_mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline));
+        count += (size_t)__builtin_popcountll(((unsigned long long)hi_mask << 32) | lo_mask);
+    }
+
+    for (; pos + 32 <= to; pos += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + pos));
+        count += (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+    }
+
+    return count + count_newlines_scalar(data, pos, to);
+}
+
+TARGET_AVX512
+static size_t count_newlines_avx512(const char* data, size_t from, size_t to) {
+    const __m512i newline = _mm512_set1_epi8('\n');
+    size_t count = 0;
+
+    for (size_t pos = from; pos < to; pos += 64) {
+        size_t remaining = to - pos;
+        __mmask64 lanes = remaining >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << remaining) - 1);
+        __m512i block = _mm512_maskz_loadu_epi8(lanes, data + pos);
+        count += (size_t)__builtin_popcountll(_mm512_mask_cmpeq_epi8_mask(lanes, block, newline));
+    }
+
+    return count;
+}
+#endif
+
+/* Number of '\n' bytes in data[from, to). */
+size_t line_count_newlines(const char* data, size_t from, size_t to) {
+    if (!data || from >= to) return 0;
+
+#ifdef CPU_X86
+    switch (kernel_active()) {
+        case KERNEL_AVX512:
+            return count_newlines_avx512(data, from, to);
+        case KERNEL_AVX2:
+            return count_newlines_avx2(data, from, to);
+        case KERNEL_SSE42:
+            return count_newlines_sse42(data, from, to);
+        default:
+            break;
+    }
+#endif
+
+    return count_newlines_scalar(data, from, to);
+}
+
+/*
+ * Line boundaries go through memrchr/memchr, which glibc already
+ * vectorizes for every ISA level it supports.
+ */
+size_t line_find_start(const char* data, size_t pos) {
+    if (!data || pos == 0) return 0;
+
+    const char* newline = (const char*)memrchr(data, '\n', pos);
+    return newline ? (size_t)(newline - data) + 1 : 0;
+}
+
+size_t line_find_end(const char* data, size_t size, size_t pos) {
+    if (!data || pos >= size) return size;
+
+    const char* newline = (const char*)memchr(data + pos, '\n', size - pos);
+    return newline ? (size_t)(newline - data) : size;
+}
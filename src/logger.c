@@ -53,11 +53,15 @@ void logger_enable(Logger* logger, int enabled) {
 }
 
 void logger_log(Logger* logger, LogLevel level, const char* format, ...) {
-    if (!logger || !logger->enabled || level < logger->level) return;
-    if (!format) return;
-
     va_list args;
     va_start(args, format);
+    logger_vlog(logger, level, format, args);
+    va_end(args);
+}
+
+void logger_vlog(Logger* logger, LogLevel level, const char* format, va_list args) {
+    if (!logger || !logger->enabled || level < logger->level) return;
+    if (!format) return;
 
     int is_tty = isatty(fileno(logger->output));
 
@@ -69,8 +73,6 @@ void logger_log(Logger* logger, LogLevel level, const char* format, ...) {
 
     vfprintf(logger->output, format, args);
     fprintf(logger->output, "\n");
-
-    va_end(args);
 }
 
 void logger_debug(Logger* logger, const char* format, ...) {
@@ -79,7 +81,7 @@ void logger_debug(Logger* logger, const char* format, ...) {
 
     va_list args;
     va_start(args, format);
-    logger_log(logger, LOG_DEBUG, format, args);
+    logger_vlog(logger, LOG_DEBUG, format, args);
     va_end(args);
 }
 
@@ -89,7 +91,7 @@ void logger_info(Logger* logger, const char* format, ...) {
 
     va_list args;
     va_start(args, format);
-    logger_log(logger, LOG_INFO, format, args);
+    logger_vlog(logger, LOG_INFO, format, args);
     va_end(args);
 }
 
@@ -99,7 +101,7 @@ void logger_warn(Logger* logger, const char* format, ...) {
 
     va_list args;
     va_start(args, format);
-    logger_log(logger, LOG_WARN, format, args);
+    logger_vlog(logger, LOG_WARN, format, args);
     va_end(args);
 }
 
@@ -109,7 +111,7 @@ void logger_error(Logger* logger, const char* format, ...) {
 
     va_list args;
     va_start(args, format);
-    logger_log(logger, LOG_ERROR, format, args);
+    logger_vlog(logger, LOG_ERROR, format, args);
     va_end(args);
 }
 
@@ -125,11 +127,17 @@ void logger_timer_stop(Logger* logger) {
 void logger_timer_print(Logger* logger) {
     if (!logger || !logger->enabled) return;
 
+    logger_info(logger, "Elapsed time: %.2f ms", logger_timer_elapsed(logger));
+}
+
+double logger_timer_elapsed(Logger* logger) {
+    if (!logger) return 0.0;
+
     struct timeval end_time;
     gettimeofday(&end_time, NULL);
 
     double elapsed = (end_time.tv_sec - logger->start_time.tv_sec) * 1000.0;
     elapsed += (end_time.tv_usec - logger->start_time.tv_usec) / 1000.0;
 
-    logger_info(logger, "Elapsed time: %.2f ms", elapsed);
+    return elapsed;
 }
\ No newline at end of file
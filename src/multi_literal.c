@@ -0,0 +1,339 @@
+#include "../include/multi_literal.h"
+#include "../include/cpu_dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define MULTI_KEY_MAX 8
+
+static inline unsigned char ascii_fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+static size_t literal_key_hash(const char* s, size_t key_len, int fold, size_t mask) {
+    unsigned long long key = 0;
+    for (size_t i = 0; i < key_len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        key = (key << 8) | (fold ? ascii_fold(c) : c);
+    }
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+/*
+ * Teddy: literals are spread over 8 buckets, grouped so that literals with
+ * similar prefixes share a bucket. For each of the first fingerprint_len
+ * bytes, two 16-entry tables map the low and high nibble of a data byte to
+ * the set of buckets that have a literal with a matching nibble at that
+ * offset. ANDing the shuffled tables over all offsets leaves a non-zero
+ * lane only where some bucket's fingerprint may start.
+ */
+static int teddy_build(MultiLiteral* ml) {
+    size_t* order = (size_t*)malloc(sizeof(size_t) * ml->count);
+    if (!order) return 0;
+
+    for (size_t i = 0; i < ml->count; i++) {
+        order[i] = i;
+    }
+
+    ml->fingerprint_len = ml->min_len < TEDDY_MAX_FINGERPRINT ? ml->min_len : TEDDY_MAX_FINGERPRINT;
+
+    /* Insertion sort by fingerprint; Teddy sets are at most TEDDY_MAX_LITERALS long. */
+    for (size_t i = 1; i < ml->count; i++) {
+        size_t index = order[i];
+        size_t j = i;
+        while (j > 0 && memcmp(ml->folded[order[j - 1]], ml->folded[index], ml->fingerprint_len) > 0) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = index;
+    }
+
+    memset(ml->lo_masks, 0, sizeof(ml->lo_masks));
+    memset(ml->hi_masks, 0, sizeof(ml->hi_masks));
+
+    for (size_t rank = 0; rank < ml->count; rank++) {
+        const unsigned char* lit = (const unsigned char*)ml->folded[order[rank]];
+        unsigned char bucket_bit = (unsigned char)(1u << (rank * TEDDY_BUCKETS / ml->count));
+
+        for (size_t k = 0; k < ml->fingerprint_len; k++) {
+            unsigned char c = lit[k];
+            ml->lo_masks[k][c & 0x0F] |= bucket_bit;
+            ml->hi_masks[k][c >> 4] |= bucket_bit;
+
+            if (ml->case_insensitive && (unsigned char)(c - 'a') < 26) {
+                unsigned char upper = (unsigned char)(c & ~0x20);
+                ml->lo_masks[k][upper & 0x0F] |= bucket_bit;
+                ml->hi_masks[k][upper >> 4] |= bucket_bit;
+            }
+        }
+    }
+
+    free(order);
+    return 1;
+}
+
+MultiLiteral* multi_literal_create(const char* const* literals, size_t count, int case_insensitive) {
+    if (!literals || count == 0) return NULL;
+
+    MultiLiteral* ml = (MultiLiteral*)calloc(1, sizeof(MultiLiteral));
+    if (!ml) return NULL;
+
+    ml->count = count;
+    ml->case_insensitive = case_insensitive;
+    ml->literals = (char**)calloc(count, sizeof(char*));
+    ml->folded = (char**)calloc(count, sizeof(char*));
+    ml->lengths = (size_t*)malloc(sizeof(size_t) * count);
+    ml->bucket_members = (size_t*)malloc(sizeof(size_t) * count);
+    ml->empty_members = (size_t*)malloc(sizeof(size_t) * count);
+    if (!ml->literals || !ml->folded || !ml->lengths || !ml->bucket_members || !ml->empty_members) {
+        multi_literal_free(ml);
+        return NULL;
+    }
+
+    ml->min_len = (size_t)-1;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(literals[i]);
+        ml->lengths[i] = len;
+        ml->literals[i] = strdup(literals[i]);
+        ml->folded[i] = (char*)malloc(len + 1);
+        if (!ml->literals[i] || !ml->folded[i]) {
+            multi_literal_free(ml);
+            return NULL;
+        }
+
+        for (size_t j = 0; j <= len; j++) {
+            unsigned char c = (unsigned char)literals[i][j];
+            ml->folded[i][j] = (char)(case_insensitive ? ascii_fold(c) : c);
+        }
+
+        if (len < ml->min_len) {
+            ml->min_len = len;
+        }
+    }
+
+    ml->key_len = MULTI_KEY_MAX;
+    for (size_t i = 0; i < count; i++) {
+        if (ml->lengths[i] == 0) {
+            ml->empty_members[ml->empty_count++] = i;
+        } else if (ml->lengths[i] < ml->key_len) {
+            ml->key_len = ml->lengths[i];
+        }
+    }
+
+    size_t buckets = 16;
+    while (buckets < count * 2) {
+        buckets *= 2;
+    }
+    ml->bucket_mask = buckets - 1;
+    ml->bucket_start = (size_t*)calloc(buckets + 1, sizeof(size_t));
+    size_t* fill = (size_t*)malloc(sizeof(size_t) * buckets);
+    if (!ml->bucket_start || !fill) {
+        free(fill);
+        multi_literal_free(ml);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (ml->lengths[i] > 0) {
+            ml->bucket_start[literal_key_hash(ml->folded[i], ml->key_len, 0, ml->bucket_mask) + 1]++;
+            ml->first_bytes[(unsigned char)ml->folded[i][0]] = 1;
+            if (case_insensitive) {
+                ml->first_bytes[(unsigned char)toupper((unsigned char)ml->folded[i][0])] = 1;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < buckets; b++) {
+        ml->bucket_start[b + 1] += ml->bucket_start[b];
+        fill[b] = ml->bucket_start[b];
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (ml->lengths[i] > 0) {
+            ml->bucket_members[fill[literal_key_hash(ml->folded[i], ml->key_len, 0, ml->bucket_mask)]++] = i;
+        }
+    }
+    free(fill);
+
+    ml->use_teddy = 0;
+    if (ml->min_len > 0 && count <= TEDDY_MAX_LITERALS && kernel_active() != KERNEL_SCALAR) {
+        if (!teddy_build(ml)) {
+            multi_literal_free(ml);
+            return NULL;
+        }
+        ml->use_teddy = 1;
+    }
+
+    return ml;
+}
+
+void multi_literal_free(MultiLiteral* ml) {
+    if (!ml) return;
+
+    for (size_t i = 0; i < ml->count; i++) {
+        if (ml->literals) free(ml->literals[i]);
+        if (ml->folded) free(ml->folded[i]);
+    }
+
+    free(ml->literals);
+    free(ml->folded);
+    free(ml->lengths);
+    free(ml->bucket_start);
+    free(ml->bucket_members);
+    free(ml->empty_members);
+    free(ml);
+}
+
+static size_t find_candidate_scalar(const MultiLiteral* ml, const char* data, size_t size, size_t pos) {
+    if (ml->empty_count > 0) {
+        return pos < size ? pos : size;
+    }
+
+    for (; pos + ml->min_len <= size; pos++) {
+        if (ml->first_bytes[(unsigned char)data[pos]]) {
+            return pos;
+        }
+    }
+
+    return size;
+}
+
+#ifdef CPU_X86
+TARGET_AVX2
+static size_t find_candidate_teddy_avx2(const MultiLiteral* ml, const char* data, size_t size, size_t pos) {
+    size_t fp = ml->fingerprint_len;
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo[TEDDY_MAX_FINGERPRINT];
+    __m256i hi[TEDDY_MAX_FINGERPRINT];
+
+    for (size_t k = 0; k < fp; k++) {
+        lo[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ml->lo_masks[k]));
+        hi[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ml->hi_masks[k]));
+    }
+
+    while (pos + 32 + fp - 1 <= size) {
+        __m256i res = _mm256_set1_epi8((char)0xFF);
+
+        for (size_t k = 0; k < fp; k++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + pos + k));
+            __m256i lo_bits = _mm256_shuffle_epi8(lo[k], _mm256_and_si256(v, nibble));
+            __m256i hi_bits = _mm256_shuffle_epi8(hi[k], _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            res = _mm256_and_si256(res, _mm256_and_si256(lo_bits, hi_bits));
+        }
+
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(res, _mm256_setzero_si256()));
+        if (mask != 0) {
+            return pos + (unsigned)__builtin_ctz(mask);
+        }
+
+        pos += 32;
+    }
+
+    return find_candidate_scalar(ml, data, size, pos);
+}
+
+TARGET_SSE42
+static size_t find_candidate_teddy_sse42(const MultiLiteral* ml, const char* data, size_t size, size_t pos) {
+    size_t fp = ml->fingerprint_len;
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i lo[TEDDY_MAX_FINGERPRINT];
+    __m128i hi[TEDDY_MAX_FINGERPRINT];
+
+    for (size_t k = 0; k < fp; k++) {
+        lo[k] = _mm_loadu_si128((const __m128i*)ml->lo_masks[k]);
+        hi[k] = _mm_loadu_si128((const __m128i*)ml->hi_masks[k]);
+    }
+
+    while (pos + 16 + fp - 1 <= size) {
+        __m128i res = _mm_set1_epi8((char)0xFF);
+
+        for (size_t k = 0; k < fp; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + pos + k));
+            __m128i lo_bits = _mm_shuffle_epi8(lo[k], _mm_and_si128(v, nibble));
+            __m128i hi_bits = _mm_shuffle_epi8(hi[k], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            res = _mm_and_si128(res, _mm_and_si128(lo_bits, hi_bits));
+        }
+
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(res, _mm_setzero_si128())) & 0xFFFF;
+        if (mask != 0) {
+            return pos + (unsigned)__builtin_ctz(mask);
+        }
+
+        pos += 16;
+    }
+
+    return find_candidate_scalar(ml, data, size, pos);
+}
+#endif
+
+size_t multi_literal_find_candidate(const MultiLiteral* ml, const char* data, size_t size, size_t pos) {
+    if (!ml || !data) return size;
+
+#ifdef CPU_X86
+    if (ml->use_teddy) {
+        switch (kernel_active()) {
+            case KERNEL_AVX512:
+            case KERNEL_AVX2:
+                return find_candidate_teddy_avx2(ml, data, size, pos);
+            case KERNEL_SSE42:
+                return find_candidate_teddy_sse42(ml, data, size, pos);
+            default:
+                break;
+        }
+    }
+#endif
+
+    return find_candidate_scalar(ml, data, size, pos);
+}
+
+static int literal_matches_at(const MultiLiteral* ml, size_t index, const char* data, size_t size, size_t pos) {
+    size_t len = ml->lengths[index];
+    if (pos + len > size) return 0;
+
+    if (!ml->case_insensitive) {
+        return memcmp(data + pos, ml->literals[index], len) == 0;
+    }
+
+    const char* folded = ml->folded[index];
+    for (size_t i = 0; i < len; i++) {
+        if (ascii_fold((unsigned char)data[pos + i]) != (unsigned char)folded[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Returns the next literal matching at pos, or ml->count when exhausted.
+ * *cursor must start at 0 for each position; empty literals come first,
+ * then literals sharing the key hash, each group in pattern order.
+ */
+size_t multi_literal_next_match(const MultiLiteral* ml, const char* data, size_t size, size_t pos, size_t* cursor) {
+    if (!ml || !data || !cursor || pos >= size) return ml ? ml->count : 0;
+
+    if (*cursor < ml->empty_count) {
+        return ml->empty_members[(*cursor)++];
+    }
+
+    if (pos + ml->key_len > size || ml->empty_count == ml->count) {
+        return ml->count;
+    }
+
+    size_t bucket = literal_key_hash(data + pos, ml->key_len, ml->case_insensitive, ml->bucket_mask);
+    size_t group_start = ml->bucket_start[bucket];
+    size_t group_size = ml->bucket_start[bucket + 1] - group_start;
+
+    while (*cursor - ml->empty_count < group_size) {
+        size_t index = ml->bucket_members[group_start + (*cursor - ml->empty_count)];
+        (*cursor)++;
+        if (literal_matches_at(ml, index, data, size, pos)) {
+            return index;
+        }
+    }
+
+    return ml->count;
+}
@@ -1,4 +1,5 @@
 #include "../include/output.h"
+#include "../include/line_scan.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -49,6 +50,13 @@ void output_set_quiet(OutputConfig* config, int enable) {
     config->quiet = enable ? 1 : 0;
 }
 
+/* Must be set before anything is written: each line goes out as soon as it is printed. */
+void output_set_line_buffered(OutputConfig* config, int enable) {
+    if (!config || !config->output || !enable) return;
+
+    setvbuf(config->output, NULL, _IOLBF, 0);
+}
+
 void output_color_start(OutputConfig* config, ColorCode color) {
     if (!config || !config->color || !config->output) return;
 
@@ -63,50 +71,147 @@ void output_color_end(OutputConfig* config) {
     fputs(COLOR_CODES[COLOR_RESET], config->output);
 }
 
-void output_match(OutputConfig* config, const char* filepath, const char* data, size_t size, const Match* match) {
-    if (!config || !data || !match || config->quiet) return;
-    if (match->start >= size || match->end > size) return;
-
+/*
+ * Writes data[line_start, line_end) with its prefixes, coloring the spans.
+ * Spans are sorted by start but may overlap; each byte is colored once.
+ */
+static void output_line(OutputConfig* config, const char* filepath, const char* data, size_t line_start,
+                        size_t line_end, size_t line_num, const Span* spans, size_t span_count) {
     FILE* out = config->output;
 
-    const char* line_start = find_line_start(data, size, match->start);
-    const char* line_end = find_line_end(data, size, match->start);
-    size_t line_len = line_end - line_start;
-
     if (config->show_filename && filepath) {
         fprintf(out, "%s:", filepath);
     }
 
     if (config->line_numbers) {
-        fprintf(out, "%zu:", match->line_num);
+        fprintf(out, "%zu:", line_num);
     }
 
+    size_t cursor = line_start;
     if (config->color) {
-        size_t match_offset = match->start - (line_start - data);
-        size_t match_len = match->end - match->start;
+        for (size_t i = 0; i < span_count; i++) {
+            size_t span_start = spans[i].start > cursor ? spans[i].start : cursor;
+            size_t span_end = spans[i].end < line_end ? spans[i].end : line_end;
+            if (span_end <= span_start) continue;
 
-        fwrite(line_start, 1, match_offset, out);
+            fwrite(data + cursor, 1, span_start - cursor, out);
 
-        output_color_start(config, COLOR_RED);
-        fwrite(line_start + match_offset, 1, match_len, out);
-        output_color_end(config);
+            output_color_start(config, COLOR_RED);
+            fwrite(data + span_start, 1, span_end - span_start, out);
+            output_color_end(config);
 
-        fwrite(line_start + match_offset + match_len, 1, line_len - match_offset - match_len, out);
-    } else {
-        fwrite(line_start, 1, line_len, out);
+            cursor = span_end;
+        }
     }
 
+    fwrite(data + cursor, 1, line_end - cursor, out);
     fputc('\n', out);
 }
 
+void output_match(OutputConfig* config, const char* filepath, const char* data, size_t size, const Match* match) {
+    if (!config || !data || !match || config->quiet) return;
+    if (size == 0 || match->start > size || match->end > size) return;
+
+    /* An empty match may sit at the very end of an unterminated last line. */
+    size_t anchor = match->start < size ? match->start : size - 1;
+    size_t line_start = (size_t)(find_line_start(data, size, anchor) - data);
+    size_t line_end = (size_t)(find_line_end(data, size, anchor) - data);
+    Span span = {match->start, match->end};
+
+    output_line(config, filepath, data, line_start, line_end, match->line_num, &span, 1);
+}
+
+/*
+ * Inverted records are gaps of whole non-matching lines; each line is
+ * printed on its own, at most *remaining of them when that is nonzero.
+ */
+static void output_gap(OutputConfig* config, const char* filepath, const char* data, size_t start, size_t end,
+                       size_t line_num, size_t* remaining) {
+    while (start < end) {
+        if (*remaining > 0 && --*remaining == 0) {
+            end = line_find_end(data, end, start);
+        }
+
+        size_t line_end = line_find_end(data, end, start);
+        output_line(config, filepath, data, start, line_end, line_num, NULL, 0);
+        start = line_end + 1;
+        line_num++;
+    }
+}
+
+/*
+ * Searches leave line_num unset; it is only worked out here, and only
+ * with -n, by counting the newlines between consecutive matches. Line
+ * mode records are printed once each with their spans highlighted.
+ */
 void output_matches(OutputConfig* config, const char* filepath, const char* data, size_t size, const MatchList* matches) {
+    output_matches_from(config, filepath, data, size, matches, 1);
+}
+
+/* As output_matches() for a streamed window whose first line is first_line. */
+void output_matches_from(OutputConfig* config, const char* filepath, const char* data, size_t size,
+                         const MatchList* matches, size_t first_line) {
     if (!config || !data || !matches) return;
 
+    size_t line_pos = 0;
+    size_t line_num = first_line;
+    size_t remaining = matches->invert ? matches->limit : 0;
+
     for (size_t i = 0; i < matches->count; i++) {
-        output_match(config, filepath, data, size, &matches->matches[i]);
+        Match match = matches->matches[i];
+
+        if (config->line_numbers && match.start <= size) {
+            if (match.start >= line_pos) {
+                line_num += line_count_newlines(data, line_pos, match.start);
+            } else {
+                line_num -= line_count_newlines(data, match.start, line_pos);
+            }
+            line_pos = match.start;
+            match.line_num = line_num;
+        }
+
+        if (matches->mode == MATCH_MODE_LINES && matches->invert) {
+            if (config->quiet || match.end > size) continue;
+            output_gap(config, filepath, data, match.start, match.end, match.line_num, &remaining);
+            if (matches->limit > 0 && remaining == 0) break;
+        } else if (matches->mode == MATCH_MODE_LINES) {
+            if (config->quiet || match.end > size) continue;
+            const Span* spans = match.span_count > 0 ? matches->spans + match.span_index : NULL;
+            output_line(config, filepath, data, match.start, match.end, match.line_num, spans, match.span_count);
+        } else {
+            output_match(config, filepath, data, size, &match);
+        }
     }
 }
 
+/* -c: the count, prefixed with the file name when names are shown. */
+void output_count(OutputConfig* config, const char* filepath, size_t count) {
+    if (!config || config->quiet) return;
+
+    if (config->show_filename && filepath) {
+        fprintf(config->output, "%s:", filepath);
+    }
+    fprintf(config->output, "%zu\n", count);
+}
+
+/* -l/-L: one file name per line. */
+void output_filename(OutputConfig* config, const char* filepath) {
+    if (!config || !filepath || config->quiet) return;
+
+    output_color_start(config, COLOR_MAGENTA);
+    fputs(filepath, config->output);
+    output_color_end(config);
+    fputc('\n', config->output);
+}
+
+/* A binary file's lines would be garbage on a terminal, so only the fact of a match is reported, on stderr like grep. */
+void output_binary_match(OutputConfig* config, const char* filepath) {
+    if (!config || !filepath || config->quiet) return;
+
+    fflush(config->output);
+    fprintf(stderr, "fgrep: %s: binary file matches\n", filepath);
+}
+
 void output_error(const char* message) {
     if (!message) return;
 
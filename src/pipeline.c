@@ -0,0 +1,360 @@
+#include "../include/pipeline.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void pipeline_config_init(PipelineConfig* config) {
+    if (!config) return;
+
+    config->num_threads = 1;
+    config->max_files = PIPELINE_MAX_FILES;
+    config->max_bytes = PIPELINE_MAX_BYTES;
+    config->backend = READ_BACKEND_AUTO;
+    config->skip_search = 0;
+}
+
+static int pipeline_cancelled(const FilePipeline* pipeline) {
+    return __atomic_load_n(&pipeline->cancelled, __ATOMIC_RELAXED);
+}
+
+/* Sets up the file's match list from the options and searches it; once -q is answered the rest are only passed through. */
+static void pipeline_search_slot(FilePipeline* pipeline, PipelineSlot* slot) {
+    const SearchOptions* options = pipeline->options;
+    const FileData* file = slot->file;
+
+    if (slot->status != READ_SUCCESS) return;
+
+    slot->matches = matchlist_create();
+    if (!slot->matches) {
+        slot->status = READ_ERROR_MEMORY;
+        slot->error = ENOMEM;
+        return;
+    }
+    matchlist_set_mode(slot->matches, options->mode, options->highlight);
+    matchlist_set_invert(slot->matches, options->invert);
+    if (options->binary_summary && file->is_binary) {
+        matchlist_set_mode(slot->matches, MATCH_MODE_COUNT, 0);
+        matchlist_set_limit(slot->matches, 1);
+    } else {
+        matchlist_set_limit(slot->matches, options->limit);
+    }
+    if (options->stop_on_match) {
+        matchlist_set_cancel(slot->matches, &pipeline->cancelled);
+    }
+
+    if (pipeline->config.skip_search || pipeline_cancelled(pipeline) || (options->skip_binary && file->is_binary)) {
+        return;
+    }
+    search_pattern(pipeline->pattern, file->data, file->size, slot->matches);
+
+    if (options->stop_on_match && slot->matches->count > 0) {
+        __atomic_store_n(&pipeline->cancelled, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Called with the mutex held once the pipeline stops or -q is answered, so no stage sleeps through it. */
+static void pipeline_wake_all(FilePipeline* pipeline) {
+    pthread_cond_broadcast(&pipeline->queued);
+    pthread_cond_broadcast(&pipeline->readable);
+    pthread_cond_broadcast(&pipeline->space);
+}
+
+/* Called with the mutex held; reports and frees finished files unless another worker already is. */
+static void pipeline_drain(FilePipeline* pipeline) {
+    if (pipeline->draining) return;
+
+    size_t released = pipeline->next_output;
+    size_t max_bytes = pipeline->config.max_bytes;
+    pipeline->draining = 1;
+    while (!pipeline->stop) {
+        PipelineSlot* slot = &pipeline->slots[pipeline->next_output % pipeline->slot_count];
+        if (slot->state != SLOT_DONE) break;
+
+        pthread_mutex_unlock(&pipeline->mutex);
+        int keep_going = !pipeline->callback || pipeline->callback(slot->file, slot->status, slot->error,
+                                                                   slot->named, slot->matches, pipeline->userdata);
+        file_close(slot->file);
+        matchlist_free(slot->matches);
+        pthread_mutex_lock(&pipeline->mutex);
+
+        if (!keep_going) {
+            pipeline->stop = 1;
+            pipeline_wake_all(pipeline);
+        }
+
+        pipeline->bytes_in_flight -= slot->bytes;
+        slot->file = NULL;
+        slot->matches = NULL;
+        slot->state = SLOT_FREE;
+        pipeline->next_output++;
+    }
+    pipeline->draining = 0;
+
+    /* A full ring wakes the caller only once an eighth of it is free, so traversal refills it in runs. */
+    size_t free_slots = pipeline->slot_count - (pipeline->next_submit - pipeline->next_output);
+    if (pipeline->next_output != released) {
+        if (pipeline->submit_waiting > 0 && free_slots >= (pipeline->slot_count + 7) / 8) {
+            pthread_cond_broadcast(&pipeline->space);
+        }
+        /* The reader can reach the cap while a callback runs unlocked, so this goes by the bytes left now. */
+        if (pipeline->reader_waiting && (max_bytes == 0 || pipeline->bytes_in_flight < max_bytes) &&
+            (pipeline->next_read != pipeline->next_submit || pipeline->finished)) {
+            pthread_cond_signal(&pipeline->queued);
+        }
+    }
+}
+
+/*
+ * Reads whatever has been queued, up to a batch at a time, in submission
+ * order. Files that arrive with data (stdin) are passed through as read.
+ */
+static void* pipeline_reader(void* arg) {
+    FilePipeline* pipeline = (FilePipeline*)arg;
+    FileData* batch[PIPELINE_READ_BATCH];
+    ReadStatus statuses[PIPELINE_READ_BATCH];
+    int errors[PIPELINE_READ_BATCH];
+    size_t positions[PIPELINE_READ_BATCH];
+
+    pthread_mutex_lock(&pipeline->mutex);
+    for (;;) {
+        while (!pipeline->stop && !pipeline_cancelled(pipeline) &&
+               ((pipeline->next_read == pipeline->next_submit && !pipeline->finished) ||
+                (pipeline->config.max_bytes > 0 && pipeline->bytes_in_flight >= pipeline->config.max_bytes))) {
+            pipeline->reader_waiting = 1;
+            pthread_cond_wait(&pipeline->queued, &pipeline->mutex);
+            pipeline->reader_waiting = 0;
+        }
+        if (pipeline->stop || pipeline_cancelled(pipeline) || pipeline->next_read == pipeline->next_submit) break;
+
+        /* A trickle of files from traversal is gathered briefly rather than read one wakeup at a time. */
+        if (!pipeline->finished && pipeline->next_submit - pipeline->next_read < PIPELINE_READ_MIN) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += PIPELINE_GATHER_US * 1000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pipeline->reader_waiting = 1;
+            pthread_cond_timedwait(&pipeline->queued, &pipeline->mutex, &deadline);
+            pipeline->reader_waiting = 0;
+            if (pipeline->stop || pipeline_cancelled(pipeline)) break;
+        }
+
+        size_t first = pipeline->next_read;
+        size_t count = pipeline->next_submit - first;
+        if (count > PIPELINE_READ_BATCH) {
+            count = PIPELINE_READ_BATCH;
+        }
+        /* The reader only waits while the cap is full, so some budget is left here. */
+        size_t budget = pipeline->config.max_bytes > 0 ? pipeline->config.max_bytes - pipeline->bytes_in_flight : 0;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        /* Queued slots belong to the reader until they are marked read. */
+        size_t pending = 0;
+        for (size_t i = 0; i < count; i++) {
+            PipelineSlot* slot = &pipeline->slots[(first + i) % pipeline->slot_count];
+            if (!slot->file->data) {
+                batch[pending] = slot->file;
+                positions[pending++] = i;
+            }
+        }
+        ReadBackend used = READ_BACKEND_SYNC;
+        if (pending > 0) {
+            /* The ring is set up on the first batch that needs one and reused for the rest. */
+            if (pipeline->config.backend != READ_BACKEND_SYNC && !pipeline->uring_tried) {
+                pipeline->uring = uring_reader_create();
+                pipeline->uring_tried = 1;
+            }
+            used = file_read_batch(batch, pending, pipeline->uring, budget, statuses, errors);
+        }
+        /* Files left unread for the byte cap stay queued, and the batch ends before the first of them. */
+        for (size_t j = 0; j < pending; j++) {
+            if (statuses[j] == READ_DEFERRED) {
+                count = positions[j];
+                break;
+            }
+            PipelineSlot* slot = &pipeline->slots[(first + positions[j]) % pipeline->slot_count];
+            slot->status = statuses[j];
+            slot->error = errors[j];
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        if (used == READ_BACKEND_URING) {
+            pipeline->backend_used = READ_BACKEND_URING;
+        }
+        for (size_t i = 0; i < count; i++) {
+            PipelineSlot* slot = &pipeline->slots[(first + i) % pipeline->slot_count];
+            slot->bytes = slot->status == READ_SUCCESS ? slot->file->size : 0;
+            slot->state = SLOT_READ;
+            pipeline->bytes_in_flight += slot->bytes;
+        }
+        if (pipeline->bytes_in_flight > pipeline->peak_bytes) {
+            pipeline->peak_bytes = pipeline->bytes_in_flight;
+        }
+        pipeline->next_read += count;
+        pthread_cond_broadcast(&pipeline->readable);
+    }
+    pipeline->reading_done = 1;
+    pthread_cond_broadcast(&pipeline->readable);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+static void* pipeline_worker(void* arg) {
+    FilePipeline* pipeline = (FilePipeline*)arg;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    for (;;) {
+        while (!pipeline->stop && !pipeline->reading_done && pipeline->next_search == pipeline->next_read) {
+            pthread_cond_wait(&pipeline->readable, &pipeline->mutex);
+        }
+        if (pipeline->stop || pipeline->next_search == pipeline->next_read) break;
+
+        PipelineSlot* slot = &pipeline->slots[pipeline->next_search++ % pipeline->slot_count];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        pipeline_search_slot(pipeline, slot);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        slot->state = SLOT_DONE;
+        if (pipeline_cancelled(pipeline)) {
+            pipeline_wake_all(pipeline);
+        }
+        pipeline_drain(pipeline);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+/*
+ * Starts the reader and config->num_threads search workers. Files are
+ * then handed in with file_pipeline_submit() and the callback sees them
+ * in that order. Returns NULL if no thread could be started.
+ */
+FilePipeline* file_pipeline_create(const Pattern* pattern, const SearchOptions* options, const PipelineConfig* config,
+                                   PipelineCallback callback, void* userdata) {
+    if (!pattern || !options || !config) return NULL;
+
+    FilePipeline* pipeline = (FilePipeline*)calloc(1, sizeof(FilePipeline));
+    if (!pipeline) return NULL;
+
+    pipeline->pattern = pattern;
+    pipeline->options = options;
+    pipeline->config = *config;
+    pipeline->callback = callback;
+    pipeline->userdata = userdata;
+    pipeline->backend_used = READ_BACKEND_SYNC;
+    pipeline->slot_count = config->max_files > 0 ? config->max_files : PIPELINE_MAX_FILES;
+    size_t num_threads = config->num_threads > 0 ? config->num_threads : 1;
+
+    pipeline->slots = (PipelineSlot*)calloc(pipeline->slot_count, sizeof(PipelineSlot));
+    pipeline->workers = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+    if (!pipeline->slots || !pipeline->workers) {
+        free(pipeline->slots);
+        free(pipeline->workers);
+        free(pipeline);
+        return NULL;
+    }
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->queued, NULL);
+    pthread_cond_init(&pipeline->readable, NULL);
+    pthread_cond_init(&pipeline->space, NULL);
+
+    pipeline->reader_started = pthread_create(&pipeline->reader, NULL, pipeline_reader, pipeline) == 0;
+    while (pipeline->reader_started && pipeline->worker_count < num_threads &&
+           pthread_create(&pipeline->workers[pipeline->worker_count], NULL, pipeline_worker, pipeline) == 0) {
+        pipeline->worker_count++;
+    }
+    if (!pipeline->reader_started || pipeline->worker_count == 0) {
+        pipeline->stop = 1;
+        file_pipeline_finish(pipeline);
+        file_pipeline_free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+/*
+ * Queues an opened file, waiting while max_files are in flight; several
+ * threads may submit at once. The pipeline owns the file from here on,
+ * even when it has stopped and this returns 0.
+ */
+int file_pipeline_submit(FilePipeline* pipeline, FileData* file, int named) {
+    if (!pipeline || !file) return 0;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    /* Walker threads submit concurrently, so the slot is only settled once it is free. */
+    PipelineSlot* slot = &pipeline->slots[pipeline->next_submit % pipeline->slot_count];
+    while (!pipeline->stop && !pipeline_cancelled(pipeline) && slot->state != SLOT_FREE) {
+        pipeline->submit_waiting++;
+        pthread_cond_wait(&pipeline->space, &pipeline->mutex);
+        pipeline->submit_waiting--;
+        slot = &pipeline->slots[pipeline->next_submit % pipeline->slot_count];
+    }
+    if (pipeline->stop || pipeline_cancelled(pipeline)) {
+        pthread_mutex_unlock(&pipeline->mutex);
+        file_close(file);
+        return 0;
+    }
+
+    slot->file = file;
+    slot->matches = NULL;
+    slot->status = READ_SUCCESS;
+    slot->error = 0;
+    slot->named = named;
+    slot->bytes = 0;
+    slot->state = SLOT_QUEUED;
+    pipeline->next_submit++;
+    if (pipeline->next_submit - pipeline->next_output > pipeline->peak_files) {
+        pipeline->peak_files = pipeline->next_submit - pipeline->next_output;
+    }
+    size_t unread = pipeline->next_submit - pipeline->next_read;
+    if (pipeline->reader_waiting && (unread == 1 || unread == PIPELINE_READ_MIN)) {
+        pthread_cond_signal(&pipeline->queued);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return 1;
+}
+
+/* No more files: waits until everything submitted is reported, or the pipeline stopped. */
+void file_pipeline_finish(FilePipeline* pipeline) {
+    if (!pipeline) return;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->finished = 1;
+    pthread_cond_signal(&pipeline->queued);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    if (pipeline->reader_started) {
+        pthread_join(pipeline->reader, NULL);
+        pipeline->reader_started = 0;
+    }
+    for (size_t i = 0; i < pipeline->worker_count; i++) {
+        pthread_join(pipeline->workers[i], NULL);
+    }
+    pipeline->worker_count = 0;
+}
+
+/* Call after file_pipeline_finish(); closes whatever a stop left unreported. */
+void file_pipeline_free(FilePipeline* pipeline) {
+    if (!pipeline) return;
+
+    for (size_t i = 0; i < pipeline->slot_count; i++) {
+        file_close(pipeline->slots[i].file);
+        matchlist_free(pipeline->slots[i].matches);
+    }
+    uring_reader_free(pipeline->uring);
+    free(pipeline->slots);
+    free(pipeline->workers);
+    pthread_cond_destroy(&pipeline->queued);
+    pthread_cond_destroy(&pipeline->readable);
+    pthread_cond_destroy(&pipeline->space);
+    pthread_mutex_destroy(&pipeline->mutex);
+    free(pipeline);
+}
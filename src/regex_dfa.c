@@ -0,0 +1,1354 @@
+#include "../include/regex_dfa.h"
+#include "../include/regex_jit.h"
+#include "../include/line_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define DFA_CACHE_SET_BUDGET (1u << 22)
+#define DFA_MIN_BYTES_PER_FLUSH (16 * DFA_CACHE_STATES)
+
+#define DFA_GAVE_UP (-2)
+
+struct DFACache {
+    size_t capacity;
+    size_t count;
+    size_t class_count;
+    int32_t* trans;
+    unsigned char* flags;
+    unsigned char* anchored;
+    unsigned char* bol;
+    size_t* set_offset;
+    size_t* set_len;
+
+    int* set_data;
+    size_t set_used;
+    size_t set_capacity;
+
+    int* table;
+    size_t table_mask;
+
+    int start[2][2];
+
+    int* scratch;
+    int* scratch_eol;
+    int* stack;
+    unsigned* mark;
+    unsigned generation;
+
+    size_t bytes_since_flush;
+    int give_up;
+    unsigned epoch;
+
+    /* Match starts of one line, marked by a backward pass of the reverse automaton on its own cache. */
+    DFACache* reverse;
+    unsigned char* starts;
+    size_t starts_capacity;
+    const char* starts_data;
+    size_t starts_from;
+    size_t starts_end;
+};
+
+/* ---------------------------------------------------------------------- */
+/* Parser: POSIX ERE subset -> RegexNode tree                             */
+/* ---------------------------------------------------------------------- */
+
+typedef struct {
+    const char* p;
+    int case_insensitive;
+    RegexDFA* dfa;
+    size_t node_capacity;
+    size_t set_capacity;
+    int depth;
+    int failed;
+} Parser;
+
+static int new_node(Parser* ps, RegexNodeType type) {
+    RegexDFA* dfa = ps->dfa;
+    if (dfa->node_count >= ps->node_capacity) {
+        size_t new_capacity = ps->node_capacity == 0 ? 64 : ps->node_capacity * 2;
+        RegexNode* new_nodes = (RegexNode*)realloc(dfa->nodes, sizeof(RegexNode) * new_capacity);
+        if (!new_nodes) {
+            ps->failed = 1;
+            return -1;
+        }
+        dfa->nodes = new_nodes;
+        ps->node_capacity = new_capacity;
+    }
+
+    RegexNode* node = &dfa->nodes[dfa->node_count];
+    node->type = type;
+    node->set = -1;
+    node->literal = -1;
+    node->min = 0;
+    node->max = 0;
+    node->left = -1;
+    node->right = -1;
+    return (int)dfa->node_count++;
+}
+
+static int new_set(Parser* ps) {
+    RegexDFA* dfa = ps->dfa;
+    if (dfa->set_count >= ps->set_capacity) {
+        size_t new_capacity = ps->set_capacity == 0 ? 32 : ps->set_capacity * 2;
+        uint64_t (*new_sets)[4] = (uint64_t (*)[4])realloc(dfa->sets, sizeof(uint64_t[4]) * new_capacity);
+        if (!new_sets) {
+            ps->failed = 1;
+            return -1;
+        }
+        dfa->sets = new_sets;
+        ps->set_capacity = new_capacity;
+    }
+
+    memset(dfa->sets[dfa->set_count], 0, sizeof(uint64_t[4]));
+    return (int)dfa->set_count++;
+}
+
+static inline void set_add(uint64_t* set, unsigned char c) {
+    set[c >> 6] |= 1ULL << (c & 63);
+}
+
+static inline int set_has(const uint64_t* set, unsigned char c) {
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+static void set_fold_case(uint64_t* set) {
+    for (int c = 'a'; c <= 'z'; c++) {
+        if (set_has(set, (unsigned char)c) || set_has(set, (unsigned char)(c - 0x20))) {
+            set_add(set, (unsigned char)c);
+            set_add(set, (unsigned char)(c - 0x20));
+        }
+    }
+}
+
+static int set_node(Parser* ps, int set) {
+    int node = new_node(ps, RNODE_SET);
+    if (node < 0) return -1;
+    ps->dfa->nodes[node].set = set;
+    return node;
+}
+
+static int literal_node(Parser* ps, unsigned char c) {
+    int set = new_set(ps);
+    if (set < 0) return -1;
+
+    set_add(ps->dfa->sets[set], c);
+    if (ps->case_insensitive) {
+        set_fold_case(ps->dfa->sets[set]);
+    }
+
+    int node = set_node(ps, set);
+    if (node < 0) return -1;
+    ps->dfa->nodes[node].literal = c;
+    return node;
+}
+
+static int class_matches(const char* name, size_t len, int c) {
+    static const struct {
+        const char* name;
+        int (*fn)(int);
+    } classes[] = {
+        {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum}, {"upper", isupper},
+        {"lower", islower}, {"space", isspace}, {"blank", isblank}, {"punct", ispunct},
+        {"print", isprint}, {"graph", isgraph}, {"cntrl", iscntrl}, {"xdigit", isxdigit}
+    };
+
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0) {
+            return c < 128 && classes[i].fn(c) ? 1 : 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_bracket(Parser* ps) {
+    int set = new_set(ps);
+    if (set < 0) return -1;
+    uint64_t* bits = ps->dfa->sets[set];
+
+    int negate = 0;
+    if (*ps->p == '^') {
+        negate = 1;
+        ps->p++;
+    }
+
+    int first = 1;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = 0;
+
+        if (ps->p[0] == '[' && (ps->p[1] == '=' || ps->p[1] == '.')) {
+            ps->failed = 1;
+            return -1;
+        }
+
+        if (ps->p[0] == '[' && ps->p[1] == ':') {
+            const char* name = ps->p + 2;
+            const char* close = strstr(name, ":]");
+            if (!close) {
+                ps->failed = 1;
+                return -1;
+            }
+            for (int c = 0; c < 256; c++) {
+                int r = class_matches(name, (size_t)(close - name), c);
+                if (r < 0) {
+                    ps->failed = 1;
+                    return -1;
+                }
+                if (r) set_add(bits, (unsigned char)c);
+            }
+            ps->p = close + 2;
+            continue;
+        }
+
+        unsigned char lo = (unsigned char)*ps->p++;
+        if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']') {
+            if (ps->p[1] == '[') {
+                ps->failed = 1;
+                return -1;
+            }
+            unsigned char hi = (unsigned char)ps->p[1];
+            ps->p += 2;
+            if (hi < lo) {
+                ps->failed = 1;
+                return -1;
+            }
+            for (int c = lo; c <= hi; c++) {
+                set_add(bits, (unsigned char)c);
+            }
+        } else {
+            set_add(bits, lo);
+        }
+    }
+
+    if (*ps->p != ']') {
+        ps->failed = 1;
+        return -1;
+    }
+    ps->p++;
+
+    if (ps->case_insensitive) {
+        set_fold_case(bits);
+    }
+
+    if (negate) {
+        for (int i = 0; i < 4; i++) {
+            bits[i] = ~bits[i];
+        }
+    }
+    bits['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+
+    return set_node(ps, set);
+}
+
+static int parse_alternation(Parser* ps);
+
+static int parse_escape(Parser* ps) {
+    unsigned char c = (unsigned char)*ps->p;
+    if (c == '\0') {
+        ps->failed = 1;
+        return -1;
+    }
+    ps->p++;
+
+    if (c == 'w' || c == 'W' || c == 's' || c == 'S') {
+        int set = new_set(ps);
+        if (set < 0) return -1;
+        uint64_t* bits = ps->dfa->sets[set];
+        for (int b = 0; b < 256; b++) {
+            int in = (c == 'w' || c == 'W') ? (b < 128 && (isalnum(b) || b == '_')) : (b < 128 && isspace(b));
+            if (in) set_add(bits, (unsigned char)b);
+        }
+        if (c == 'W' || c == 'S') {
+            for (int i = 0; i < 4; i++) {
+                bits[i] = ~bits[i];
+            }
+        }
+        bits['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+        return set_node(ps, set);
+    }
+
+    /* Word boundaries, buffer anchors and back-references stay with regexec. */
+    if (isalnum(c) || c == '<' || c == '>' || c == '`' || c == '\'') {
+        ps->failed = 1;
+        return -1;
+    }
+
+    return literal_node(ps, c);
+}
+
+static int parse_atom(Parser* ps) {
+    char c = *ps->p;
+
+    switch (c) {
+        case '(': {
+            ps->p++;
+            if (++ps->depth > 256) {
+                ps->failed = 1;
+                return -1;
+            }
+            int inner = parse_alternation(ps);
+            ps->depth--;
+            if (inner < 0 || *ps->p != ')') {
+                ps->failed = 1;
+                return -1;
+            }
+            ps->p++;
+            return inner;
+        }
+        case '.': {
+            ps->p++;
+            int set = new_set(ps);
+            if (set < 0) return -1;
+            memset(ps->dfa->sets[set], 0xFF, sizeof(uint64_t[4]));
+            ps->dfa->sets[set]['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+            return set_node(ps, set);
+        }
+        case '[':
+            ps->p++;
+            return parse_bracket(ps);
+        case '^':
+            ps->p++;
+            return new_node(ps, RNODE_BOL);
+        case '$':
+            ps->p++;
+            return new_node(ps, RNODE_EOL);
+        case '\\':
+            ps->p++;
+            return parse_escape(ps);
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+        case ')':
+            ps->failed = 1;
+            return -1;
+        default:
+            ps->p++;
+            return literal_node(ps, (unsigned char)c);
+    }
+}
+
+static int parse_number(Parser* ps, int* out) {
+    if (!isdigit((unsigned char)*ps->p)) return 0;
+
+    int value = 0;
+    while (isdigit((unsigned char)*ps->p)) {
+        value = value * 10 + (*ps->p - '0');
+        if (value > DFA_MAX_REPEAT) return 0;
+        ps->p++;
+    }
+    *out = value;
+    return 1;
+}
+
+static int parse_repeat(Parser* ps) {
+    int atom = parse_atom(ps);
+    if (atom < 0) return -1;
+
+    for (;;) {
+        int min, max;
+        char c = *ps->p;
+
+        if (c == '*') {
+            min = 0;
+            max = -1;
+            ps->p++;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+            ps->p++;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+            ps->p++;
+        } else if (c == '{') {
+            ps->p++;
+            if (!parse_number(ps, &min)) {
+                ps->failed = 1;
+                return -1;
+            }
+            max = min;
+            if (*ps->p == ',') {
+                ps->p++;
+                max = -1;
+                if (*ps->p != '}' && (!parse_number(ps, &max) || max < min)) {
+                    ps->failed = 1;
+                    return -1;
+                }
+            }
+            if (*ps->p != '}') {
+                ps->failed = 1;
+                return -1;
+            }
+            ps->p++;
+        } else {
+            return atom;
+        }
+
+        RegexNodeType type = ps->dfa->nodes[atom].type;
+        if (type == RNODE_BOL || type == RNODE_EOL) {
+            ps->failed = 1;
+            return -1;
+        }
+
+        int node = new_node(ps, RNODE_REPEAT);
+        if (node < 0) return -1;
+        ps->dfa->nodes[node].min = min;
+        ps->dfa->nodes[node].max = max;
+        ps->dfa->nodes[node].left = atom;
+        atom = node;
+    }
+}
+
+static int parse_concat(Parser* ps) {
+    if (*ps->p == '\0' || *ps->p == '|' || *ps->p == ')') {
+        return new_node(ps, RNODE_EMPTY);
+    }
+
+    int left = parse_repeat(ps);
+    while (left >= 0 && *ps->p && *ps->p != '|' && *ps->p != ')') {
+        int right = parse_repeat(ps);
+        if (right < 0) return -1;
+
+        int node = new_node(ps, RNODE_CONCAT);
+        if (node < 0) return -1;
+        ps->dfa->nodes[node].left = left;
+        ps->dfa->nodes[node].right = right;
+        left = node;
+    }
+    return left;
+}
+
+static int parse_alternation(Parser* ps) {
+    int left = parse_concat(ps);
+    while (left >= 0 && *ps->p == '|') {
+        ps->p++;
+        int right = parse_concat(ps);
+        if (right < 0) return -1;
+
+        int node = new_node(ps, RNODE_ALT);
+        if (node < 0) return -1;
+        ps->dfa->nodes[node].left = left;
+        ps->dfa->nodes[node].right = right;
+        left = node;
+    }
+    return left;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Thompson construction: every fragment exits through an epsilon state   */
+/* whose out is patched by the caller.                                    */
+/* ---------------------------------------------------------------------- */
+
+typedef struct {
+    RegexDFA* dfa;
+    /* Nodes come from source; reverse builds the automaton for the pattern read backwards. */
+    const RegexDFA* source;
+    int reverse;
+    size_t capacity;
+    int failed;
+} Builder;
+
+static int nfa_add(Builder* b, NFAStateType type, int set, int out, int out1) {
+    RegexDFA* dfa = b->dfa;
+    if (dfa->nfa_count >= DFA_MAX_NFA_STATES) {
+        b->failed = 1;
+        return -1;
+    }
+
+    if (dfa->nfa_count >= b->capacity) {
+        size_t new_capacity = b->capacity == 0 ? 128 : b->capacity * 2;
+        NFAState* new_nfa = (NFAState*)realloc(dfa->nfa, sizeof(NFAState) * new_capacity);
+        if (!new_nfa) {
+            b->failed = 1;
+            return -1;
+        }
+        dfa->nfa = new_nfa;
+        b->capacity = new_capacity;
+    }
+
+    NFAState* state = &dfa->nfa[dfa->nfa_count];
+    state->type = type;
+    state->set = set;
+    state->out = out;
+    state->out1 = out1;
+    return (int)dfa->nfa_count++;
+}
+
+static int nfa_compile(Builder* b, int node_index, int* exit) {
+    if (b->failed) return -1;
+
+    const RegexNode node = b->source->nodes[node_index];
+    int entry;
+
+    switch (node.type) {
+        case RNODE_EMPTY:
+            entry = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+            *exit = entry;
+            return entry;
+
+        case RNODE_SET:
+        case RNODE_BOL:
+        case RNODE_EOL: {
+            *exit = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+            int bol = (node.type == RNODE_BOL) != b->reverse;
+            NFAStateType type = node.type == RNODE_SET ? NFA_SET : (bol ? NFA_BOL : NFA_EOL);
+            return nfa_add(b, type, node.set, *exit, -1);
+        }
+
+        case RNODE_CONCAT: {
+            int first_exit, second_exit;
+            entry = nfa_compile(b, b->reverse ? node.right : node.left, &first_exit);
+            int second = nfa_compile(b, b->reverse ? node.left : node.right, &second_exit);
+            if (b->failed) return -1;
+            b->dfa->nfa[first_exit].out = second;
+            *exit = second_exit;
+            return entry;
+        }
+
+        case RNODE_ALT: {
+            int left_exit, right_exit;
+            int left = nfa_compile(b, node.left, &left_exit);
+            int right = nfa_compile(b, node.right, &right_exit);
+            *exit = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+            entry = nfa_add(b, NFA_SPLIT, -1, left, right);
+            if (b->failed) return -1;
+            b->dfa->nfa[left_exit].out = *exit;
+            b->dfa->nfa[right_exit].out = *exit;
+            return entry;
+        }
+
+        case RNODE_REPEAT: {
+            entry = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+            int tail = entry;
+
+            for (int i = 0; i < node.min; i++) {
+                int copy_exit;
+                int copy = nfa_compile(b, node.left, &copy_exit);
+                if (b->failed) return -1;
+                b->dfa->nfa[tail].out = copy;
+                tail = copy_exit;
+            }
+
+            if (node.max < 0) {
+                int copy_exit;
+                int copy = nfa_compile(b, node.left, &copy_exit);
+                *exit = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+                int loop = nfa_add(b, NFA_SPLIT, -1, copy, *exit);
+                if (b->failed) return -1;
+                b->dfa->nfa[tail].out = loop;
+                b->dfa->nfa[copy_exit].out = loop;
+                return entry;
+            }
+
+            *exit = nfa_add(b, NFA_EPSILON, -1, -1, -1);
+            for (int i = node.min; i < node.max; i++) {
+                int copy_exit;
+                int copy = nfa_compile(b, node.left, &copy_exit);
+                int split = nfa_add(b, NFA_SPLIT, -1, copy, *exit);
+                if (b->failed) return -1;
+                b->dfa->nfa[tail].out = split;
+                tail = copy_exit;
+            }
+            if (b->failed) return -1;
+            b->dfa->nfa[tail].out = *exit;
+            return entry;
+        }
+    }
+
+    b->failed = 1;
+    return -1;
+}
+
+static void build_byte_classes(RegexDFA* dfa) {
+    unsigned char cls[256];
+    memset(cls, 0, sizeof(cls));
+    size_t count = 1;
+
+    for (size_t s = 0; s <= dfa->set_count; s++) {
+        int remap[256][2];
+        for (size_t i = 0; i < count; i++) {
+            remap[i][0] = remap[i][1] = -1;
+        }
+
+        size_t new_count = 0;
+        for (int c = 0; c < 256; c++) {
+            int in = s < dfa->set_count ? set_has(dfa->sets[s], (unsigned char)c) : c == '\n';
+            if (remap[cls[c]][in] < 0) {
+                remap[cls[c]][in] = (int)new_count++;
+            }
+            cls[c] = (unsigned char)remap[cls[c]][in];
+        }
+        count = new_count;
+    }
+
+    memcpy(dfa->byte_class, cls, sizeof(cls));
+    dfa->class_count = count;
+    for (int c = 255; c >= 0; c--) {
+        dfa->class_rep[cls[c]] = (unsigned char)c;
+    }
+}
+
+/* Thompson-compiles source's tree into dfa, forwards or reversed; the reverse borrows source's sets and classes. */
+static int build_nfa(RegexDFA* dfa, const RegexDFA* source, int reverse) {
+    if (dfa != source) {
+        dfa->set_count = source->set_count;
+        dfa->sets = (uint64_t(*)[4])malloc(sizeof(uint64_t[4]) * (source->set_count > 0 ? source->set_count : 1));
+        if (!dfa->sets) return 0;
+        if (source->set_count > 0) {
+            memcpy(dfa->sets, source->sets, sizeof(uint64_t[4]) * source->set_count);
+        }
+        memcpy(dfa->byte_class, source->byte_class, sizeof(dfa->byte_class));
+        memcpy(dfa->class_rep, source->class_rep, sizeof(dfa->class_rep));
+        dfa->class_count = source->class_count;
+    }
+
+    Builder b;
+    b.dfa = dfa;
+    b.source = source;
+    b.reverse = reverse;
+    b.capacity = 0;
+    b.failed = 0;
+
+    int exit;
+    int entry = nfa_compile(&b, source->root, &exit);
+    int match = nfa_add(&b, NFA_MATCH, -1, -1, -1);
+    if (b.failed) return 0;
+    dfa->nfa[exit].out = match;
+    dfa->nfa_start = entry;
+    return 1;
+}
+
+RegexDFA* regex_dfa_compile(const char* pattern, int case_insensitive) {
+    if (!pattern) return NULL;
+
+    RegexDFA* dfa = (RegexDFA*)calloc(1, sizeof(RegexDFA));
+    if (!dfa) return NULL;
+
+    if (pthread_mutex_init(&dfa->pool_mutex, NULL) != 0) {
+        free(dfa);
+        return NULL;
+    }
+
+    Parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.p = pattern;
+    ps.case_insensitive = case_insensitive;
+    ps.dfa = dfa;
+
+    dfa->root = parse_alternation(&ps);
+    if (ps.failed || dfa->root < 0 || *ps.p != '\0') {
+        regex_dfa_free(dfa);
+        return NULL;
+    }
+
+    build_byte_classes(dfa);
+    dfa->reverse = (RegexDFA*)calloc(1, sizeof(RegexDFA));
+    if (!dfa->reverse || pthread_mutex_init(&dfa->reverse->pool_mutex, NULL) != 0) {
+        free(dfa->reverse);
+        dfa->reverse = NULL;
+        regex_dfa_free(dfa);
+        return NULL;
+    }
+    dfa->reverse->root = -1;
+    if (!build_nfa(dfa, dfa, 0) || !build_nfa(dfa->reverse, dfa, 1)) {
+        regex_dfa_free(dfa);
+        return NULL;
+    }
+
+    return dfa;
+}
+
+typedef struct {
+    char run[DFA_MAX_LITERAL];
+    size_t run_len;
+    char best[DFA_MAX_LITERAL];
+    size_t best_len;
+} LiteralScan;
+
+static void literal_commit(LiteralScan* scan) {
+    if (scan->run_len > scan->best_len) {
+        memcpy(scan->best, scan->run, scan->run_len);
+        scan->best_len = scan->run_len;
+    }
+    scan->run_len = 0;
+}
+
+static void literal_visit(const RegexDFA* dfa, int node_index, LiteralScan* scan) {
+    const RegexNode* node = &dfa->nodes[node_index];
+
+    switch (node->type) {
+        case RNODE_SET:
+            if (node->literal < 0) {
+                literal_commit(scan);
+            } else {
+                if (scan->run_len == DFA_MAX_LITERAL) {
+                    literal_commit(scan);
+                }
+                scan->run[scan->run_len++] = (char)node->literal;
+            }
+            break;
+        case RNODE_CONCAT:
+            literal_visit(dfa, node->left, scan);
+            literal_visit(dfa, node->right, scan);
+            break;
+        case RNODE_REPEAT:
+            literal_commit(scan);
+            if (node->min > 0) {
+                literal_visit(dfa, node->left, scan);
+                literal_commit(scan);
+            }
+            break;
+        default:
+            literal_commit(scan);
+            break;
+    }
+}
+
+/*
+ * Returns the longest run of literal bytes that every match must contain,
+ * or NULL if there is none. Alternations and optional parts break runs;
+ * a repeat with min >= 1 contributes its body's own best run.
+ */
+char* regex_dfa_required_literal(const RegexDFA* dfa) {
+    if (!dfa || dfa->root < 0) return NULL;
+
+    LiteralScan scan;
+    scan.run_len = 0;
+    scan.best_len = 0;
+    literal_visit(dfa, dfa->root, &scan);
+    literal_commit(&scan);
+
+    if (scan.best_len == 0) return NULL;
+
+    char* literal = (char*)malloc(scan.best_len + 1);
+    if (!literal) return NULL;
+    memcpy(literal, scan.best, scan.best_len);
+    literal[scan.best_len] = '\0';
+    return literal;
+}
+
+static void dfa_cache_free(DFACache* cache) {
+    if (!cache) return;
+
+    free(cache->trans);
+    free(cache->flags);
+    free(cache->anchored);
+    free(cache->bol);
+    free(cache->set_offset);
+    free(cache->set_len);
+    free(cache->set_data);
+    free(cache->table);
+    free(cache->scratch);
+    free(cache->scratch_eol);
+    free(cache->stack);
+    free(cache->mark);
+    dfa_cache_free(cache->reverse);
+    free(cache->starts);
+    free(cache);
+}
+
+void regex_dfa_free(RegexDFA* dfa) {
+    if (!dfa) return;
+
+    for (size_t i = 0; i < dfa->pool_count; i++) {
+        dfa_cache_free(dfa->pool[i]);
+    }
+    free(dfa->pool);
+    free(dfa->nodes);
+    free(dfa->sets);
+    free(dfa->nfa);
+    regex_jit_free(dfa->jit);
+    regex_dfa_free(dfa->reverse);
+    pthread_mutex_destroy(&dfa->pool_mutex);
+    free(dfa);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Lazy DFA cache                                                         */
+/* ---------------------------------------------------------------------- */
+
+static void dfa_cache_flush(DFACache* cache) {
+    if (cache->bytes_since_flush < DFA_MIN_BYTES_PER_FLUSH) {
+        cache->give_up = 1;
+    }
+
+    cache->count = 0;
+    cache->set_used = 0;
+    cache->bytes_since_flush = 0;
+    cache->epoch++;
+    memset(cache->table, 0, sizeof(int) * (cache->table_mask + 1));
+    cache->start[0][0] = cache->start[0][1] = -1;
+    cache->start[1][0] = cache->start[1][1] = -1;
+}
+
+static DFACache* dfa_cache_create(const RegexDFA* dfa) {
+    DFACache* cache = (DFACache*)calloc(1, sizeof(DFACache));
+    if (!cache) return NULL;
+
+    size_t capacity = DFA_CACHE_STATES;
+    cache->capacity = capacity;
+    cache->class_count = dfa->class_count;
+    cache->table_mask = capacity * 2 - 1;
+    cache->set_capacity = 4096;
+
+    cache->trans = (int32_t*)malloc(sizeof(int32_t) * capacity * dfa->class_count);
+    cache->flags = (unsigned char*)malloc(capacity);
+    cache->anchored = (unsigned char*)malloc(capacity);
+    cache->bol = (unsigned char*)malloc(capacity);
+    cache->set_offset = (size_t*)malloc(sizeof(size_t) * capacity);
+    cache->set_len = (size_t*)malloc(sizeof(size_t) * capacity);
+    cache->set_data = (int*)malloc(sizeof(int) * cache->set_capacity);
+    cache->table = (int*)malloc(sizeof(int) * (cache->table_mask + 1));
+    cache->scratch = (int*)malloc(sizeof(int) * dfa->nfa_count);
+    cache->scratch_eol = (int*)malloc(sizeof(int) * dfa->nfa_count);
+    cache->stack = (int*)malloc(sizeof(int) * dfa->nfa_count);
+    cache->mark = (unsigned*)calloc(dfa->nfa_count, sizeof(unsigned));
+
+    if (!cache->trans || !cache->flags || !cache->anchored || !cache->bol || !cache->set_offset ||
+        !cache->set_len || !cache->set_data || !cache->table || !cache->scratch || !cache->scratch_eol ||
+        !cache->stack || !cache->mark) {
+        dfa_cache_free(cache);
+        return NULL;
+    }
+
+    cache->bytes_since_flush = DFA_MIN_BYTES_PER_FLUSH;
+    dfa_cache_flush(cache);
+    return cache;
+}
+
+DFACache* regex_dfa_acquire(RegexDFA* dfa) {
+    if (!dfa) return NULL;
+
+    DFACache* cache = NULL;
+    pthread_mutex_lock(&dfa->pool_mutex);
+    if (dfa->pool_count > 0) {
+        cache = dfa->pool[--dfa->pool_count];
+    }
+    pthread_mutex_unlock(&dfa->pool_mutex);
+
+    if (!cache) {
+        cache = dfa_cache_create(dfa);
+    }
+
+    if (cache) {
+        cache->give_up = 0;
+        cache->starts_data = NULL;
+        if (cache->reverse) {
+            cache->reverse->give_up = 0;
+        }
+    }
+    return cache;
+}
+
+void regex_dfa_release(RegexDFA* dfa, DFACache* cache) {
+    if (!dfa || !cache) return;
+
+    pthread_mutex_lock(&dfa->pool_mutex);
+    if (dfa->pool_count >= dfa->pool_capacity) {
+        size_t new_capacity = dfa->pool_capacity == 0 ? 4 : dfa->pool_capacity * 2;
+        DFACache** new_pool = (DFACache**)realloc(dfa->pool, sizeof(DFACache*) * new_capacity);
+        if (!new_pool) {
+            pthread_mutex_unlock(&dfa->pool_mutex);
+            dfa_cache_free(cache);
+            return;
+        }
+        dfa->pool = new_pool;
+        dfa->pool_capacity = new_capacity;
+    }
+    dfa->pool[dfa->pool_count++] = cache;
+    pthread_mutex_unlock(&dfa->pool_mutex);
+}
+
+/* Adds the epsilon closure of start to out; consuming, MATCH and pending EOL states are kept. */
+static void add_closure(const RegexDFA* dfa, DFACache* cache, int start, int bol, int allow_eol,
+                        int* out, size_t* n) {
+    size_t top = 0;
+    if (cache->mark[start] == cache->generation) return;
+    cache->mark[start] = cache->generation;
+    cache->stack[top++] = start;
+
+    while (top > 0) {
+        int id = cache->stack[--top];
+        const NFAState* state = &dfa->nfa[id];
+        int next[2] = {-1, -1};
+
+        switch (state->type) {
+            case NFA_SET:
+            case NFA_MATCH:
+                out[(*n)++] = id;
+                break;
+            case NFA_EOL:
+                if (allow_eol) {
+                    next[0] = state->out;
+                } else {
+                    out[(*n)++] = id;
+                }
+                break;
+            case NFA_BOL:
+                if (bol) next[0] = state->out;
+                break;
+            case NFA_EPSILON:
+                next[0] = state->out;
+                break;
+            case NFA_SPLIT:
+                next[0] = state->out;
+                next[1] = state->out1;
+                break;
+        }
+
+        for (int i = 0; i < 2; i++) {
+            if (next[i] >= 0 && cache->mark[next[i]] != cache->generation) {
+                cache->mark[next[i]] = cache->generation;
+                cache->stack[top++] = next[i];
+            }
+        }
+    }
+}
+
+static void sort_ids(int* ids, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        int id = ids[i];
+        size_t j = i;
+        while (j > 0 && ids[j - 1] > id) {
+            ids[j] = ids[j - 1];
+            j--;
+        }
+        ids[j] = id;
+    }
+}
+
+static size_t hash_set(const int* ids, size_t n, int anchored, int bol) {
+    size_t h = 2166136261u ^ (size_t)(anchored * 2 + bol);
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (size_t)ids[i]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned char state_flags(const RegexDFA* dfa, DFACache* cache, const int* ids, size_t n, int bol) {
+    unsigned char flags = 0;
+    if (n == 0) return DFA_FLAG_DEAD;
+
+    for (size_t i = 0; i < n; i++) {
+        if (dfa->nfa[ids[i]].type == NFA_MATCH) {
+            return DFA_FLAG_ACCEPT | DFA_FLAG_ACCEPT_EOL;
+        }
+    }
+
+    cache->generation++;
+    size_t eol_n = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (dfa->nfa[ids[i]].type == NFA_EOL) {
+            add_closure(dfa, cache, dfa->nfa[ids[i]].out, bol, 1, cache->scratch_eol, &eol_n);
+        }
+    }
+    for (size_t i = 0; i < eol_n; i++) {
+        if (dfa->nfa[cache->scratch_eol[i]].type == NFA_MATCH) {
+            flags |= DFA_FLAG_ACCEPT_EOL;
+            break;
+        }
+    }
+    return flags;
+}
+
+/* Returns the state id for the set in cache->scratch, creating it (and flushing if full). */
+static int intern_state(const RegexDFA* dfa, DFACache* cache, size_t n, int anchored, int bol) {
+    int* ids = cache->scratch;
+    sort_ids(ids, n);
+
+    size_t h = hash_set(ids, n, anchored, bol);
+    for (size_t slot = h & cache->table_mask;; slot = (slot + 1) & cache->table_mask) {
+        int entry = cache->table[slot];
+        if (entry == 0) break;
+
+        int id = entry - 1;
+        if (cache->set_len[id] == n && cache->anchored[id] == anchored && cache->bol[id] == bol &&
+            memcmp(cache->set_data + cache->set_offset[id], ids, sizeof(int) * n) == 0) {
+            return id;
+        }
+    }
+
+    if (cache->count >= cache->capacity) {
+        dfa_cache_flush(cache);
+    }
+
+    if (cache->set_used + n > cache->set_capacity) {
+        size_t new_capacity = cache->set_capacity;
+        while (cache->set_used + n > new_capacity) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > DFA_CACHE_SET_BUDGET) {
+            dfa_cache_flush(cache);
+            new_capacity = cache->set_capacity;
+            while (n > new_capacity) {
+                new_capacity *= 2;
+            }
+        }
+        if (new_capacity != cache->set_capacity) {
+            int* new_data = (int*)realloc(cache->set_data, sizeof(int) * new_capacity);
+            if (!new_data) {
+                cache->give_up = 1;
+                return -1;
+            }
+            cache->set_data = new_data;
+            cache->set_capacity = new_capacity;
+        }
+    }
+
+    int id = (int)cache->count++;
+    cache->set_offset[id] = cache->set_used;
+    cache->set_len[id] = n;
+    cache->anchored[id] = (unsigned char)anchored;
+    cache->bol[id] = (unsigned char)bol;
+    memcpy(cache->set_data + cache->set_used, ids, sizeof(int) * n);
+    cache->set_used += n;
+    cache->flags[id] = state_flags(dfa, cache, ids, n, bol);
+    for (size_t c = 0; c < cache->class_count; c++) {
+        cache->trans[(size_t)id * cache->class_count + c] = -1;
+    }
+
+    size_t slot = h & cache->table_mask;
+    while (cache->table[slot] != 0) {
+        slot = (slot + 1) & cache->table_mask;
+    }
+    cache->table[slot] = id + 1;
+
+    return id;
+}
+
+static int start_state(const RegexDFA* dfa, DFACache* cache, int anchored, int bol) {
+    if (cache->start[anchored][bol] >= 0) {
+        return cache->start[anchored][bol];
+    }
+
+    size_t n = 0;
+    cache->generation++;
+    add_closure(dfa, cache, dfa->nfa_start, bol, 0, cache->scratch, &n);
+
+    int id = intern_state(dfa, cache, n, anchored, bol);
+    if (id >= 0) {
+        cache->start[anchored][bol] = id;
+    }
+    return id;
+}
+
+static int next_state(const RegexDFA* dfa, DFACache* cache, int state, size_t cls) {
+    unsigned char byte = dfa->class_rep[cls];
+    int anchored = cache->anchored[state];
+    const int* ids = cache->set_data + cache->set_offset[state];
+    size_t len = cache->set_len[state];
+    size_t n = 0;
+
+    cache->generation++;
+    for (size_t i = 0; i < len; i++) {
+        const NFAState* nfa_state = &dfa->nfa[ids[i]];
+        if (nfa_state->type == NFA_SET && set_has(dfa->sets[nfa_state->set], byte)) {
+            add_closure(dfa, cache, nfa_state->out, 0, 0, cache->scratch, &n);
+        }
+    }
+    if (!anchored) {
+        add_closure(dfa, cache, dfa->nfa_start, 0, 0, cache->scratch, &n);
+    }
+
+    unsigned epoch = cache->epoch;
+    int id = intern_state(dfa, cache, n, anchored, 0);
+    if (id >= 0 && epoch == cache->epoch) {
+        cache->trans[(size_t)state * cache->class_count + cls] = id;
+    }
+    if (cache->give_up) return DFA_GAVE_UP;
+    return id;
+}
+
+/*
+ * Expands every state reachable from the unanchored start states into a
+ * private cache. Returns NULL when the automaton has more than max_states
+ * states; such patterns stay on the lazy DFA.
+ */
+DFATable* regex_dfa_table_create(const RegexDFA* dfa, size_t max_states) {
+    if (!dfa || max_states == 0 || max_states > DFA_CACHE_STATES) return NULL;
+
+    DFACache* cache = dfa_cache_create(dfa);
+    if (!cache) return NULL;
+
+    unsigned epoch = cache->epoch;
+    int start[2] = {start_state(dfa, cache, 0, 0), start_state(dfa, cache, 0, 1)};
+    int ok = start[0] >= 0 && start[1] >= 0;
+
+    for (size_t state = 0; ok && state < cache->count; state++) {
+        for (size_t cls = 0; cls < cache->class_count; cls++) {
+            if (cache->trans[state * cache->class_count + cls] >= 0) continue;
+            if (next_state(dfa, cache, (int)state, cls) < 0 || cache->count > max_states) {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    if (cache->epoch != epoch) ok = 0;
+
+    DFATable* table = ok ? (DFATable*)calloc(1, sizeof(DFATable)) : NULL;
+    if (table) {
+        table->state_count = cache->count;
+        table->start[0] = start[0];
+        table->start[1] = start[1];
+        table->next = (int32_t*)malloc(sizeof(int32_t) * 256 * cache->count);
+        table->flags = (unsigned char*)malloc(cache->count);
+        if (!table->next || !table->flags) {
+            regex_dfa_table_free(table);
+            table = NULL;
+        }
+    }
+
+    if (table) {
+        for (size_t state = 0; state < cache->count; state++) {
+            table->flags[state] = cache->flags[state];
+            for (size_t byte = 0; byte < 256; byte++) {
+                table->next[state * 256 + byte] = cache->trans[state * cache->class_count + dfa->byte_class[byte]];
+            }
+        }
+    }
+
+    dfa_cache_free(cache);
+    return table;
+}
+
+void regex_dfa_table_free(DFATable* table) {
+    if (!table) return;
+
+    free(table->next);
+    free(table->flags);
+    free(table);
+}
+
+/* Compiles the unanchored scan to machine code. Returns 0 and keeps the interpreter when that isn't possible. */
+int regex_dfa_enable_jit(RegexDFA* dfa) {
+    if (!dfa) return 0;
+    if (dfa->jit) return 1;
+    if (!regex_jit_available()) return 0;
+
+    DFATable* table = regex_dfa_table_create(dfa, DFA_TABLE_MAX_STATES);
+    if (!table) return 0;
+
+    dfa->jit = regex_jit_compile(table);
+    regex_dfa_table_free(table);
+    return dfa->jit != NULL;
+}
+
+/* Earliest position in [from, line_end] where some match ends, scanning unanchored. */
+static int scan_earliest(const RegexDFA* dfa, DFACache* cache, const unsigned char* data, size_t from,
+                         size_t line_end, int bol, size_t* end) {
+    int state = start_state(dfa, cache, 0, bol);
+    if (state < 0 || cache->give_up) return DFA_GAVE_UP;
+
+    size_t i = from;
+    for (;;) {
+        unsigned char flags = cache->flags[state];
+        if (flags & DFA_FLAG_ACCEPT) {
+            *end = i;
+            break;
+        }
+        if (flags & DFA_FLAG_DEAD) {
+            i = line_end + 1;
+            break;
+        }
+        if (i == line_end) {
+            if (flags & DFA_FLAG_ACCEPT_EOL) {
+                *end = i;
+                break;
+            }
+            i++;
+            break;
+        }
+
+        size_t cls = dfa->byte_class[data[i]];
+        int next = cache->trans[(size_t)state * cache->class_count + cls];
+        if (next < 0) {
+            next = next_state(dfa, cache, state, cls);
+            if (next < 0) return DFA_GAVE_UP;
+        }
+        state = next;
+        i++;
+    }
+
+    cache->bytes_since_flush += i - from;
+    return i <= line_end;
+}
+
+/* End of the longest match starting exactly at start, or -1. */
+static long scan_longest(const RegexDFA* dfa, DFACache* cache, const unsigned char* data, size_t start,
+                         size_t line_end, int bol) {
+    int state = start_state(dfa, cache, 1, bol);
+    if (state < 0 || cache->give_up) return DFA_GAVE_UP;
+
+    long last = -1;
+    size_t i = start;
+    for (;;) {
+        unsigned char flags = cache->flags[state];
+        if (flags & DFA_FLAG_ACCEPT) last = (long)i;
+        if (flags & DFA_FLAG_DEAD) break;
+        if (i == line_end) {
+            if (flags & DFA_FLAG_ACCEPT_EOL) last = (long)i;
+            break;
+        }
+
+        size_t cls = dfa->byte_class[data[i]];
+        int next = cache->trans[(size_t)state * cache->class_count + cls];
+        if (next < 0) {
+            next = next_state(dfa, cache, state, cls);
+            if (next < 0) return DFA_GAVE_UP;
+        }
+        state = next;
+        i++;
+    }
+
+    cache->bytes_since_flush += i - start;
+    return last;
+}
+
+/*
+ * Marks every position in [from, line_end] where a match starts, with one
+ * backward pass of the reverse automaton from the end of the line. The
+ * marks stay valid for later calls on the same line of the same buffer.
+ */
+static int mark_starts(const RegexDFA* dfa, DFACache* cache, const char* data, size_t from, size_t line_end) {
+    if (cache->starts_data == data && cache->starts_end == line_end && cache->starts_from <= from) {
+        return 1;
+    }
+
+    const RegexDFA* reverse = dfa->reverse;
+    if (!cache->reverse) {
+        cache->reverse = dfa_cache_create(reverse);
+        if (!cache->reverse) return 0;
+    }
+    size_t span = line_end - from + 1;
+    if (span > cache->starts_capacity) {
+        unsigned char* starts = (unsigned char*)realloc(cache->starts, span);
+        if (!starts) return 0;
+        cache->starts = starts;
+        cache->starts_capacity = span;
+    }
+
+    /* Reading backwards, the end of the line is where the reversed ^ holds. */
+    DFACache* rcache = cache->reverse;
+    int state = start_state(reverse, rcache, 0, 1);
+    if (state < 0 || rcache->give_up) return 0;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = line_end;; i--) {
+        unsigned char flags = rcache->flags[state];
+        int line_start = i == 0 || data[i - 1] == '\n';
+        cache->starts[i - from] = (flags & DFA_FLAG_ACCEPT) || (line_start && (flags & DFA_FLAG_ACCEPT_EOL));
+        if (i == from) break;
+
+        size_t cls = reverse->byte_class[bytes[i - 1]];
+        int next = rcache->trans[(size_t)state * rcache->class_count + cls];
+        if (next < 0) {
+            next = next_state(reverse, rcache, state, cls);
+            if (next < 0) return 0;
+        }
+        state = next;
+    }
+    rcache->bytes_since_flush += span;
+
+    cache->starts_data = data;
+    cache->starts_from = from;
+    cache->starts_end = line_end;
+    return 1;
+}
+
+/*
+ * The first marked start in [from, end] is the leftmost match; one
+ * anchored pass from it finds the longest end. Each line costs a
+ * forward, a backward and an anchored pass, however long it is.
+ */
+static int match_from_starts(const RegexDFA* dfa, DFACache* cache, const char* data, size_t from, size_t end,
+                             size_t line_end, size_t* match_start, size_t* match_end) {
+    if (!mark_starts(dfa, cache, data, from, line_end)) return -1;
+
+    const unsigned char* starts = cache->starts - cache->starts_from;
+    for (size_t start = from; start <= end; start++) {
+        if (!starts[start]) continue;
+
+        int start_bol = start == 0 || data[start - 1] == '\n';
+        long longest = scan_longest(dfa, cache, (const unsigned char*)data, start, line_end, start_bol);
+        if (longest == DFA_GAVE_UP) return -1;
+        if (longest >= 0) {
+            *match_start = start;
+            *match_end = (size_t)longest;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The compiled scan runs across lines on its own and returns the earliest
+ * match end; only the line holding it goes back to the interpreter for
+ * the anchored passes.
+ */
+static int find_compiled(const RegexDFA* dfa, DFACache* cache, const char* data, size_t size, size_t from,
+                         size_t* match_start, size_t* match_end) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t pos = from;
+
+    while (pos <= size) {
+        int bol = pos == 0 || data[pos - 1] == '\n';
+        size_t end = dfa->jit->scan(bytes, pos, size, bol);
+        if (end == REGEX_JIT_NO_MATCH) return 0;
+
+        size_t line_start = line_find_start(data, end);
+        if (line_start < pos) {
+            line_start = pos;
+        }
+        size_t line_end = line_find_end(data, size, end);
+
+        int found = match_from_starts(dfa, cache, data, line_start, end, line_end, match_start, match_end);
+        if (found != 0) return found;
+
+        if (line_end >= size) break;
+        pos = line_end + 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Finds the leftmost-longest match starting at or after from. Matches never
+ * span a newline: each line is scanned unanchored for the earliest match
+ * end, and only a line that has one is scanned backwards for where its
+ * matches start and forwards once from the leftmost of them.
+ *
+ * Returns 1 on a match, 0 if there is none, and -1 if the cache thrashed
+ * and the caller should fall back to regexec for the rest of the buffer.
+ */
+int regex_dfa_find(const RegexDFA* dfa, DFACache* cache, const char* data, size_t size, size_t from,
+                   size_t* match_start, size_t* match_end) {
+    if (!dfa || !cache || !data) return 0;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t pos = from;
+
+    if (dfa->jit) {
+        return find_compiled(dfa, cache, data, size, from, match_start, match_end);
+    }
+
+    while (pos < size || (pos == size && size > 0 && data[size - 1] != '\n')) {
+        const char* newline = (const char*)memchr(data + pos, '\n', size - pos);
+        size_t line_end = newline ? (size_t)(newline - data) : size;
+        int bol = pos == 0 || data[pos - 1] == '\n';
+
+        size_t end = line_end;
+        int found = scan_earliest(dfa, cache, bytes, pos, line_end, bol, &end);
+        if (found == DFA_GAVE_UP) return -1;
+
+        if (found) {
+            found = match_from_starts(dfa, cache, data, pos, end, line_end, match_start, match_end);
+            if (found != 0) return found;
+        }
+
+        if (line_end >= size) break;
+        pos = line_end + 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include "../include/regex_jit.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+/* States with more byte ranges than this dispatch through a jump table instead of compares. */
+#define JIT_MAX_COMPARES 8
+
+int regex_jit_available(void) {
+#if defined(__x86_64__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void regex_jit_free(RegexJit* jit) {
+    if (!jit) return;
+
+#if defined(__x86_64__)
+    munmap(jit->code, jit->size);
+#endif
+    free(jit);
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Generated code, System V calling convention:
+ *   rdi = data, rsi = position, rdx = size, ecx = bol on entry,
+ *   eax = current byte, ecx = scratch afterwards.
+ * Each DFA state is a block that checks for the end of the buffer, loads
+ * one byte and branches straight to the next state's block, so the state
+ * lives in the program counter instead of a table lookup.
+ */
+
+typedef struct {
+    size_t at;
+    size_t base;
+    size_t label;
+} Fixup;
+
+typedef struct {
+    unsigned char* code;
+    size_t len;
+    size_t capacity;
+
+    Fixup* fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+
+    int failed;
+} Emitter;
+
+static void emit_bytes(Emitter* e, const void* bytes, size_t n) {
+    if (e->failed) return;
+
+    if (e->len + n > e->capacity) {
+        size_t new_capacity = e->capacity ? e->capacity * 2 : 4096;
+        while (e->len + n > new_capacity) {
+            new_capacity *= 2;
+        }
+        unsigned char* new_code = (unsigned char*)realloc(e->code, new_capacity);
+        if (!new_code) {
+            e->failed = 1;
+            return;
+        }
+        e->code = new_code;
+        e->capacity = new_capacity;
+    }
+    memcpy(e->code + e->len, bytes, n);
+    e->len += n;
+}
+
+static void emit_u32(Emitter* e, uint32_t value) {
+    unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16),
+                              (unsigned char)(value >> 24)};
+    emit_bytes(e, bytes, 4);
+}
+
+/* Emits a 32-bit slot holding label - base, filled in once every label is placed. */
+static void emit_label_ref(Emitter* e, size_t label, size_t base) {
+    if (e->fixup_count >= e->fixup_capacity) {
+        size_t new_capacity = e->fixup_capacity ? e->fixup_capacity * 2 : 256;
+        Fixup* new_fixups = (Fixup*)realloc(e->fixups, sizeof(Fixup) * new_capacity);
+        if (!new_fixups) {
+            e->failed = 1;
+            return;
+        }
+        e->fixups = new_fixups;
+        e->fixup_capacity = new_capacity;
+    }
+    e->fixups[e->fixup_count].at = e->len;
+    e->fixups[e->fixup_count].base = base;
+    e->fixups[e->fixup_count].label = label;
+    e->fixup_count++;
+    emit_u32(e, 0);
+}
+
+/* Branch with a rel32 operand: opcode bytes, then the displacement from the end of the instruction. */
+static void emit_branch(Emitter* e, const unsigned char* opcode, size_t opcode_len, size_t label) {
+    emit_bytes(e, opcode, opcode_len);
+    emit_label_ref(e, label, e->len + 4);
+}
+
+static const unsigned char OP_JMP[] = {0xE9};
+static const unsigned char OP_JE[] = {0x0F, 0x84};
+static const unsigned char OP_JNE[] = {0x0F, 0x85};
+static const unsigned char OP_JBE[] = {0x0F, 0x86};
+
+/* Picks the target covering the most bytes as the fall-through, preferring the state itself. */
+static size_t default_target(const size_t* targets, size_t self, size_t* counts, size_t label_count) {
+    memset(counts, 0, sizeof(size_t) * label_count);
+    for (size_t b = 0; b < 256; b++) {
+        counts[targets[b]]++;
+    }
+
+    size_t best = self;
+    for (size_t label = 0; label < label_count; label++) {
+        if (counts[label] > counts[best]) {
+            best = label;
+        }
+    }
+    return best;
+}
+
+/* Dispatches on eax: a short chain of range compares, or a table of rel32 offsets. */
+static void emit_dispatch(Emitter* e, const size_t* targets, size_t self, size_t* counts, size_t label_count) {
+    size_t fallback = default_target(targets, self, counts, label_count);
+    size_t ranges = 0;
+    for (size_t b = 0; b < 256; b++) {
+        if (targets[b] != fallback && (b == 0 || targets[b - 1] != targets[b])) {
+            ranges++;
+        }
+    }
+
+    if (ranges <= JIT_MAX_COMPARES) {
+        for (size_t lo = 0; lo < 256;) {
+            size_t hi = lo;
+            while (hi + 1 < 256 && targets[hi + 1] == targets[lo]) {
+                hi++;
+            }
+            if (targets[lo] != fallback) {
+                if (lo == hi) {
+                    static const unsigned char cmp_eax[] = {0x3D};
+                    emit_bytes(e, cmp_eax, sizeof(cmp_eax));
+                    emit_u32(e, (uint32_t)lo);
+                    emit_branch(e, OP_JE, sizeof(OP_JE), targets[lo]);
+                } else {
+                    static const unsigned char lea_ecx[] = {0x8D, 0x88};
+                    static const unsigned char cmp_ecx[] = {0x81, 0xF9};
+                    emit_bytes(e, lea_ecx, sizeof(lea_ecx));
+                    emit_u32(e, (uint32_t)(0u - (uint32_t)lo));
+                    emit_bytes(e, cmp_ecx, sizeof(cmp_ecx));
+                    emit_u32(e, (uint32_t)(hi - lo));
+                    emit_branch(e, OP_JBE, sizeof(OP_JBE), targets[lo]);
+                }
+            }
+            lo = hi + 1;
+        }
+        emit_branch(e, OP_JMP, sizeof(OP_JMP), fallback);
+        return;
+    }
+
+    /* lea rcx, [rip + table]; movsxd rax, [rcx + rax*4]; add rax, rcx; jmp rax */
+    static const unsigned char lea_rcx[] = {0x48, 0x8D, 0x0D};
+    static const unsigned char jump[] = {0x48, 0x63, 0x04, 0x81, 0x48, 0x01, 0xC8, 0xFF, 0xE0};
+    emit_bytes(e, lea_rcx, sizeof(lea_rcx));
+    size_t disp_at = e->len;
+    emit_u32(e, 0);
+    emit_bytes(e, jump, sizeof(jump));
+
+    static const unsigned char trap = 0xCC;
+    while (e->len % 4 != 0) {
+        emit_bytes(e, &trap, 1);
+    }
+    size_t table = e->len;
+    if (!e->failed) {
+        uint32_t disp = (uint32_t)(table - (disp_at + 4));
+        memcpy(e->code + disp_at, &disp, 4);
+    }
+    for (size_t b = 0; b < 256; b++) {
+        emit_label_ref(e, targets[b], table);
+    }
+}
+
+RegexJit* regex_jit_compile(const DFATable* table) {
+    if (!table || table->state_count == 0) return NULL;
+
+    size_t n = table->state_count;
+    size_t label_none = n;
+    size_t label_here = n + 1;
+    size_t label_before = n + 2;
+    size_t* labels = (size_t*)malloc(sizeof(size_t) * (n + 3));
+    size_t* targets = (size_t*)malloc(sizeof(size_t) * 256);
+    size_t* counts = (size_t*)malloc(sizeof(size_t) * (n + 3));
+    Emitter e;
+    memset(&e, 0, sizeof(e));
+    if (!labels || !targets || !counts) {
+        free(labels);
+        free(targets);
+        free(counts);
+        return NULL;
+    }
+
+    size_t bol_start = (size_t)table->start[1];
+
+    /* Entry: test ecx, ecx; jnz start[1]; jmp start[0] */
+    static const unsigned char test_ecx[] = {0x85, 0xC9};
+    emit_bytes(&e, test_ecx, sizeof(test_ecx));
+    emit_branch(&e, OP_JNE, sizeof(OP_JNE), bol_start);
+    emit_branch(&e, OP_JMP, sizeof(OP_JMP), (size_t)table->start[0]);
+
+    /* cmp rsi, rdx */
+    static const unsigned char cmp_end[] = {0x48, 0x39, 0xD6};
+    /* movzx eax, byte [rdi + rsi]; add rsi, 1 */
+    static const unsigned char load[] = {0x0F, 0xB6, 0x04, 0x37, 0x48, 0x83, 0xC6, 0x01};
+
+    for (size_t s = 0; s < n; s++) {
+        unsigned char flags = table->flags[s];
+        labels[s] = e.len;
+
+        /* The empty line after a final '\n' isn't a line; nothing may match there. */
+        if (s == bol_start) {
+            emit_bytes(&e, cmp_end, sizeof(cmp_end));
+            emit_branch(&e, OP_JE, sizeof(OP_JE), label_none);
+        }
+
+        if (flags & DFA_FLAG_ACCEPT) {
+            emit_branch(&e, OP_JMP, sizeof(OP_JMP), label_here);
+            continue;
+        }
+
+        int accept_eol = (flags & DFA_FLAG_ACCEPT_EOL) != 0;
+        if (s != bol_start) {
+            emit_bytes(&e, cmp_end, sizeof(cmp_end));
+            emit_branch(&e, OP_JE, sizeof(OP_JE), accept_eol ? label_here : label_none);
+        }
+        emit_bytes(&e, load, sizeof(load));
+
+        for (size_t b = 0; b < 256; b++) {
+            if (b == '\n') {
+                targets[b] = accept_eol ? label_before : bol_start;
+            } else if (flags & DFA_FLAG_DEAD) {
+                targets[b] = s;
+            } else {
+                targets[b] = (size_t)table->next[s * 256 + b];
+            }
+        }
+        emit_dispatch(&e, targets, s, counts, n + 3);
+    }
+
+    /* mov rax, -1; ret */
+    static const unsigned char ret_none[] = {0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF, 0xC3};
+    /* mov rax, rsi; ret */
+    static const unsigned char ret_here[] = {0x48, 0x89, 0xF0, 0xC3};
+    /* lea rax, [rsi - 1]; ret */
+    static const unsigned char ret_before[] = {0x48, 0x8D, 0x46, 0xFF, 0xC3};
+    labels[label_none] = e.len;
+    emit_bytes(&e, ret_none, sizeof(ret_none));
+    labels[label_here] = e.len;
+    emit_bytes(&e, ret_here, sizeof(ret_here));
+    labels[label_before] = e.len;
+    emit_bytes(&e, ret_before, sizeof(ret_before));
+
+    RegexJit* jit = NULL;
+    if (!e.failed) {
+        for (size_t i = 0; i < e.fixup_count; i++) {
+            uint32_t value = (uint32_t)(labels[e.fixups[i].label] - e.fixups[i].base);
+            memcpy(e.code + e.fixups[i].at, &value, 4);
+        }
+        jit = (RegexJit*)calloc(1, sizeof(RegexJit));
+    }
+
+    /* Written while mapped read-write, then flipped to read-execute; never both at once. */
+    if (jit) {
+        jit->size = e.len;
+        jit->code = mmap(NULL, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (jit->code == MAP_FAILED) {
+            free(jit);
+            jit = NULL;
+        } else {
+            memcpy(jit->code, e.code, e.len);
+            if (mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) != 0) {
+                regex_jit_free(jit);
+                jit = NULL;
+            } else {
+                jit->scan = (RegexJitScan)jit->code;
+            }
+        }
+    }
+
+    free(e.code);
+    free(e.fixups);
+    free(labels);
+    free(targets);
+    free(counts);
+    return jit;
+}
+
+#else
+
+RegexJit* regex_jit_compile(const DFATable* table) {
+    (void)table;
+    return NULL;
+}
+
+#endif
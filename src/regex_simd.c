@@ -1,12 +1,33 @@
 #include "../include/regex_simd.h"
+#include "../include/line_scan.h"
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <stdio.h>
 
 #define INITIAL_MATCH_CAPACITY 1024
+#define CANCEL_BLOCK_SIZE (4 * 1024 * 1024)
+#define REGEX_PREFILTER_MIN_LITERAL 2
+#define LONG_NEEDLE_MIN_LEN 40
+#define FUZZY_MIN_PIECE 2
 
-Pattern* pattern_create(const char* pattern_str, int case_insensitive, int use_regex) {
+static inline unsigned char ascii_fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+static int ascii_case_equal(const char* data, const char* folded, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (ascii_fold((unsigned char)data[i]) != (unsigned char)folded[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * unicode_fold lets -i literals containing non-ASCII bytes (or k and s)
+ * use Unicode simple case folding; prefilters stay ASCII-folded.
+ */
+static Pattern* pattern_build(const char* pattern_str, int case_insensitive, int use_regex, int unicode_fold) {
     if (!pattern_str) return NULL;
 
     Pattern* pattern = (Pattern*)malloc(sizeof(Pattern));
@@ -22,9 +43,58 @@ Pattern* pattern_create(const char* pattern_str, int case_insensitive, int use_r
     pattern->case_insensitive = case_insensitive;
     pattern->type = use_regex ? MATCH_REGEX : MATCH_ASCII;
     pattern->is_regex_compiled = 0;
+    pattern->folded = NULL;
+    pattern->multi = NULL;
+    pattern->dict = NULL;
+    pattern->dfa = NULL;
+    pattern->prefilter = NULL;
+    pattern->two_way = NULL;
+    pattern->match_words = 0;
+    pattern->match_lines = 0;
+    pattern->casefold = NULL;
+    pattern->fuzzy = NULL;
+
+    if (case_insensitive && pattern->type == MATCH_ASCII) {
+        pattern->folded = (char*)malloc(pattern->pattern_len + 1);
+        if (!pattern->folded) {
+            free(pattern->pattern);
+            free(pattern);
+            return NULL;
+        }
+        for (size_t i = 0; i <= pattern->pattern_len; i++) {
+            pattern->folded[i] = (char)ascii_fold((unsigned char)pattern_str[i]);
+        }
+    }
+
+    /*
+     * The packed kernels handle the needle's ASCII folding through
+     * prefilter, which is the folded needle when that is all ASCII.
+     */
+    if (unicode_fold && case_insensitive && pattern->type == MATCH_ASCII &&
+        casefold_needs_unicode(pattern_str, pattern->pattern_len)) {
+        pattern->casefold = case_needle_create(pattern_str, pattern->pattern_len);
+        if (pattern->casefold && pattern->casefold->all_ascii) {
+            char* ascii = (char*)malloc(pattern->casefold->count + 1);
+            if (ascii) {
+                memcpy(ascii, pattern->casefold->ascii, pattern->casefold->count);
+                ascii[pattern->casefold->count] = '\0';
+                pattern->prefilter = pattern_build(ascii, 1, 0, 0);
+                free(ascii);
+            }
+            if (!pattern->prefilter) {
+                case_needle_free(pattern->casefold);
+                pattern->casefold = NULL;
+            }
+        }
+    }
+
+    /* Long needles get a skip-based matcher instead of the packed kernels. */
+    if (pattern->type == MATCH_ASCII && pattern->pattern_len >= LONG_NEEDLE_MIN_LEN) {
+        pattern->two_way = two_way_create(pattern->pattern, pattern->pattern_len, case_insensitive);
+    }
 
     if (pattern->type == MATCH_REGEX) {
-        int flags = REG_EXTENDED;
+        int flags = REG_EXTENDED | REG_NEWLINE;
         if (case_insensitive) {
             flags |= REG_ICASE;
         }
@@ -36,6 +106,131 @@ Pattern* pattern_create(const char* pattern_str, int case_insensitive, int use_r
         }
 
         pattern->is_regex_compiled = 1;
+
+        /* regcomp validates the syntax and stays as the fallback for what the DFA can't express. */
+        pattern->dfa = regex_dfa_compile(pattern->pattern, case_insensitive);
+
+        /* A required literal lets the packed kernels pick candidate lines. */
+        char* literal = regex_dfa_required_literal(pattern->dfa);
+        if (literal && strlen(literal) >= REGEX_PREFILTER_MIN_LITERAL) {
+            pattern->prefilter = pattern_build(literal, case_insensitive, 0, 0);
+        }
+        free(literal);
+    }
+
+    return pattern;
+}
+
+Pattern* pattern_create(const char* pattern_str, int case_insensitive, int use_regex) {
+    return pattern_build(pattern_str, case_insensitive, use_regex, 1);
+}
+
+/*
+ * Several literals are compiled into one MultiLiteral so every file is
+ * scanned once regardless of the number of patterns; sets larger than
+ * Teddy handles go to the hashed Dictionary. Several regexes are joined
+ * into a single ERE alternation, so their matches carry pattern_index 0.
+ */
+Pattern* pattern_create_multi(const char* const* patterns, size_t count, int case_insensitive, int use_regex) {
+    if (!patterns || count == 0) return NULL;
+
+    if (count == 1) {
+        return pattern_create(patterns[0], case_insensitive, use_regex);
+    }
+
+    if (use_regex) {
+        size_t joined_len = 1;
+        for (size_t i = 0; i < count; i++) {
+            joined_len += strlen(patterns[i]) + 3;
+        }
+
+        char* joined = (char*)malloc(joined_len);
+        if (!joined) return NULL;
+
+        char* out = joined;
+        for (size_t i = 0; i < count; i++) {
+            out += sprintf(out, "%s(%s)", i > 0 ? "|" : "", patterns[i]);
+        }
+
+        Pattern* pattern = pattern_create(joined, case_insensitive, 1);
+        free(joined);
+        return pattern;
+    }
+
+    Pattern* pattern = pattern_create(patterns[0], case_insensitive, 0);
+    if (!pattern) return NULL;
+
+    int has_empty = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (patterns[i][0] == '\0') {
+            has_empty = 1;
+            break;
+        }
+    }
+
+    if (count > TEDDY_MAX_LITERALS && !has_empty) {
+        pattern->dict = dictionary_create(patterns, count, case_insensitive);
+        if (!pattern->dict) {
+            pattern_free(pattern);
+            return NULL;
+        }
+
+        pattern->type = MATCH_DICT;
+        return pattern;
+    }
+
+    pattern->multi = multi_literal_create(patterns, count, case_insensitive);
+    if (!pattern->multi) {
+        pattern_free(pattern);
+        return NULL;
+    }
+
+    pattern->type = MATCH_MULTI;
+    return pattern;
+}
+
+/*
+ * Approximate matching within max_errors edits. By pigeonhole, a match
+ * contains one of max_errors + 1 disjoint needle pieces verbatim, so when
+ * the pieces are long enough a multi-literal prefilter picks the lines
+ * Bitap has to look at.
+ */
+Pattern* pattern_create_fuzzy(const char* pattern_str, int max_errors, int case_insensitive) {
+    if (!pattern_str) return NULL;
+
+    size_t len = strlen(pattern_str);
+    Fuzzy* fuzzy = fuzzy_create(pattern_str, len, max_errors, case_insensitive);
+    if (!fuzzy) return NULL;
+
+    Pattern* pattern = pattern_build(pattern_str, case_insensitive, 0, 0);
+    if (!pattern) {
+        fuzzy_free(fuzzy);
+        return NULL;
+    }
+
+    pattern->type = MATCH_FUZZY;
+    pattern->fuzzy = fuzzy;
+
+    size_t pieces = (size_t)max_errors + 1;
+    if (len / pieces >= FUZZY_MIN_PIECE) {
+        char* storage = (char*)malloc(len + pieces);
+        const char** literals = (const char**)malloc(sizeof(char*) * pieces);
+
+        if (storage && literals) {
+            char* out = storage;
+            for (size_t i = 0; i < pieces; i++) {
+                size_t from = i * len / pieces;
+                size_t to = (i + 1) * len / pieces;
+                memcpy(out, pattern_str + from, to - from);
+                out[to - from] = '\0';
+                literals[i] = out;
+                out += to - from + 1;
+            }
+            pattern->prefilter = pattern_create_multi(literals, pieces, case_insensitive, 0);
+        }
+
+        free(storage);
+        free(literals);
     }
 
     return pattern;
@@ -48,13 +243,59 @@ void pattern_free(Pattern* pattern) {
         regfree(&pattern->regex_compiled);
     }
 
+    if (pattern->dfa) {
+        regex_dfa_free(pattern->dfa);
+    }
+
+    if (pattern->prefilter) {
+        pattern_free(pattern->prefilter);
+    }
+
+    if (pattern->two_way) {
+        two_way_free(pattern->two_way);
+    }
+
+    case_needle_free(pattern->casefold);
+    fuzzy_free(pattern->fuzzy);
+
     if (pattern->pattern) {
         free(pattern->pattern);
     }
 
+    if (pattern->folded) {
+        free(pattern->folded);
+    }
+
+    multi_literal_free(pattern->multi);
+    dictionary_free(pattern->dict);
+
     free(pattern);
 }
 
+/*
+ * Boundaries are checked on each occurrence the kernels report, so -w and
+ * -x searches keep the literal kernels. For regexes -x is exact because
+ * matches are leftmost-longest; a regex match -w rejects is retried
+ * shorter and then further along the line, as GNU grep does.
+ */
+void pattern_set_boundaries(Pattern* pattern, int match_words, int match_lines) {
+    if (!pattern) return;
+
+    pattern->match_words = match_words ? 1 : 0;
+    pattern->match_lines = match_lines ? 1 : 0;
+}
+
+/*
+ * Compiles the regex automaton to machine code. Returns 0 when the pattern
+ * has no DFA, it is too large or the platform isn't x86-64; the
+ * interpreter keeps running in that case.
+ */
+int pattern_enable_jit(Pattern* pattern) {
+    if (!pattern || !pattern->dfa) return 0;
+
+    return regex_dfa_enable_jit(pattern->dfa);
+}
+
 MatchList* matchlist_create(void) {
     MatchList* list = (MatchList*)malloc(sizeof(MatchList));
     if (!list) return NULL;
@@ -67,6 +308,16 @@ MatchList* matchlist_create(void) {
 
     list->count = 0;
     list->capacity = INITIAL_MATCH_CAPACITY;
+    list->mode = MATCH_MODE_ALL;
+    list->highlight = 0;
+    list->spans = NULL;
+    list->span_total = 0;
+    list->span_capacity = 0;
+    list->invert = 0;
+    list->limit = 0;
+    list->line_end = 0;
+    list->line_seen = 0;
+    list->cancel = NULL;
     return list;
 }
 
@@ -77,10 +328,78 @@ void matchlist_free(MatchList* list) {
         free(list->matches);
     }
 
+    free(list->spans);
     free(list);
 }
 
+/* Empties the list for another buffer, keeping its settings and storage. */
+void matchlist_clear(MatchList* list) {
+    if (!list) return;
+
+    list->count = 0;
+    list->span_total = 0;
+    list->line_end = 0;
+    list->line_seen = 0;
+}
+
+/* Set before searching; highlight only matters in line mode. */
+void matchlist_set_mode(MatchList* list, MatchMode mode, int highlight) {
+    if (!list) return;
+
+    list->mode = mode;
+    list->highlight = highlight ? 1 : 0;
+}
+
+/* Set before searching; only LINES and COUNT lists can be inverted. */
+void matchlist_set_invert(MatchList* list, int invert) {
+    if (!list) return;
+
+    list->invert = invert ? 1 : 0;
+}
+
+void matchlist_set_limit(MatchList* list, size_t limit) {
+    if (!list) return;
+
+    list->limit = limit;
+}
+
+void matchlist_set_cancel(MatchList* list, const int* cancel) {
+    if (!list) return;
+
+    list->cancel = cancel;
+}
+
+static inline int matchlist_full(const MatchList* list) {
+    return list->limit > 0 && !list->invert && list->count >= list->limit;
+}
+
+static inline int matchlist_cancelled(const MatchList* list) {
+    return list->cancel && __atomic_load_n(list->cancel, __ATOMIC_RELAXED);
+}
+
+static int matchlist_add_span(MatchList* list, size_t start, size_t end) {
+    if (list->span_total >= list->span_capacity) {
+        size_t new_capacity = list->span_capacity == 0 ? INITIAL_MATCH_CAPACITY : list->span_capacity * 2;
+        Span* new_spans = (Span*)realloc(list->spans, sizeof(Span) * new_capacity);
+        if (!new_spans) return 0;
+
+        list->spans = new_spans;
+        list->span_capacity = new_capacity;
+    }
+
+    list->spans[list->span_total].start = start;
+    list->spans[list->span_total].end = end;
+    list->span_total++;
+    list->matches[list->count - 1].span_count++;
+
+    return 1;
+}
+
 int matchlist_add(MatchList* list, size_t start, size_t end, size_t line_num) {
+    return matchlist_add_indexed(list, start, end, line_num, 0);
+}
+
+int matchlist_add_indexed(MatchList* list, size_t start, size_t end, size_t line_num, size_t pattern_index) {
     if (!list) return 0;
 
     if (list->count >= list->capacity) {
@@ -95,6 +414,9 @@ int matchlist_add(MatchList* list, size_t start, size_t end, size_t line_num) {
     list->matches[list->count].start = start;
     list->matches[list->count].end = end;
     list->matches[list->count].line_num = line_num;
+    list->matches[list->count].pattern_index = pattern_index;
+    list->matches[list->count].span_index = list->span_total;
+    list->matches[list->count].span_count = 0;
     list->count++;
 
     return 1;
@@ -109,12 +431,25 @@ int pattern_match_ascii(const Pattern* pattern, const char* data, size_t size, s
 }
 
 int pattern_match_ascii_case(const Pattern* pattern, const char* data, size_t size, size_t pos) {
-    if (!pattern || !data || pos >= size || pos + pattern->pattern_len > size) {
+    if (!pattern || !data || pos >= size) {
         return 0;
     }
 
+    /* Folded matches may differ in byte length from the needle. */
+    if (pattern->casefold) {
+        return case_needle_match(pattern->casefold, data, size, pos) != 0;
+    }
+
+    if (pos + pattern->pattern_len > size) {
+        return 0;
+    }
+
+    if (pattern->folded) {
+        return ascii_case_equal(data + pos, pattern->folded, pattern->pattern_len);
+    }
+
     for (size_t i = 0; i < pattern->pattern_len; i++) {
-        if (tolower((unsigned char)pattern->pattern[i]) != tolower((unsigned char)data[pos + i])) {
+        if (ascii_fold((unsigned char)pattern->pattern[i]) != ascii_fold((unsigned char)data[pos + i])) {
             return 0;
         }
     }
@@ -128,83 +463,527 @@ int pattern_match_regex(const Pattern* pattern, const char* data, size_t size, s
     }
 
     regmatch_t match;
-    int result = regexec(&pattern->regex_compiled, data + pos, 1, &match, 0);
+    match.rm_so = 0;
+    match.rm_eo = (regoff_t)(size - pos);
+    int result = regexec(&pattern->regex_compiled, data + pos, 1, &match, REG_STARTEND);
 
     return result == 0;
 }
 
+static inline int is_word_byte(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static int boundaries_ok(const Pattern* pattern, const char* data, size_t size, size_t start, size_t end) {
+    if (pattern->match_lines) {
+        return (start == 0 || data[start - 1] == '\n') && (end >= size || data[end] == '\n');
+    }
+
+    return (start == 0 || !is_word_byte((unsigned char)data[start - 1])) &&
+           (end >= size || !is_word_byte((unsigned char)data[end]));
+}
+
+/*
+ * COUNT mode and inverted lists only track where the last matching line
+ * ended: a new matching line is counted, or closes the gap of
+ * non-matching lines before it.
+ */
+static size_t record_line(MatchList* matches, const char* data, size_t size, size_t start) {
+    if (matches->line_seen && start <= matches->line_end) {
+        return matches->line_end < size ? matches->line_end + 1 : size;
+    }
+
+    size_t line_end = line_find_end(data, size, start);
+    if (matches->mode == MATCH_MODE_COUNT) {
+        if (matchlist_full(matches)) return size;
+        matches->count++;
+    } else {
+        size_t gap = matches->line_seen ? matches->line_end + 1 : 0;
+        size_t line_start = gap + line_find_start(data + gap, start - gap);
+        if (line_start > gap) {
+            matchlist_add_indexed(matches, gap, line_start, 0, 0);
+        }
+    }
+
+    matches->line_end = line_end;
+    matches->line_seen = 1;
+    if (matchlist_full(matches)) return size;
+    return line_end < size ? line_end + 1 : size;
+}
+
+/*
+ * Adds the occurrence [start, end) to the list unless it fails -w/-x. In
+ * line mode the first occurrence on a line opens that line's record and
+ * later ones only add highlight spans. Returns where scanning may resume
+ * when the rest of the line can be skipped, or 0 to carry on as usual.
+ */
+static size_t record_hit(const Pattern* pattern, MatchList* matches, const char* data, size_t size,
+                         size_t start, size_t end, size_t pattern_index) {
+    if ((pattern->match_words || pattern->match_lines) && !boundaries_ok(pattern, data, size, start, end)) {
+        return 0;
+    }
+
+    if (matches->mode == MATCH_MODE_ALL) {
+        if (matchlist_full(matches)) return size;
+        matchlist_add_indexed(matches, start, end, 0, pattern_index);
+        return matchlist_full(matches) ? size : 0;
+    }
+
+    if (matches->mode == MATCH_MODE_COUNT || matches->invert) {
+        return record_line(matches, data, size, start);
+    }
+
+    Match* last = matches->count > 0 ? &matches->matches[matches->count - 1] : NULL;
+    if (!last || start > last->end) {
+        if (matchlist_full(matches)) return size;
+
+        /* Records are in order, so the line can't start before the previous one ended. */
+        size_t bound = last ? last->end + 1 : 0;
+        size_t line_start = bound + line_find_start(data + bound, start - bound);
+        size_t line_end = line_find_end(data, size, start);
+
+        if (!matchlist_add_indexed(matches, line_start, line_end, 0, pattern_index)) return 0;
+        last = &matches->matches[matches->count - 1];
+    }
+
+    if (matches->highlight) {
+        matchlist_add_span(matches, start, end);
+        return 0;
+    }
+
+    if (matchlist_full(matches)) return size;
+    return last->end < size ? last->end + 1 : size;
+}
+
+/* Returns the position of the first occurrence at or after pos, or size if none. */
+typedef size_t (*LiteralFinder)(const Pattern* pattern, const char* data, size_t size, size_t pos);
+
+static size_t find_literal_fast(const Pattern* pattern, const char* data, size_t size, size_t pos);
+
+static int collect_literal_matches(const Pattern* pattern, const char* data, size_t size,
+                                   MatchList* matches, LiteralFinder find) {
+    size_t pos = 0;
+
+    while ((pos = find(pattern, data, size, pos)) < size) {
+        size_t next = record_hit(pattern, matches, data, size, pos, pos + pattern->pattern_len, 0);
+        pos = next > pos ? next : pos + 1;
+    }
+
+    return matches->count > 0;
+}
+
+static size_t find_literal_scalar(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    for (; pos < size; pos++) {
+        int found = pattern->case_insensitive ? pattern_match_ascii_case(pattern, data, size, pos)
+                                              : pattern_match_ascii(pattern, data, size, pos);
+        if (found) {
+            return pos;
+        }
+    }
+
+    return size;
+}
+
 int search_pattern_ascii(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
     if (!pattern || !data || !matches) return 0;
 
-    size_t pos = 0;
-    size_t line_num = 1;
+    if (pattern->casefold) {
+        size_t pos = 0;
+        for (; pos < size; pos++) {
+            size_t end = case_needle_match(pattern->casefold, data, size, pos);
+            if (end) {
+                size_t next = record_hit(pattern, matches, data, size, pos, end, 0);
+                if (next > pos) pos = next - 1;
+            }
+        }
+        return matches->count > 0;
+    }
+
+    return collect_literal_matches(pattern, data, size, matches, find_literal_scalar);
+}
+
+/*
+ * Unicode -i: ASCII stretches of the text go to the packed kernels via the
+ * ASCII prefilter, or are skipped when the folded needle isn't all ASCII,
+ * up to the last few bytes before a stretch with multibyte sequences.
+ * Only those stretches are decoded and folded. stretch[] caches the
+ * current one across calls.
+ */
+static size_t find_casefold(const Pattern* pattern, const char* data, size_t size, size_t pos, size_t stretch[2],
+                            size_t* match_end) {
+    const CaseNeedle* needle = pattern->casefold;
+    size_t reach_back = needle->all_ascii ? needle->count - 1 : needle->ascii_prefix;
 
     while (pos < size) {
-        int found = 0;
+        if (stretch[1] <= pos) {
+            stretch[0] = casefold_next_non_ascii(data, size, pos);
+            stretch[1] = casefold_stretch_end(data, size, stretch[0]);
+        }
 
-        if (pattern->case_insensitive) {
-            found = pattern_match_ascii_case(pattern, data, size, pos);
-        } else {
-            found = pattern_match_ascii(pattern, data, size, pos);
+        if (pos < stretch[0]) {
+            if (needle->all_ascii) {
+                size_t found = find_literal_fast(pattern->prefilter, data, stretch[0], pos);
+                if (found < stretch[0]) {
+                    *match_end = found + needle->count;
+                    return found;
+                }
+            }
+            if (stretch[0] >= size) break;
+
+            size_t from = stretch[0] > reach_back ? stretch[0] - reach_back : 0;
+            if (from > pos) {
+                pos = from;
+            }
         }
 
-        if (found) {
-            matchlist_add(matches, pos, pos + pattern->pattern_len, line_num);
-            pos++;
-        } else {
-            if (data[pos] == '\n') {
-                line_num++;
+        for (; pos < stretch[1]; pos++) {
+            if (needle->lead[(unsigned char)data[pos]]) {
+                size_t end = case_needle_match(needle, data, size, pos);
+                if (end) {
+                    *match_end = end;
+                    return pos;
+                }
             }
-            pos++;
         }
     }
 
-    return matches->count > 0;
+    return size;
 }
 
-int search_pattern_regex(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
-    if (!pattern || !data || !matches || !pattern->is_regex_compiled) return 0;
+int search_pattern_casefold(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->casefold) return 0;
 
+    size_t stretch[2] = {0, 0};
     size_t pos = 0;
-    size_t line_num = 1;
+    size_t end;
+
+    while ((pos = find_casefold(pattern, data, size, pos, stretch, &end)) < size) {
+        size_t next = record_hit(pattern, matches, data, size, pos, end, 0);
+        pos = next > pos ? next : pos + 1;
+    }
+
+    return matches->count > 0;
+}
+
+static size_t find_literal_two_way(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    return two_way_find(pattern->two_way, data, size, pos);
+}
+
+int search_pattern_two_way(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->two_way) return 0;
+
+    return collect_literal_matches(pattern, data, size, matches, find_literal_two_way);
+}
+
+/*
+ * -w for regexes: when the leftmost-longest match [start, end) isn't a
+ * whole word, tries shorter matches from the same start, then the next
+ * leftmost-longest match after start, until one is or the line runs out.
+ * Uses regexec for the retries, so the DFA needs no anchored mode.
+ * Returns 1 with the word match in *word_start and *word_end.
+ */
+static int find_word_retry(const Pattern* pattern, const char* data, size_t size, size_t start, size_t end,
+                           size_t* word_start, size_t* word_end) {
+    size_t line_start = line_find_start(data, start);
+    size_t line_end = line_find_end(data, size, start);
+    const char* line = data + line_start;
     regmatch_t regmatch;
 
-    while (pos <= size) {
-        int result = regexec(&pattern->regex_compiled, data + pos, 1, &regmatch, 0);
+    for (;;) {
+        /* A window ending before the line does isn't the end of the line for $. */
+        size_t limit = end;
+        while (limit > start) {
+            regmatch.rm_so = (regoff_t)(start - line_start);
+            regmatch.rm_eo = (regoff_t)(limit - 1 - line_start);
+            if (regexec(&pattern->regex_compiled, line, 1, &regmatch, REG_STARTEND | REG_NOTEOL) != 0 ||
+                line_start + regmatch.rm_so != start) {
+                break;
+            }
+            limit = line_start + regmatch.rm_eo;
+            if (boundaries_ok(pattern, data, size, start, limit)) {
+                *word_start = start;
+                *word_end = limit;
+                return 1;
+            }
+        }
+
+        if (start >= line_end) return 0;
+        regmatch.rm_so = (regoff_t)(start + 1 - line_start);
+        regmatch.rm_eo = (regoff_t)(line_end - line_start);
+        if (regexec(&pattern->regex_compiled, line, 1, &regmatch, REG_STARTEND) != 0) return 0;
+
+        start = line_start + regmatch.rm_so;
+        end = line_start + regmatch.rm_eo;
+        if (boundaries_ok(pattern, data, size, start, end)) {
+            *word_start = start;
+            *word_end = end;
+            return 1;
+        }
+    }
+}
+
+/* True when -w alone applies and [start, end) fails it. */
+static int word_rejected(const Pattern* pattern, const char* data, size_t size, size_t start, size_t end) {
+    return pattern->match_words && !pattern->match_lines && !boundaries_ok(pattern, data, size, start, end);
+}
+
+/*
+ * Runs regexec over data[from, end) one line at a time. REG_STARTEND keeps
+ * it inside the line, so mmap'd buffers need no NUL terminator and the
+ * cost is proportional to the lines scanned.
+ */
+static void collect_regexec_matches(const Pattern* pattern, const char* data, size_t end, size_t from,
+                                    MatchList* matches) {
+    size_t pos = from;
+
+    while (pos < end || (pos == end && end > 0 && data[end - 1] != '\n')) {
+        const char* newline = (const char*)memchr(data + pos, '\n', end - pos);
+        size_t line_end = newline ? (size_t)(newline - data) : end;
+        int eflags = REG_STARTEND | ((pos == 0 || data[pos - 1] == '\n') ? 0 : REG_NOTBOL);
+        size_t line_start = pos;
+        regmatch_t regmatch;
+
+        while (pos <= line_end) {
+            regmatch.rm_so = (regoff_t)(pos - line_start);
+            regmatch.rm_eo = (regoff_t)(line_end - line_start);
+
+            if (regexec(&pattern->regex_compiled, data + line_start, 1, &regmatch, eflags) != 0) {
+                break;
+            }
+
+            size_t match_start = line_start + regmatch.rm_so;
+            size_t match_end = line_start + regmatch.rm_eo;
+
+            if (word_rejected(pattern, data, end, match_start, match_end) &&
+                !find_word_retry(pattern, data, end, match_start, match_end, &match_start, &match_end)) {
+                break;
+            }
+            if (record_hit(pattern, matches, data, end, match_start, match_end, 0)) {
+                break;
+            }
+
+            pos = match_end > match_start ? match_end : match_start + 1;
+        }
+
+        if (line_end >= end || matchlist_full(matches)) break;
+        pos = line_end + 1;
+    }
+}
 
-        if (result != 0 || regmatch.rm_so == -1) {
+/*
+ * Adds every DFA match in data[from, end). Returns -1 if the DFA gave up,
+ * with *resume set to where regexec should take over.
+ */
+static int collect_dfa_matches(const Pattern* pattern, DFACache* cache, const char* data, size_t end,
+                               size_t from, MatchList* matches, size_t* resume) {
+    size_t pos = from;
+
+    while (pos <= end) {
+        size_t match_start, match_end;
+        int found = regex_dfa_find(pattern->dfa, cache, data, end, pos, &match_start, &match_end);
+
+        if (found < 0) {
+            *resume = pos;
+            return -1;
+        }
+        if (found == 0) {
             break;
         }
+        if (word_rejected(pattern, data, end, match_start, match_end) &&
+            !find_word_retry(pattern, data, end, match_start, match_end, &match_start, &match_end)) {
+            pos = line_find_end(data, end, match_start) + 1;
+            continue;
+        }
 
-        size_t match_start = pos + regmatch.rm_so;
-        size_t match_end = pos + regmatch.rm_eo;
+        size_t next = record_hit(pattern, matches, data, end, match_start, match_end, 0);
+        if (matchlist_full(matches)) break;
 
-        matchlist_add(matches, match_start, match_end, line_num);
+        pos = match_end > match_start ? match_end : match_start + 1;
+        if (next > pos) {
+            pos = next;
+        }
+    }
 
-        pos = match_end ? match_end : pos + 1;
+    return 0;
+}
+
+/* Matches data[from, end) on the DFA, switching this buffer to regexec for good if it gives up. */
+static void collect_window_matches(const Pattern* pattern, DFACache** cache, const char* data, size_t end,
+                                   size_t from, MatchList* matches) {
+    size_t resume = from;
+
+    if (*cache) {
+        if (collect_dfa_matches(pattern, *cache, data, end, from, matches, &resume) == 0) {
+            return;
+        }
+        regex_dfa_release(pattern->dfa, *cache);
+        *cache = NULL;
     }
 
+    collect_regexec_matches(pattern, data, end, resume, matches);
+}
+
+/*
+ * Regexes run on the lazy DFA when it could be built and on line-bounded
+ * regexec otherwise. With a required literal, only the lines containing
+ * it are matched at all.
+ */
+int search_pattern_regex(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->is_regex_compiled) return 0;
+
+    DFACache* cache = regex_dfa_acquire(pattern->dfa);
+
+    if (!pattern->prefilter) {
+        collect_window_matches(pattern, &cache, data, size, 0, matches);
+    } else {
+        size_t pos = 0;
+        size_t candidate;
+        while (!matchlist_full(matches) &&
+               (candidate = find_literal_fast(pattern->prefilter, data, size, pos)) < size) {
+            size_t line_start = pos + line_find_start(data + pos, candidate - pos);
+            size_t line_end = line_find_end(data, size, candidate);
+            if (line_end < size) {
+                line_end++;
+            }
+
+            collect_window_matches(pattern, &cache, data, line_end, line_start, matches);
+            pos = line_end;
+        }
+    }
+
+    if (cache) {
+        regex_dfa_release(pattern->dfa, cache);
+    }
     return matches->count > 0;
 }
 
-int search_pattern(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
-    if (!pattern || !data || !matches) return 0;
+/* Next position at or after pos where one of the prefilter's literals occurs, or size. */
+static size_t find_prefilter_hit(const Pattern* prefilter, const char* data, size_t size, size_t pos) {
+    if (prefilter->type != MATCH_MULTI) {
+        return find_literal_fast(prefilter, data, size, pos);
+    }
 
-#ifdef __AVX2__
-    if (pattern->type == MATCH_ASCII && !pattern->case_insensitive && is_simd_available()) {
-        if (search_pattern_avx2(pattern, data, size, matches)) {
-            return 1;
+    const MultiLiteral* ml = prefilter->multi;
+    while ((pos = multi_literal_find_candidate(ml, data, size, pos)) < size) {
+        size_t cursor = 0;
+        if (multi_literal_next_match(ml, data, size, pos, &cursor) < ml->count) {
+            return pos;
         }
+        pos++;
     }
-#endif
 
-#ifdef __SSE4_2__
-    if (pattern->type == MATCH_ASCII && !pattern->case_insensitive && is_simd_available()) {
-        if (search_pattern_sse42(pattern, data, size, matches)) {
-            return 1;
+    return size;
+}
+
+static void collect_fuzzy_matches(const Pattern* pattern, const char* data, size_t end, size_t from,
+                                  MatchList* matches) {
+    size_t pos = from;
+    size_t match_start, match_end;
+
+    while ((match_start = fuzzy_find(pattern->fuzzy, data, end, pos, &match_end)) < end) {
+        size_t next = record_hit(pattern, matches, data, end, match_start, match_end, 0);
+
+        pos = match_end > match_start ? match_end : match_start + 1;
+        if (next > pos) {
+            pos = next;
+        }
+    }
+}
+
+int search_pattern_fuzzy(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->fuzzy) return 0;
+
+    if (!pattern->prefilter) {
+        collect_fuzzy_matches(pattern, data, size, 0, matches);
+        return matches->count > 0;
+    }
+
+    size_t pos = 0;
+    size_t candidate;
+    while (!matchlist_full(matches) && (candidate = find_prefilter_hit(pattern->prefilter, data, size, pos)) < size) {
+        size_t line_start = pos + line_find_start(data + pos, candidate - pos);
+        size_t line_end = line_find_end(data, size, candidate);
+
+        collect_fuzzy_matches(pattern, data, line_end, line_start, matches);
+        pos = line_end < size ? line_end + 1 : size;
+    }
+
+    return matches->count > 0;
+}
+
+int search_pattern_multi(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->multi) return 0;
+
+    const MultiLiteral* ml = pattern->multi;
+    size_t pos = 0;
+
+    while ((pos = multi_literal_find_candidate(ml, data, size, pos)) < size) {
+        size_t cursor = 0;
+        size_t index;
+        size_t next = 0;
+
+        while (!next && (index = multi_literal_next_match(ml, data, size, pos, &cursor)) < ml->count) {
+            next = record_hit(pattern, matches, data, size, pos, pos + ml->lengths[index], index);
         }
+        pos = next > pos ? next : pos + 1;
     }
+
+    return matches->count > 0;
+}
+
+int search_pattern_dict(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || !pattern->dict) return 0;
+
+    const Dictionary* dict = pattern->dict;
+    size_t pos = 0;
+
+    while ((pos = dictionary_find_candidate(dict, data, size, pos)) < size) {
+        size_t cursor = 0;
+        size_t index;
+        size_t next = 0;
+
+        while (!next && (index = dictionary_next_match(dict, data, size, pos, &cursor)) < dict->count) {
+            next = record_hit(pattern, matches, data, size, pos, pos + dict->lengths[index], index);
+        }
+        pos = next > pos ? next : pos + 1;
+    }
+
+    return matches->count > 0;
+}
+
+static int search_dispatch(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (pattern->type == MATCH_MULTI) {
+        return search_pattern_multi(pattern, data, size, matches);
+    }
+
+    if (pattern->type == MATCH_DICT) {
+        return search_pattern_dict(pattern, data, size, matches);
+    }
+
+    if (pattern->type == MATCH_FUZZY) {
+        return search_pattern_fuzzy(pattern, data, size, matches);
+    }
+
+    if (pattern->casefold) {
+        return search_pattern_casefold(pattern, data, size, matches);
+    }
+
+    if (pattern->two_way) {
+        return search_pattern_two_way(pattern, data, size, matches);
+    }
+
+    if (pattern->type == MATCH_ASCII && pattern->pattern_len > 0 && is_simd_available()) {
+#ifdef CPU_X86
+        switch (kernel_active()) {
+            case KERNEL_AVX512:
+                return search_pattern_avx512(pattern, data, size, matches);
+            case KERNEL_AVX2:
+                return search_pattern_avx2(pattern, data, size, matches);
+            default:
+                return search_pattern_sse42(pattern, data, size, matches);
+        }
 #endif
+    }
 
     if (pattern->type == MATCH_ASCII) {
         return search_pattern_ascii(pattern, data, size, matches);
@@ -213,120 +992,372 @@ int search_pattern(const Pattern* pattern, const char* data, size_t size, MatchL
     }
 }
 
-#ifdef __SSE4_2__
-#include <nmmintrin.h>
+/*
+ * Turns the matching lines seen by an inverted search into the lines it
+ * selects; before is the count the list had when the search started.
+ */
+static void invert_finish(MatchList* matches, const char* data, size_t size, size_t before) {
+    size_t gap = matches->line_seen ? matches->line_end + 1 : 0;
+
+    if (matches->mode == MATCH_MODE_COUNT) {
+        size_t lines = line_count_newlines(data, 0, size) + (size > 0 && data[size - 1] != '\n');
+        size_t selected = lines - (matches->count - before);
+        if (matches->limit > 0 && selected > matches->limit) {
+            selected = matches->limit;
+        }
+        matches->count = before + selected;
+    } else if (gap < size) {
+        matchlist_add_indexed(matches, gap, size, 0, 0);
+    }
+}
 
-int search_pattern_sse42(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
-    if (!pattern || !data || !matches || pattern->pattern_len == 0) return 0;
-    if (pattern->pattern_len > 16) {
-        return search_pattern_ascii(pattern, data, size, matches);
+static void search_block(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    size_t before = matches->count;
+
+    search_dispatch(pattern, data, size, matches);
+    if (matches->invert && matches->mode != MATCH_MODE_ALL) {
+        invert_finish(matches, data, size, before);
     }
+}
+
+/* Appends src's records and spans to dst, moved by offset. */
+static void matchlist_append_shifted(MatchList* dst, const MatchList* src, size_t offset) {
+    for (size_t i = 0; i < src->count; i++) {
+        const Match* match = &src->matches[i];
+        if (!matchlist_add_indexed(dst, match->start + offset, match->end + offset, 0, match->pattern_index)) return;
+
+        for (size_t s = 0; s < match->span_count; s++) {
+            const Span* span = &src->spans[match->span_index + s];
+            matchlist_add_span(dst, span->start + offset, span->end + offset);
+        }
+    }
+}
+
+/*
+ * Large buffers with a cancel flag are searched in newline-aligned blocks
+ * so another thread's hit (-q) stops the scan within one block. Each
+ * block is searched into a scratch list as its own buffer and the
+ * records are shifted back; inverted gaps may split at block edges, which
+ * the output doesn't notice since they hold whole lines.
+ */
+static void search_blocks(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    MatchList* block = matchlist_create();
+    if (!block) {
+        search_block(pattern, data, size, matches);
+        return;
+    }
+    matchlist_set_mode(block, matches->mode, matches->highlight);
+    matchlist_set_invert(block, matches->invert);
 
-    __m128i pattern_vec = _mm_loadu_si128((const __m128i*)pattern->pattern);
     size_t pos = 0;
-    size_t line_num = 1;
-
-    while (pos + 16 <= size) {
-        __m128i data_vec = _mm_loadu_si128((const __m128i*)(data + pos));
-        __m128i cmp = _mm_cmpeq_epi8(data_vec, pattern_vec);
-
-        unsigned mask = _mm_movemask_epi8(cmp);
-
-        if (mask != 0) {
-            for (int i = 0; i < 16; i++) {
-                if (mask & (1 << i)) {
-                    if (pos + i + pattern->pattern_len <= size) {
-                        if (memcmp(data + pos + i, pattern->pattern, pattern->pattern_len) == 0) {
-                            matchlist_add(matches, pos + i, pos + i + pattern->pattern_len, line_num);
-                        }
-                    }
-                }
+    /* Inverted lists ignore the limit while scanning, but past it they hold enough lines already. */
+    while (pos < size && !matchlist_cancelled(matches) && !(matches->limit > 0 && matches->count >= matches->limit)) {
+        size_t end = size;
+        if (size - pos > CANCEL_BLOCK_SIZE) {
+            end = line_find_end(data, size, pos + CANCEL_BLOCK_SIZE);
+            if (end < size) {
+                end++;
             }
         }
 
-        for (int i = 0; i < 16 && pos + i < size; i++) {
-            if (data[pos + i] == '\n') {
-                line_num++;
+        matchlist_clear(block);
+        block->limit = matches->limit > 0 ? matches->limit - matches->count : 0;
+        search_block(pattern, data + pos, end - pos, block);
+
+        if (matches->mode == MATCH_MODE_COUNT) {
+            matches->count += block->count;
+        } else {
+            matchlist_append_shifted(matches, block, pos);
+        }
+        pos = end;
+    }
+
+    matchlist_free(block);
+}
+
+int search_pattern(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches) return 0;
+
+    if (matches->cancel && size > CANCEL_BLOCK_SIZE) {
+        search_blocks(pattern, data, size, matches);
+    } else {
+        search_block(pattern, data, size, matches);
+    }
+    return matches->count > 0;
+}
+
+/*
+ * Packed literal kernels: compare the first and last needle byte against two
+ * overlapping data vectors, AND the results, and only memcmp the middle of
+ * the needle for lanes that survive. Works for needles of any length; the
+ * block loop stops once the last-byte load would run past the buffer and the
+ * remaining positions go through the scalar finder.
+ *
+ * The case-insensitive variants fold in-register: lanes are ORed with 0x20
+ * only where the needle byte being tested is a letter, so 'A'/'a' compare
+ * equal while '@' and '`' stay distinct. Candidates are verified against
+ * the pre-folded needle.
+ */
+#ifdef CPU_X86
+#include <immintrin.h>
+
+TARGET_SSE42
+static size_t find_literal_sse42(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->pattern;
+    size_t n = pattern->pattern_len;
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+
+    while (size >= n && pos + n - 1 + 16 <= size) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(data + pos + n - 1));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (n <= 2 || memcmp(data + pos + bit + 1, needle + 1, n - 2) == 0) {
+                return pos + bit;
             }
+            mask &= mask - 1;
         }
 
         pos += 16;
     }
 
-    while (pos < size) {
-        if (pattern_match_ascii(pattern, data, size, pos)) {
-            matchlist_add(matches, pos, pos + pattern->pattern_len, line_num);
-        }
-        if (data[pos] == '\n') {
-            line_num++;
+    return find_literal_scalar(pattern, data, size, pos);
+}
+
+TARGET_SSE42
+static size_t find_literal_case_sse42(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->folded;
+    size_t n = pattern->pattern_len;
+    unsigned char first_byte = (unsigned char)needle[0];
+    unsigned char last_byte = (unsigned char)needle[n - 1];
+
+    const __m128i first = _mm_set1_epi8((char)first_byte);
+    const __m128i last = _mm_set1_epi8((char)last_byte);
+    const __m128i first_fold = _mm_set1_epi8((unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8((unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+
+    while (size >= n && pos + n - 1 + 16 <= size) {
+        __m128i block_first = _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + pos)), first_fold);
+        __m128i block_last = _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + pos + n - 1)), last_fold);
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (n <= 2 || ascii_case_equal(data + pos + bit + 1, needle + 1, n - 2)) {
+                return pos + bit;
+            }
+            mask &= mask - 1;
         }
-        pos++;
+
+        pos += 16;
     }
 
-    return matches->count > 0;
+    return find_literal_scalar(pattern, data, size, pos);
 }
-#endif
 
-#ifdef __AVX2__
-#include <immintrin.h>
-
-int search_pattern_avx2(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+TARGET_SSE42
+int search_pattern_sse42(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
     if (!pattern || !data || !matches || pattern->pattern_len == 0) return 0;
-    if (pattern->pattern_len > 32) {
-        return search_pattern_ascii(pattern, data, size, matches);
+
+    if (pattern->case_insensitive) {
+        return collect_literal_matches(pattern, data, size, matches, find_literal_case_sse42);
     }
+    return collect_literal_matches(pattern, data, size, matches, find_literal_sse42);
+}
 
-    __m256i pattern_vec = _mm256_loadu_si256((const __m256i*)pattern->pattern);
-    size_t pos = 0;
-    size_t line_num = 1;
-
-    while (pos + 32 <= size) {
-        __m256i data_vec = _mm256_loadu_si256((const __m256i*)(data + pos));
-        __m256i cmp = _mm256_cmpeq_epi8(data_vec, pattern_vec);
-
-        unsigned mask = _mm256_movemask_epi8(cmp);
-
-        if (mask != 0) {
-            for (int i = 0; i < 32; i++) {
-                if (mask & (1 << i)) {
-                    if (pos + i + pattern->pattern_len <= size) {
-                        if (memcmp(data + pos + i, pattern->pattern, pattern->pattern_len) == 0) {
-                            matchlist_add(matches, pos + i, pos + i + pattern->pattern_len, line_num);
-                        }
-                    }
-                }
+TARGET_AVX2
+static size_t find_literal_avx2(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->pattern;
+    size_t n = pattern->pattern_len;
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+
+    while (size >= n && pos + n - 1 + 32 <= size) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(data + pos));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(data + pos + n - 1));
+
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (n <= 2 || memcmp(data + pos + bit + 1, needle + 1, n - 2) == 0) {
+                return pos + bit;
             }
+            mask &= mask - 1;
         }
 
-        for (int i = 0; i < 32 && pos + i < size; i++) {
-            if (data[pos + i] == '\n') {
-                line_num++;
+        pos += 32;
+    }
+
+    return find_literal_scalar(pattern, data, size, pos);
+}
+
+TARGET_AVX2
+static size_t find_literal_case_avx2(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->folded;
+    size_t n = pattern->pattern_len;
+    unsigned char first_byte = (unsigned char)needle[0];
+    unsigned char last_byte = (unsigned char)needle[n - 1];
+
+    const __m256i first = _mm256_set1_epi8((char)first_byte);
+    const __m256i last = _mm256_set1_epi8((char)last_byte);
+    const __m256i first_fold = _mm256_set1_epi8((unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m256i last_fold = _mm256_set1_epi8((unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+
+    while (size >= n && pos + n - 1 + 32 <= size) {
+        __m256i block_first = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(data + pos)), first_fold);
+        __m256i block_last = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(data + pos + n - 1)), last_fold);
+
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (n <= 2 || ascii_case_equal(data + pos + bit + 1, needle + 1, n - 2)) {
+                return pos + bit;
             }
+            mask &= mask - 1;
         }
 
         pos += 32;
     }
 
-    while (pos < size) {
-        if (pattern_match_ascii(pattern, data, size, pos)) {
-            matchlist_add(matches, pos, pos + pattern->pattern_len, line_num);
+    return find_literal_scalar(pattern, data, size, pos);
+}
+
+TARGET_AVX2
+int search_pattern_avx2(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || pattern->pattern_len == 0) return 0;
+
+    if (pattern->case_insensitive) {
+        return collect_literal_matches(pattern, data, size, matches, find_literal_case_avx2);
+    }
+    return collect_literal_matches(pattern, data, size, matches, find_literal_avx2);
+}
+
+/*
+ * 64-byte kernels. The final partial block is handled with a lane mask:
+ * masked loads never fault on the lanes they skip, so there is no scalar
+ * epilogue and no read past the end of the buffer.
+ */
+static inline __mmask64 tail_lanes(size_t remaining) {
+    return remaining >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << remaining) - 1);
+}
+
+TARGET_AVX512
+static size_t find_literal_avx512(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->pattern;
+    size_t n = pattern->pattern_len;
+    if (size < n) return size;
+
+    const __m512i first = _mm512_set1_epi8(needle[0]);
+    const __m512i last = _mm512_set1_epi8(needle[n - 1]);
+    size_t last_start = size - n;
+
+    while (pos <= last_start) {
+        __mmask64 lanes = tail_lanes(last_start - pos + 1);
+        __m512i block_first = _mm512_maskz_loadu_epi8(lanes, data + pos);
+        __m512i block_last = _mm512_maskz_loadu_epi8(lanes, data + pos + n - 1);
+
+        uint64_t mask = _mm512_mask_cmpeq_epi8_mask(_mm512_mask_cmpeq_epi8_mask(lanes, block_first, first),
+                                                    block_last, last);
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctzll(mask);
+            if (n <= 2 || memcmp(data + pos + bit + 1, needle + 1, n - 2) == 0) {
+                return pos + bit;
+            }
+            mask &= mask - 1;
         }
-        if (data[pos] == '\n') {
-            line_num++;
+
+        pos += 64;
+    }
+
+    return size;
+}
+
+TARGET_AVX512
+static size_t find_literal_case_avx512(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    const char* needle = pattern->folded;
+    size_t n = pattern->pattern_len;
+    if (size < n) return size;
+
+    unsigned char first_byte = (unsigned char)needle[0];
+    unsigned char last_byte = (unsigned char)needle[n - 1];
+
+    const __m512i first = _mm512_set1_epi8((char)first_byte);
+    const __m512i last = _mm512_set1_epi8((char)last_byte);
+    const __m512i first_fold = _mm512_set1_epi8((unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m512i last_fold = _mm512_set1_epi8((unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+    size_t last_start = size - n;
+
+    while (pos <= last_start) {
+        __mmask64 lanes = tail_lanes(last_start - pos + 1);
+        __m512i block_first = _mm512_or_si512(_mm512_maskz_loadu_epi8(lanes, data + pos), first_fold);
+        __m512i block_last = _mm512_or_si512(_mm512_maskz_loadu_epi8(lanes, data + pos + n - 1), last_fold);
+
+        uint64_t mask = _mm512_mask_cmpeq_epi8_mask(_mm512_mask_cmpeq_epi8_mask(lanes, block_first, first),
+                                                    block_last, last);
+
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctzll(mask);
+            if (n <= 2 || ascii_case_equal(data + pos + bit + 1, needle + 1, n - 2)) {
+                return pos + bit;
+            }
+            mask &= mask - 1;
         }
-        pos++;
+
+        pos += 64;
     }
 
-    return matches->count > 0;
+    return size;
+}
+
+TARGET_AVX512
+int search_pattern_avx512(const Pattern* pattern, const char* data, size_t size, MatchList* matches) {
+    if (!pattern || !data || !matches || pattern->pattern_len == 0) return 0;
+
+    if (pattern->case_insensitive) {
+        return collect_literal_matches(pattern, data, size, matches, find_literal_case_avx512);
+    }
+    return collect_literal_matches(pattern, data, size, matches, find_literal_avx512);
 }
 #endif
 
-int is_simd_available(void) {
-#ifdef __SSE4_2__
-    return 1;
-#elif defined(__AVX2__)
-    return 1;
-#else
-    return 0;
+/* Best literal kernel compiled in; used by the regex prefilter. */
+static size_t find_literal_fast(const Pattern* pattern, const char* data, size_t size, size_t pos) {
+    if (pattern->two_way) {
+        return two_way_find(pattern->two_way, data, size, pos);
+    }
+
+#ifdef CPU_X86
+    switch (kernel_active()) {
+        case KERNEL_AVX512:
+            return pattern->case_insensitive ? find_literal_case_avx512(pattern, data, size, pos)
+                                             : find_literal_avx512(pattern, data, size, pos);
+        case KERNEL_AVX2:
+            return pattern->case_insensitive ? find_literal_case_avx2(pattern, data, size, pos)
+                                             : find_literal_avx2(pattern, data, size, pos);
+        case KERNEL_SSE42:
+            return pattern->case_insensitive ? find_literal_case_sse42(pattern, data, size, pos)
+                                             : find_literal_sse42(pattern, data, size, pos);
+        default:
+            break;
+    }
 #endif
-}
\ No newline at end of file
+    return find_literal_scalar(pattern, data, size, pos);
+}
+
+int is_simd_available(void) {
+    return kernel_active() != KERNEL_SCALAR;
+}
@@ -1,186 +1,356 @@
 #include "../include/search.h"
+#include "../include/line_scan.h"
 #include <stdlib.h>
 #include <string.h>
 
-TaskQueue* taskqueue_create(void) {
-    TaskQueue* queue = (TaskQueue*)malloc(sizeof(TaskQueue));
-    if (!queue) return NULL;
-
-    queue->tasks = NULL;
-    queue->count = 0;
-    queue->capacity = 0;
-    queue->next_task = 0;
+/* Defaults match the library: every occurrence, no highlight spans. */
+void search_options_init(SearchOptions* options) {
+    if (!options) return;
+
+    options->mode = MATCH_MODE_ALL;
+    options->highlight = 0;
+    options->invert = 0;
+    options->limit = 0;
+    options->stop_on_match = 0;
+    options->skip_binary = 0;
+    options->binary_summary = 0;
+}
 
-    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
-        free(queue);
-        return NULL;
-    }
+int search_single_file(const Pattern* pattern, const FileData* file, MatchList* matches) {
+    if (!pattern || !file || !matches) return 0;
 
-    return queue;
+    return search_pattern(pattern, file->data, file->size, matches);
 }
 
-void taskqueue_free(TaskQueue* queue) {
-    if (!queue) return;
-
-    if (queue->tasks) {
-        free(queue->tasks);
+/* Inverted line records are gaps; this is how many lines they select. */
+static size_t gap_lines(const char* data, const MatchList* matches) {
+    size_t lines = 0;
+    for (size_t i = 0; i < matches->count; i++) {
+        const Match* gap = &matches->matches[i];
+        if (gap->end > gap->start) {
+            lines += line_count_newlines(data, gap->start, gap->end) + (data[gap->end - 1] != '\n');
+        }
     }
-
-    pthread_mutex_destroy(&queue->mutex);
-    free(queue);
+    return lines;
 }
 
-int taskqueue_add(TaskQueue* queue, const Pattern* pattern, const FileData* file, int file_index) {
-    if (!queue || !pattern || !file) return 0;
+/*
+ * Searches a reader window by window with one reused list. Windows are
+ * whole lines, so each one is searched as its own buffer; only the limit
+ * and -q carry over from one window to the next. Binary inputs are told
+ * apart on the first window. Returns 0 if reading failed.
+ */
+int search_stream(const Pattern* pattern, ChunkReader* reader, const SearchOptions* options,
+                  StreamCallback callback, void* userdata, size_t* selected) {
+    if (!pattern || !reader || !options) return 0;
+
+    MatchList* matches = matchlist_create();
+    if (!matches) return 0;
+
+    size_t total = 0;
+    int done = 0;
+    while (!done && chunk_reader_next(reader)) {
+        MatchMode mode = options->mode;
+        size_t limit = options->limit;
+        if (reader->is_binary && options->skip_binary) break;
+        if (reader->is_binary && options->binary_summary) {
+            mode = MATCH_MODE_COUNT;
+            limit = 1;
+        }
 
-    if (queue->count >= queue->capacity) {
-        size_t new_capacity = queue->capacity == 0 ? 16 : queue->capacity * 2;
-        SearchTask* new_tasks = (SearchTask*)realloc(queue->tasks, sizeof(SearchTask) * new_capacity);
-        if (!new_tasks) return 0;
+        matchlist_clear(matches);
+        matchlist_set_mode(matches, mode, options->highlight);
+        matchlist_set_invert(matches, options->invert);
+        matchlist_set_limit(matches, limit > 0 ? limit - total : 0);
+        search_pattern(pattern, reader->data, reader->size, matches);
+
+        size_t found = matches->count;
+        if (matches->invert && mode == MATCH_MODE_LINES) {
+            found = gap_lines(reader->data, matches);
+            if (matches->limit > 0 && found > matches->limit) {
+                found = matches->limit;
+            }
+        }
+        total += found;
 
-        queue->tasks = new_tasks;
-        queue->capacity = new_capacity;
+        if (callback && !callback(reader->data, reader->size, reader->first_line, matches, userdata)) {
+            done = 1;
+        }
+        if ((limit > 0 && total >= limit) || (options->stop_on_match && total > 0)) {
+            done = 1;
+        }
     }
 
-    queue->tasks[queue->count].pattern = pattern;
-    queue->tasks[queue->count].file = file;
-    queue->tasks[queue->count].matches = matchlist_create();
-    if (!queue->tasks[queue->count].matches) {
-        return 0;
+    matchlist_free(matches);
+    if (selected) {
+        *selected = total;
     }
-    queue->tasks[queue->count].file_index = file_index;
-    queue->count++;
-
-    return 1;
+    return !reader->error;
 }
 
-SearchTask* taskqueue_get_next(TaskQueue* queue) {
-    if (!queue) return NULL;
-
-    pthread_mutex_lock(&queue->mutex);
+typedef enum {
+    BLOCK_FREE,
+    BLOCK_READY,
+    BLOCK_DONE
+} BlockState;
+
+typedef struct {
+    char* buffer;
+    size_t capacity;
+    size_t size;
+    size_t newlines;
+    size_t found;
+    MatchList* matches;
+    BlockState state;
+} StreamBlock;
+
+/*
+ * Blocks form a ring indexed by sequence number: the reader fills the
+ * next free slot, workers search READY blocks in order of arrival, and
+ * whichever worker finds the oldest block DONE prints the run of finished
+ * blocks from there, so output keeps the input order. One condition
+ * variable covers every wait.
+ */
+typedef struct {
+    const Pattern* pattern;
+    const SearchOptions* options;
+    StreamCallback callback;
+    void* userdata;
+    MatchMode mode;
+    size_t limit;
+    int count_lines;
+
+    StreamBlock* blocks;
+    size_t block_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    size_t next_read;
+    size_t next_search;
+    size_t next_output;
+    int eof;
+    int stop;
+    int draining;
+
+    /* Owned by the draining worker. */
+    size_t total;
+    size_t first_line;
+} StreamPipeline;
+
+static void stream_search_block(StreamPipeline* pipeline, StreamBlock* block) {
+    MatchList* matches = block->matches;
+
+    matchlist_clear(matches);
+    matchlist_set_mode(matches, pipeline->mode, pipeline->options->highlight);
+    matchlist_set_invert(matches, pipeline->options->invert);
+    matchlist_set_limit(matches, pipeline->limit);
+    search_pattern(pipeline->pattern, block->buffer, block->size, matches);
+
+    block->found = matches->count;
+    if (matches->invert && pipeline->mode == MATCH_MODE_LINES) {
+        block->found = gap_lines(block->buffer, matches);
+    }
+    block->newlines = pipeline->count_lines ? line_count_newlines(block->buffer, 0, block->size) : 0;
+}
 
-    if (queue->next_task >= queue->count) {
-        pthread_mutex_unlock(&queue->mutex);
-        return NULL;
+/*
+ * Hands one block to the callback in order, cutting it down to what the
+ * limit leaves. Returns 0 once nothing more is wanted.
+ */
+static int stream_emit_block(StreamPipeline* pipeline, StreamBlock* block) {
+    MatchList* matches = block->matches;
+    size_t found = block->found;
+
+    if (pipeline->limit > 0) {
+        size_t room = pipeline->limit - pipeline->total;
+        if (found > room) {
+            found = room;
+            if (!matches->invert && matches->mode != MATCH_MODE_COUNT) {
+                matches->count = room;
+            }
+        }
+        /* Inverted gaps are cut while printing. */
+        matchlist_set_limit(matches, room);
     }
+    pipeline->total += found;
 
-    SearchTask* task = &queue->tasks[queue->next_task++];
-    pthread_mutex_unlock(&queue->mutex);
+    int keep_going = !pipeline->callback ||
+                     pipeline->callback(block->buffer, block->size, pipeline->first_line, matches, pipeline->userdata);
+    pipeline->first_line += block->newlines;
 
-    return task;
+    return keep_going && !(pipeline->limit > 0 && pipeline->total >= pipeline->limit) &&
+           !(pipeline->options->stop_on_match && pipeline->total > 0);
 }
 
-SearchContext* search_context_create(size_t num_threads) {
-    SearchContext* context = (SearchContext*)malloc(sizeof(SearchContext));
-    if (!context) return NULL;
+/* Called with the mutex held; prints finished blocks unless another worker already is. */
+static void stream_drain(StreamPipeline* pipeline) {
+    if (pipeline->draining) return;
 
-    context->queue = NULL;
-    context->threads = NULL;
-    context->num_threads = num_threads > 0 ? num_threads : 1;
-    context->files_searched = 0;
-    context->total_matches = 0;
+    pipeline->draining = 1;
+    while (!pipeline->stop) {
+        StreamBlock* block = &pipeline->blocks[pipeline->next_output % pipeline->block_count];
+        if (pipeline->next_output == pipeline->next_read || block->state != BLOCK_DONE) break;
 
-    if (pthread_mutex_init(&context->result_mutex, NULL) != 0) {
-        free(context);
-        return NULL;
-    }
+        pthread_mutex_unlock(&pipeline->mutex);
+        int keep_going = stream_emit_block(pipeline, block);
+        pthread_mutex_lock(&pipeline->mutex);
 
-    context->threads = (pthread_t*)malloc(sizeof(pthread_t) * context->num_threads);
-    if (!context->threads) {
-        pthread_mutex_destroy(&context->result_mutex);
-        free(context);
-        return NULL;
-    }
+        if (!keep_going) {
+            pipeline->stop = 1;
+        }
 
-    return context;
+        block->state = BLOCK_FREE;
+        pipeline->next_output++;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pipeline->draining = 0;
 }
 
-void search_context_free(SearchContext* context) {
-    if (!context) return;
+static void* stream_worker(void* arg) {
+    StreamPipeline* pipeline = (StreamPipeline*)arg;
 
-    if (context->threads) {
-        free(context->threads);
-    }
-
-    pthread_mutex_destroy(&context->result_mutex);
-    free(context);
-}
+    pthread_mutex_lock(&pipeline->mutex);
+    for (;;) {
+        while (!pipeline->stop && !pipeline->eof && pipeline->next_search == pipeline->next_read) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+        }
+        if (pipeline->stop || pipeline->next_search == pipeline->next_read) break;
 
-void* search_worker(void* arg) {
-    SearchContext* context = (SearchContext*)arg;
-    if (!context || !context->queue) return NULL;
+        StreamBlock* block = &pipeline->blocks[pipeline->next_search++ % pipeline->block_count];
+        pthread_mutex_unlock(&pipeline->mutex);
 
-    SearchTask* task;
-    while ((task = taskqueue_get_next(context->queue)) != NULL) {
-        search_pattern(task->pattern, task->file->data, task->file->size, task->matches);
+        stream_search_block(pipeline, block);
 
-        pthread_mutex_lock(&context->result_mutex);
-        context->files_searched++;
-        context->total_matches += task->matches->count;
-        pthread_mutex_unlock(&context->result_mutex);
+        pthread_mutex_lock(&pipeline->mutex);
+        block->state = BLOCK_DONE;
+        stream_drain(pipeline);
+        pthread_cond_broadcast(&pipeline->changed);
     }
+    pthread_mutex_unlock(&pipeline->mutex);
 
     return NULL;
 }
 
-int search_context_run(SearchContext* context, TaskQueue* queue) {
-    if (!context || !queue) return 0;
-
-    context->queue = queue;
-
-    for (size_t i = 0; i < context->num_threads; i++) {
-        if (pthread_create(&context->threads[i], NULL, search_worker, context) != 0) {
-            return 0;
-        }
+static void stream_pipeline_free(StreamPipeline* pipeline) {
+    for (size_t i = 0; i < pipeline->block_count; i++) {
+        free(pipeline->blocks[i].buffer);
+        matchlist_free(pipeline->blocks[i].matches);
     }
-
-    for (size_t i = 0; i < context->num_threads; i++) {
-        pthread_join(context->threads[i], NULL);
-    }
-
-    return 1;
+    free(pipeline->blocks);
+    pthread_cond_destroy(&pipeline->changed);
+    pthread_mutex_destroy(&pipeline->mutex);
 }
 
-int search_single_file(const Pattern* pattern, const FileData* file, MatchList* matches) {
-    if (!pattern || !file || !matches) return 0;
+/*
+ * search_stream() with the windows searched by num_threads workers. The
+ * calling thread only reads: each window's buffer is swapped out of the
+ * reader into a ring slot, so nothing is copied, and two slots per worker
+ * keep the workers busy while a slow block holds up the output. Lines
+ * are numbered as blocks are printed, from newline counts the workers
+ * take, so the reader doesn't count them itself.
+ */
+int search_stream_parallel(const Pattern* pattern, ChunkReader* reader, const SearchOptions* options,
+                           size_t num_threads, StreamCallback callback, void* userdata, size_t* selected) {
+    if (!pattern || !reader || !options) return 0;
+    if (num_threads <= 1) {
+        return search_stream(pattern, reader, options, callback, userdata, selected);
+    }
 
-    return search_pattern(pattern, file->data, file->size, matches);
-}
+    StreamPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.pattern = pattern;
+    pipeline.options = options;
+    pipeline.callback = callback;
+    pipeline.userdata = userdata;
+    pipeline.mode = options->mode;
+    pipeline.limit = options->limit;
+    pipeline.count_lines = reader->count_lines;
+    pipeline.first_line = reader->first_line;
+    pipeline.block_count = num_threads * 2;
+    pthread_mutex_init(&pipeline.mutex, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    pipeline.blocks = (StreamBlock*)calloc(pipeline.block_count, sizeof(StreamBlock));
+    int ok = pipeline.blocks != NULL;
+    for (size_t i = 0; ok && i < pipeline.block_count; i++) {
+        pipeline.blocks[i].capacity = reader->window_size;
+        pipeline.blocks[i].buffer = (char*)malloc(reader->window_size);
+        pipeline.blocks[i].matches = matchlist_create();
+        ok = pipeline.blocks[i].buffer && pipeline.blocks[i].matches;
+    }
+    if (!ok) {
+        if (!pipeline.blocks) pipeline.block_count = 0;
+        stream_pipeline_free(&pipeline);
+        return 0;
+    }
 
-int search_multiple_files(const Pattern* pattern, const FileList* files, size_t num_threads, MatchList*** results) {
-    if (!pattern || !files || !results) return 0;
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+    size_t started = 0;
+    while (threads && started < num_threads &&
+           pthread_create(&threads[started], NULL, stream_worker, &pipeline) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        free(threads);
+        stream_pipeline_free(&pipeline);
+        return search_stream(pattern, reader, options, callback, userdata, selected);
+    }
 
-    TaskQueue* queue = taskqueue_create();
-    if (!queue) return 0;
+    reader->count_lines = 0;
+    for (;;) {
+        pthread_mutex_lock(&pipeline.mutex);
+        StreamBlock* block = &pipeline.blocks[pipeline.next_read % pipeline.block_count];
+        while (!pipeline.stop && block->state != BLOCK_FREE) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.mutex);
+        }
+        int stop = pipeline.stop;
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        if (stop || !chunk_reader_next(reader)) break;
+
+        /* Settled on the first window, before any worker looks at the mode. */
+        if (reader->offset == 0 && reader->is_binary) {
+            if (options->skip_binary) break;
+            if (options->binary_summary) {
+                pipeline.mode = MATCH_MODE_COUNT;
+                pipeline.limit = 1;
+            }
+        }
 
-    for (size_t i = 0; i < files->count; i++) {
-        if (!taskqueue_add(queue, pattern, files->files[i], (int)i)) {
-            taskqueue_free(queue);
-            return 0;
+        size_t capacity = block->capacity;
+        size_t size = reader->size;
+        char* window = chunk_reader_swap(reader, block->buffer, &capacity);
+        if (!window) {
+            reader->error = 1;
+            break;
         }
-    }
 
-    SearchContext* context = search_context_create(num_threads);
-    if (!context) {
-        taskqueue_free(queue);
-        return 0;
+        pthread_mutex_lock(&pipeline.mutex);
+        block->buffer = window;
+        block->capacity = capacity;
+        block->size = size;
+        block->state = BLOCK_READY;
+        pipeline.next_read++;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.mutex);
     }
+    reader->count_lines = pipeline.count_lines;
 
-    int success = search_context_run(context, queue);
+    /* Let the workers finish what was read; they print it and exit. */
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.eof = 1;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.mutex);
 
-    *results = (MatchList**)malloc(sizeof(MatchList*) * queue->count);
-    if (!*results) {
-        search_context_free(context);
-        taskqueue_free(queue);
-        return 0;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
     }
+    free(threads);
 
-    for (size_t i = 0; i < queue->count; i++) {
-        (*results)[i] = queue->tasks[i].matches;
+    if (selected) {
+        *selected = pipeline.total;
     }
-
-    search_context_free(context);
-    taskqueue_free(queue);
-
+    int success = !reader->error;
+    stream_pipeline_free(&pipeline);
     return success;
-}
\ No newline at end of file
+}
@@ -0,0 +1,300 @@
+#include "../include/two_way.h"
+#include "../include/cpu_dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static inline unsigned char ascii_fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+/*
+ * Computes the critical factorization of the needle as the later of the
+ * maximal suffixes under < and >. Returns the split point and stores the
+ * local period in *period.
+ */
+static size_t critical_factorization(const unsigned char* needle, size_t len, size_t* period) {
+    size_t max_suffix = SIZE_MAX;
+    size_t j = 0;
+    size_t k = 1;
+    size_t p = 1;
+
+    while (j + k < len) {
+        unsigned char a = needle[j + k];
+        unsigned char b = needle[max_suffix + k];
+        if (a < b) {
+            j += k;
+            k = 1;
+            p = j - max_suffix;
+        } else if (a == b) {
+            if (k != p) {
+                k++;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            max_suffix = j++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+
+    size_t max_suffix_rev = SIZE_MAX;
+    j = 0;
+    k = p = 1;
+    while (j + k < len) {
+        unsigned char a = needle[j + k];
+        unsigned char b = needle[max_suffix_rev + k];
+        if (b < a) {
+            j += k;
+            k = 1;
+            p = j - max_suffix_rev;
+        } else if (a == b) {
+            if (k != p) {
+                k++;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            max_suffix_rev = j++;
+            k = p = 1;
+        }
+    }
+
+    if (max_suffix_rev + 1 < max_suffix + 1) {
+        return max_suffix + 1;
+    }
+    *period = p;
+    return max_suffix_rev + 1;
+}
+
+TwoWay* two_way_create(const char* needle, size_t len, int case_insensitive) {
+    if (!needle || len == 0) return NULL;
+
+    TwoWay* tw = (TwoWay*)malloc(sizeof(TwoWay));
+    if (!tw) return NULL;
+
+    tw->needle = (unsigned char*)malloc(len);
+    if (!tw->needle) {
+        free(tw);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)needle[i];
+        tw->needle[i] = case_insensitive ? ascii_fold(c) : c;
+    }
+    tw->len = len;
+    tw->case_insensitive = case_insensitive;
+
+    tw->suffix = critical_factorization(tw->needle, len, &tw->period);
+    tw->periodic = memcmp(tw->needle, tw->needle + tw->period, tw->suffix) == 0;
+    if (!tw->periodic) {
+        size_t left = tw->suffix;
+        size_t right = len - tw->suffix;
+        tw->period = (left > right ? left : right) + 1;
+    }
+
+    for (size_t c = 0; c < 256; c++) {
+        tw->shift[c] = len;
+    }
+    for (size_t i = 0; i + 1 < len; i++) {
+        tw->shift[tw->needle[i]] = len - i - 1;
+    }
+    tw->shift[tw->needle[len - 1]] = 0;
+
+    if (case_insensitive) {
+        for (int c = 'A'; c <= 'Z'; c++) {
+            tw->shift[c] = tw->shift[c | 0x20];
+        }
+    }
+
+    return tw;
+}
+
+void two_way_free(TwoWay* tw) {
+    if (!tw) return;
+
+    free(tw->needle);
+    free(tw);
+}
+
+static inline unsigned char hay_byte(const TwoWay* tw, const unsigned char* hay, size_t i) {
+    return tw->case_insensitive ? ascii_fold(hay[i]) : hay[i];
+}
+
+#ifdef CPU_X86
+#include <immintrin.h>
+
+/* Vector skips: advance to the first alignment whose first and last bytes match, or to the tail. */
+TARGET_AVX2
+static size_t skip_avx2(const TwoWay* tw, const unsigned char* hay, size_t j, size_t last) {
+    unsigned char first_byte = tw->needle[0];
+    unsigned char last_byte = tw->needle[tw->len - 1];
+    size_t tail = tw->len - 1;
+
+    const __m256i first = _mm256_set1_epi8((char)first_byte);
+    const __m256i lastv = _mm256_set1_epi8((char)last_byte);
+    const __m256i first_fold = _mm256_set1_epi8(tw->case_insensitive && (unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m256i last_fold = _mm256_set1_epi8(tw->case_insensitive && (unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+
+    while (j + 31 <= last) {
+        __m256i block_first = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(hay + j)), first_fold);
+        __m256i block_last = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(hay + j + tail)), last_fold);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, lastv)));
+        if (mask != 0) {
+            return j + (size_t)__builtin_ctz(mask);
+        }
+        j += 32;
+    }
+    return j;
+}
+
+TARGET_AVX512
+static size_t skip_avx512(const TwoWay* tw, const unsigned char* hay, size_t j, size_t last) {
+    unsigned char first_byte = tw->needle[0];
+    unsigned char last_byte = tw->needle[tw->len - 1];
+    size_t tail = tw->len - 1;
+
+    const __m512i first = _mm512_set1_epi8((char)first_byte);
+    const __m512i lastv = _mm512_set1_epi8((char)last_byte);
+    const __m512i first_fold = _mm512_set1_epi8(tw->case_insensitive && (unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m512i last_fold = _mm512_set1_epi8(tw->case_insensitive && (unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+
+    while (j + 63 <= last) {
+        __m512i block_first = _mm512_or_si512(_mm512_loadu_si512((const void*)(hay + j)), first_fold);
+        __m512i block_last = _mm512_or_si512(_mm512_loadu_si512((const void*)(hay + j + tail)), last_fold);
+        uint64_t mask = _mm512_mask_cmpeq_epi8_mask(_mm512_cmpeq_epi8_mask(block_first, first), block_last, lastv);
+        if (mask != 0) {
+            return j + (size_t)__builtin_ctzll(mask);
+        }
+        j += 64;
+    }
+    return j;
+}
+
+TARGET_SSE42
+static size_t skip_sse42(const TwoWay* tw, const unsigned char* hay, size_t j, size_t last) {
+    unsigned char first_byte = tw->needle[0];
+    unsigned char last_byte = tw->needle[tw->len - 1];
+    size_t tail = tw->len - 1;
+
+    const __m128i first = _mm_set1_epi8((char)first_byte);
+    const __m128i lastv = _mm_set1_epi8((char)last_byte);
+    const __m128i first_fold = _mm_set1_epi8(tw->case_insensitive && (unsigned char)(first_byte - 'a') < 26 ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8(tw->case_insensitive && (unsigned char)(last_byte - 'a') < 26 ? 0x20 : 0);
+
+    while (j + 15 <= last) {
+        __m128i block_first = _mm_or_si128(_mm_loadu_si128((const __m128i*)(hay + j)), first_fold);
+        __m128i block_last = _mm_or_si128(_mm_loadu_si128((const __m128i*)(hay + j + tail)), last_fold);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, lastv)));
+        if (mask != 0) {
+            return j + (size_t)__builtin_ctz(mask);
+        }
+        j += 16;
+    }
+    return j;
+}
+#endif
+
+/*
+ * Smallest alignment at or after j whose first and last bytes match the
+ * needle, or last + 1. Alignments skipped here cannot match, so jumping to
+ * the result never breaks Two-Way's linear bound.
+ */
+static size_t next_candidate(const TwoWay* tw, const unsigned char* hay, size_t j, size_t last, KernelLevel level) {
+    unsigned char first_byte = tw->needle[0];
+    unsigned char last_byte = tw->needle[tw->len - 1];
+    size_t tail = tw->len - 1;
+
+    if (j <= last && hay_byte(tw, hay, j) == first_byte && hay_byte(tw, hay, j + tail) == last_byte) {
+        return j;
+    }
+
+#ifdef CPU_X86
+    if (level == KERNEL_AVX512) {
+        j = skip_avx512(tw, hay, j, last);
+        j = skip_avx2(tw, hay, j, last);
+    } else if (level == KERNEL_AVX2) {
+        j = skip_avx2(tw, hay, j, last);
+    } else if (level == KERNEL_SSE42) {
+        j = skip_sse42(tw, hay, j, last);
+    }
+#endif
+
+    /* Without vectors the Horspool shift on the last byte does the skipping. */
+    if (level == KERNEL_SCALAR) {
+        while (j <= last) {
+            size_t shift = tw->shift[hay[j + tail]];
+            if (shift == 0 && hay_byte(tw, hay, j) == first_byte) {
+                return j;
+            }
+            j += shift ? shift : 1;
+        }
+    }
+
+    for (; j <= last; j++) {
+        if (hay_byte(tw, hay, j) == first_byte && hay_byte(tw, hay, j + tail) == last_byte) {
+            return j;
+        }
+    }
+    return last + 1;
+}
+
+/*
+ * Two-Way search. Candidate alignments come from next_candidate(); each
+ * one is verified right half first, then left half, and a mismatch shifts
+ * by the amount the critical factorization allows, which keeps the worst
+ * case linear. Periodic needles remember how much of the left half is
+ * already known to match. Returns the first match at or after pos, or
+ * size if there is none.
+ */
+size_t two_way_find(const TwoWay* tw, const char* data, size_t size, size_t pos) {
+    if (!tw || !data || size < tw->len || pos > size - tw->len) return size;
+
+    const unsigned char* hay = (const unsigned char*)data;
+    const unsigned char* needle = tw->needle;
+    size_t len = tw->len;
+    size_t suffix = tw->suffix;
+    size_t period = tw->period;
+    size_t last = size - len;
+    size_t memory = 0;
+    size_t j = pos;
+    KernelLevel level = kernel_active();
+
+    while (j <= last) {
+        size_t candidate = next_candidate(tw, hay, j, last, level);
+        if (candidate > last) break;
+        if (candidate != j) {
+            memory = 0;
+            j = candidate;
+        }
+
+        size_t i = suffix > memory ? suffix : memory;
+        while (i < len && needle[i] == hay_byte(tw, hay, i + j)) {
+            i++;
+        }
+        if (i < len) {
+            j += i - suffix + 1;
+            memory = 0;
+            continue;
+        }
+
+        i = suffix;
+        while (i > memory && needle[i - 1] == hay_byte(tw, hay, i - 1 + j)) {
+            i--;
+        }
+        if (i <= memory) {
+            return j;
+        }
+
+        j += period;
+        memory = tw->periodic ? len - period : 0;
+    }
+
+    return size;
+}
@@ -0,0 +1,555 @@
+#include "../include/uring_reader.h"
+#include "../include/binary_detect.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+
+/*
+ * A minimal io_uring over the raw syscalls: the submission and completion
+ * rings are shared with the kernel, so the tail we publish and the tail
+ * we read are ordered with release/acquire atomics.
+ */
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    unsigned to_submit;
+    unsigned in_flight;
+} Ring;
+
+/* Enters that fail with EAGAIN, or EBUSY with nothing to reap, before the ring gives up. */
+#define RING_ENTER_RETRIES 8
+
+static void ring_free(Ring* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+static int ring_supports(int fd, const int* ops, size_t op_count) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (!probe) return 0;
+
+    int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < op_count; i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static int ring_setup(Ring* ring, unsigned entries) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return 0;
+    ring->fd = fd;
+
+    static const int ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+    if (!ring_supports(fd, ops, sizeof(ops) / sizeof(ops[0]))) {
+        ring_free(ring);
+        return 0;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        ring_free(ring);
+        return 0;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            ring_free(ring);
+            return 0;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ring_free(ring);
+        return 0;
+    }
+
+    char* sq = (char*)ring->sq_ring;
+    char* cq = (char*)ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+static int ring_cq_ready(const Ring* ring) {
+    return __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head;
+}
+
+/*
+ * Hands queued entries to the kernel and waits for at least wait_for
+ * completions. EBUSY means the completion ring is full: with completions
+ * waiting this returns 1 so the caller reaps them before entering again.
+ * EAGAIN (no kernel memory for the requests) is retried a few times and
+ * then reported as a failure, which drains the ring.
+ */
+static int ring_enter(Ring* ring, unsigned wait_for) {
+    for (unsigned retries = 0;;) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_for,
+                               wait_for > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            ring->to_submit = (unsigned)ret >= ring->to_submit ? 0 : ring->to_submit - (unsigned)ret;
+            return 1;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EBUSY && ring_cq_ready(ring)) return 1;
+        if ((errno != EAGAIN && errno != EBUSY) || ++retries > RING_ENTER_RETRIES) return 0;
+    }
+}
+
+/* Free submission entries, after handing the queued ones to the kernel if the ring is full. */
+static unsigned ring_space(Ring* ring) {
+    unsigned used = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (used == ring->sq_entries && ring_enter(ring, 0)) {
+        used = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    }
+    return ring->sq_entries - used;
+}
+
+static struct io_uring_sqe* ring_get_sqe(Ring* ring) {
+    if (ring_space(ring) == 0) return NULL;
+
+    unsigned index = *ring->sq_tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+static void ring_queue(Ring* ring) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    ring->in_flight++;
+}
+
+/* user_data: the file slot in the high bits, the operation in the low two. */
+enum { OP_OPEN, OP_STAT, OP_READ, OP_CLOSE };
+#define SLOT_NONE 0xFFFFFFu
+
+typedef struct {
+    size_t file_index;
+    int busy;
+    int fd;
+    int open_res;
+    int stat_res;
+    int waiting;
+    size_t size;
+    size_t done;
+    struct statx stx;
+} Slot;
+
+/* A ring kept across calls; set broken once an enter failed and the ring was torn down. */
+struct UringReader {
+    Ring ring;
+    int broken;
+};
+
+typedef struct {
+    Ring* ring;
+    FileData** files;
+    size_t max_size;
+    ReadStatus* statuses;
+    int* errors;
+    Slot slots[URING_MAX_FILES];
+    size_t active;
+    /* Files are sized against max_bytes in index order; from the first that doesn't fit, all are deferred. */
+    size_t max_bytes;
+    size_t reserved;
+    size_t next_admit;
+    int deferring;
+    /* Set once an enter has failed: completions are only collected, nothing new is queued. */
+    int draining;
+} Batch;
+
+static void batch_close_fd(Batch* batch, int fd) {
+    struct io_uring_sqe* sqe = ring_get_sqe(batch->ring);
+    if (!sqe) {
+        close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = ((__u64)SLOT_NONE << 2) | OP_CLOSE;
+    ring_queue(batch->ring);
+}
+
+static void batch_finish(Batch* batch, Slot* slot, ReadStatus status, int error) {
+    batch->statuses[slot->file_index] = status;
+    batch->errors[slot->file_index] = error;
+    if (slot->fd >= 0) {
+        batch_close_fd(batch, slot->fd);
+    }
+    slot->busy = 0;
+    batch->active--;
+}
+
+static void batch_fail(Batch* batch, Slot* slot, ReadStatus status, int error) {
+    FileData* file = batch->files[slot->file_index];
+    free(file->data);
+    file->data = NULL;
+    file->size = 0;
+    batch_finish(batch, slot, status, error);
+}
+
+static int batch_queue_read(Batch* batch, Slot* slot) {
+    struct io_uring_sqe* sqe = ring_get_sqe(batch->ring);
+    if (!sqe) return 0;
+
+    FileData* file = batch->files[slot->file_index];
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (__u64)(uintptr_t)(file->data + slot->done);
+    sqe->len = (__u32)(slot->size - slot->done);
+    sqe->off = slot->done;
+    sqe->user_data = ((__u64)(slot - batch->slots) << 2) | OP_READ;
+    ring_queue(batch->ring);
+    return 1;
+}
+
+/* Both the open and the statx are back and every earlier file is decided: check the file and queue its read. */
+static void batch_opened(Batch* batch, Slot* slot) {
+    if (batch->deferring) {
+        batch_finish(batch, slot, READ_DEFERRED, 0);
+        return;
+    }
+    if (slot->open_res < 0) {
+        batch_finish(batch, slot, READ_ERROR_OPEN, -slot->open_res);
+        return;
+    }
+    if (slot->stat_res < 0) {
+        batch_finish(batch, slot, READ_ERROR_STAT, -slot->stat_res);
+        return;
+    }
+    if (S_ISDIR(slot->stx.stx_mode)) {
+        batch_finish(batch, slot, READ_ERROR_DIRECTORY, EISDIR);
+        return;
+    }
+
+    FileData* file = batch->files[slot->file_index];
+    slot->size = (size_t)slot->stx.stx_size;
+    /* The first file always goes, so a batch moves even when one file fills the budget. */
+    if (batch->max_bytes > 0 && slot->file_index > 0 && batch->reserved + slot->size > batch->max_bytes) {
+        batch->deferring = 1;
+        batch_finish(batch, slot, READ_DEFERRED, 0);
+        return;
+    }
+    batch->reserved += slot->size;
+    if (slot->size > batch->max_size) {
+        /* The caller maps it from this descriptor rather than opening it again. */
+        file->fd = slot->fd;
+        file->size = slot->size;
+        slot->fd = -1;
+        batch_finish(batch, slot, READ_ERROR_UNSUPPORTED, 0);
+        return;
+    }
+
+    file->data = (char*)malloc(slot->size + 1);
+    if (!file->data) {
+        batch_finish(batch, slot, READ_ERROR_MEMORY, ENOMEM);
+        return;
+    }
+    file->size = slot->size;
+    file->data[slot->size] = '\0';
+    file->is_mapped = 0;
+
+    if (slot->size == 0) {
+        batch_finish(batch, slot, READ_SUCCESS, 0);
+    } else if (!batch_queue_read(batch, slot)) {
+        batch_fail(batch, slot, READ_ERROR_OPEN, EAGAIN);
+    }
+}
+
+/* Opens complete out of order; files are decided in index order so the deferred ones are a suffix. */
+static void batch_admit(Batch* batch) {
+    for (;;) {
+        Slot* slot = NULL;
+        for (size_t i = 0; i < URING_MAX_FILES && !slot; i++) {
+            if (batch->slots[i].busy && batch->slots[i].file_index == batch->next_admit) {
+                slot = &batch->slots[i];
+            }
+        }
+        if (!slot || slot->waiting > 0) return;
+
+        batch->next_admit++;
+        batch_opened(batch, slot);
+    }
+}
+
+static void batch_complete(Batch* batch, __u64 user_data, int res) {
+    unsigned op = (unsigned)(user_data & 3);
+    size_t index = (size_t)(user_data >> 2);
+    if (op == OP_CLOSE || index >= URING_MAX_FILES) return;
+
+    Slot* slot = &batch->slots[index];
+    /* After a failed enter the file stays busy; only an fd that turns up needs closing. */
+    if (batch->draining) {
+        if (op == OP_OPEN && res >= 0) close(res);
+        return;
+    }
+    if (op == OP_OPEN || op == OP_STAT) {
+        if (op == OP_OPEN) {
+            slot->open_res = res;
+            slot->fd = res >= 0 ? res : -1;
+        } else {
+            slot->stat_res = res;
+        }
+        if (--slot->waiting == 0) {
+            batch_admit(batch);
+        }
+        return;
+    }
+
+    /* A read that comes up short (the file shrank) fails like file_read() does. */
+    if (res <= 0) {
+        batch_fail(batch, slot, READ_ERROR_OPEN, res < 0 ? -res : EIO);
+        return;
+    }
+    slot->done += (size_t)res;
+    if (slot->done < slot->size) {
+        if (!batch_queue_read(batch, slot)) {
+            batch_fail(batch, slot, READ_ERROR_OPEN, EAGAIN);
+        }
+        return;
+    }
+
+    FileData* file = batch->files[slot->file_index];
+    file->is_binary = binary_detect(file->data, file->size);
+    batch_finish(batch, slot, READ_SUCCESS, 0);
+}
+
+/* Queues the open and statx of the next file; both go out with the next enter. */
+static int batch_start(Batch* batch, size_t file_index) {
+    Slot* slot = NULL;
+    for (size_t i = 0; i < URING_MAX_FILES && !slot; i++) {
+        if (!batch->slots[i].busy) {
+            slot = &batch->slots[i];
+        }
+    }
+    if (!slot || ring_space(batch->ring) < 2) return 0;
+
+    memset(slot, 0, sizeof(*slot));
+    slot->file_index = file_index;
+    slot->busy = 1;
+    slot->fd = -1;
+    slot->waiting = 2;
+    batch->active++;
+
+    const char* path = batch->files[file_index]->filepath;
+    __u64 tag = (__u64)(slot - batch->slots) << 2;
+
+    struct io_uring_sqe* sqe = ring_get_sqe(batch->ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (__u64)(uintptr_t)path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = tag | OP_OPEN;
+    ring_queue(batch->ring);
+
+    sqe = ring_get_sqe(batch->ring);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (__u64)(uintptr_t)path;
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = (__u64)(uintptr_t)&slot->stx;
+    sqe->user_data = tag | OP_STAT;
+    ring_queue(batch->ring);
+    return 1;
+}
+
+static void batch_reap(Batch* batch) {
+    Ring* ring = batch->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+        __u64 user_data = cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        ring->in_flight--;
+
+        batch_complete(batch, user_data, res);
+    }
+}
+
+int uring_reader_available(void) {
+    Ring ring;
+    if (!ring_setup(&ring, 4)) return 0;
+    ring_free(&ring);
+    return 1;
+}
+
+UringReader* uring_reader_create(void) {
+    UringReader* reader = (UringReader*)calloc(1, sizeof(UringReader));
+    if (!reader) return NULL;
+    if (!ring_setup(&reader->ring, URING_ENTRIES)) {
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void uring_reader_free(UringReader* reader) {
+    if (!reader) return;
+    if (!reader->broken) {
+        ring_free(&reader->ring);
+    }
+    free(reader);
+}
+
+int uring_read_files(UringReader* reader, FileData** files, size_t count, size_t max_size, size_t max_bytes,
+                     ReadStatus* statuses, int* errors) {
+    if (!reader || reader->broken || !files || !statuses || !errors) return 0;
+
+    Batch* batch = (Batch*)calloc(1, sizeof(Batch));
+    if (!batch) return 0;
+    batch->ring = &reader->ring;
+    batch->files = files;
+    batch->max_size = max_size;
+    batch->max_bytes = max_bytes;
+    batch->statuses = statuses;
+    batch->errors = errors;
+
+    /* Each file in flight holds at most two entries, so the completion ring never overflows. */
+    size_t next = 0;
+    int ok = 1;
+    while (ok && (next < count || batch->ring->in_flight > 0)) {
+        while (next < count && !batch->deferring && batch->active < URING_MAX_FILES &&
+               batch->ring->in_flight + 2 <= batch->ring->sq_entries && batch_start(batch, next)) {
+            next++;
+        }
+
+        ok = ring_enter(batch->ring, batch->ring->in_flight > 0 ? 1 : 0);
+        batch_reap(batch);
+    }
+
+    /*
+     * Closing the ring neither waits for nor cancels what was submitted, so
+     * after a failed enter the outstanding completions are reaped first:
+     * a pending read would otherwise land in a buffer freed below, and a
+     * late open would leak its fd. Should waiting fail as well, the read
+     * buffers and the batch (statx writes into its slots) are leaked
+     * rather than freed under the kernel.
+     */
+    batch->draining = !ok;
+    while (!ok && batch->ring->in_flight > 0 && ring_enter(batch->ring, 1)) {
+        batch_reap(batch);
+    }
+    int settled = batch->ring->in_flight == 0;
+
+    /* A ring whose enter failed is not trusted again: later calls fall back to file_read(). */
+    if (!ok) {
+        ring_free(batch->ring);
+        reader->broken = 1;
+    }
+
+    /* Unfinished files go back to the caller. */
+    for (size_t i = 0; i < URING_MAX_FILES; i++) {
+        Slot* slot = &batch->slots[i];
+        if (!slot->busy) continue;
+        FileData* file = files[slot->file_index];
+        if (settled) free(file->data);
+        file->data = NULL;
+        file->size = 0;
+        statuses[slot->file_index] = READ_ERROR_UNSUPPORTED;
+        if (slot->fd >= 0) close(slot->fd);
+    }
+    for (size_t i = next; i < count; i++) {
+        statuses[i] = batch->deferring ? READ_DEFERRED : READ_ERROR_UNSUPPORTED;
+    }
+
+    if (settled) free(batch);
+    return 1;
+}
+
+#else
+
+int uring_reader_available(void) {
+    return 0;
+}
+
+UringReader* uring_reader_create(void) {
+    return NULL;
+}
+
+void uring_reader_free(UringReader* reader) {
+    (void)reader;
+}
+
+int uring_read_files(UringReader* reader, FileData** files, size_t count, size_t max_size, size_t max_bytes,
+                     ReadStatus* statuses, int* errors) {
+    (void)reader;
+    (void)files;
+    (void)count;
+    (void)max_size;
+    (void)max_bytes;
+    (void)statuses;
+    (void)errors;
+    return 0;
+}
+
+#endif
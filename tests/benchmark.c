@@ -0,0 +1,177 @@
+#include "../include/regex_simd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DATA_SIZE (64 * 1024 * 1024)
+#define BENCH_RUNS 3
+#define BENCH_REGEX_SIZE (16 * 1024 * 1024)
+
+typedef int (*SearchFn)(const Pattern* pattern, const char* data, size_t size, MatchList* matches);
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Log-like text drawn from a small vocabulary, so long needles share many prefixes with the data. */
+static char* make_data(size_t size) {
+    static const char* words[] = {
+        "ERROR", "WARN", "INFO", "request", "timeout", "user", "id=", "Connection", "reset",
+        "java.lang.IllegalStateException:", "at", "com.example.service.", "Handler", "0x7f3a",
+        "550e8400-e29b-41d4-a716-446655440000", "retry", "after", "ms", "failed"
+    };
+    char* data = (char*)malloc(size);
+    if (!data) return NULL;
+
+    unsigned seed = 12345;
+    size_t pos = 0;
+    size_t line = 0;
+    while (pos < size) {
+        seed = seed * 1103515245 + 12345;
+        const char* word = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+        size_t len = strlen(word);
+        if (pos + len + 1 >= size) break;
+
+        memcpy(data + pos, word, len);
+        pos += len;
+        line += len;
+        data[pos++] = line > 100 ? '\n' : ' ';
+        if (line > 100) line = 0;
+    }
+    memset(data + pos, '\n', size - pos);
+    return data;
+}
+
+static double time_search(SearchFn fn, const Pattern* pattern, const char* data, size_t size, size_t* count) {
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        MatchList* matches = matchlist_create();
+        double start = now_ms();
+        fn(pattern, data, size, matches);
+        double elapsed = now_ms() - start;
+        *count = matches->count;
+        matchlist_free(matches);
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static void bench_long_needles(const char* data, size_t size) {
+    static const char* base =
+        "java.lang.IllegalStateException: Connection reset after retry request timeout "
+        "550e8400-e29b-41d4-a716-446655440000 com.example.service.Handler failed after 3 retries";
+    static const size_t lengths[] = {16, 32, 40, 48, 64, 96, 128, 160};
+
+    printf("Literal search, %zu MB, best of %d runs (ms), %s kernel\n", size >> 20, BENCH_RUNS,
+           kernel_name(kernel_active()));
+    printf("%6s %10s %10s %10s %10s\n", "len", "scalar", "packed", "two-way", "auto");
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        char needle[256];
+        memcpy(needle, base, lengths[i]);
+        needle[lengths[i]] = '\0';
+
+        Pattern* pattern = pattern_create(needle, 0, 0);
+        if (!pattern) continue;
+
+        size_t count;
+        double scalar = time_search(search_pattern_ascii, pattern, data, size, &count);
+
+        double packed = -1;
+#ifdef CPU_X86
+        if (kernel_active() == KERNEL_AVX512) {
+            packed = time_search(search_pattern_avx512, pattern, data, size, &count);
+        } else if (kernel_active() == KERNEL_AVX2) {
+            packed = time_search(search_pattern_avx2, pattern, data, size, &count);
+        } else if (kernel_active() == KERNEL_SSE42) {
+            packed = time_search(search_pattern_sse42, pattern, data, size, &count);
+        }
+#endif
+
+        TwoWay* own = NULL;
+        if (!pattern->two_way) {
+            own = pattern->two_way = two_way_create(needle, lengths[i], 0);
+        }
+        double two_way = time_search(search_pattern_two_way, pattern, data, size, &count);
+        if (own) {
+            two_way_free(own);
+            pattern->two_way = NULL;
+        }
+
+        double automatic = time_search(search_pattern, pattern, data, size, &count);
+
+        printf("%6zu %10.1f %10.1f %10.1f %10.1f\n", lengths[i], scalar, packed, two_way, automatic);
+        pattern_free(pattern);
+    }
+}
+
+static double mb_per_s(size_t size, double ms) {
+    return ms > 0 ? (size / (1024.0 * 1024.0)) / (ms / 1000.0) : 0;
+}
+
+/*
+ * Regex engines on the same pattern with the required-literal prefilter
+ * detached, so every byte goes through the engine being measured.
+ */
+static void bench_regex_engines(const char* data, size_t size) {
+    static const char* patterns[] = {
+        "0x[0-9a-f]+ (ms|after)",
+        "(WARN|INFO) [a-z]+ [0-9]",
+        "[A-Z][a-z]+ [a-z]+$",
+        "Connection (reset|refused).*retry",
+        "[0-9a-f]{8}-[0-9a-f]{4}-[0-9a-f]{4}",
+    };
+
+    printf("\nRegex engines, %zu MB, best of %d runs (MB/s)\n", size >> 20, BENCH_RUNS);
+    printf("%-40s %10s %10s %10s %10s\n", "pattern", "regexec", "dfa", "jit", "matches");
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        Pattern* pattern = pattern_create(patterns[i], 0, 1);
+        if (!pattern || !pattern->dfa) {
+            pattern_free(pattern);
+            continue;
+        }
+
+        Pattern* prefilter = pattern->prefilter;
+        pattern->prefilter = NULL;
+
+        size_t regexec_count, dfa_count, jit_count;
+        RegexDFA* dfa = pattern->dfa;
+        pattern->dfa = NULL;
+        double regexec_ms = time_search(search_pattern_regex, pattern, data, size, &regexec_count);
+        pattern->dfa = dfa;
+
+        double dfa_ms = time_search(search_pattern_regex, pattern, data, size, &dfa_count);
+
+        double jit_ms = -1;
+        jit_count = dfa_count;
+        if (pattern_enable_jit(pattern)) {
+            jit_ms = time_search(search_pattern_regex, pattern, data, size, &jit_count);
+        }
+
+        printf("%-40s %10.1f %10.1f %10.1f %10zu%s\n", patterns[i], mb_per_s(size, regexec_ms),
+               mb_per_s(size, dfa_ms), jit_ms < 0 ? -1.0 : mb_per_s(size, jit_ms), dfa_count,
+               regexec_count != dfa_count || jit_count != dfa_count ? "  MISMATCH" : "");
+
+        pattern->prefilter = prefilter;
+        pattern_free(pattern);
+    }
+}
+
+int main(void) {
+    size_t size = BENCH_DATA_SIZE;
+    char* data = make_data(size);
+    if (!data) {
+        fprintf(stderr, "benchmark: out of memory\n");
+        return 1;
+    }
+
+    bench_long_needles(data, size);
+    bench_regex_engines(data, BENCH_REGEX_SIZE);
+
+    free(data);
+    return 0;
+}
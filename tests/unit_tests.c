@@ -1,8 +1,21 @@
 #include "../include/regex_simd.h"
 #include "../include/file_reader.h"
+#include "../include/line_scan.h"
+#include "../include/output.h"
+#include "../include/regex_jit.h"
+#include "../include/binary_detect.h"
+#include "../include/chunk_reader.h"
+#include "../include/search.h"
+#include "../include/pipeline.h"
+#include "../include/dir_walker.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 int test_pattern_create(void) {
     Pattern* pattern = pattern_create("hello", 0, 0);
@@ -265,6 +278,1996 @@ int test_pattern_overlapping(void) {
     return 1;
 }
 
+int test_simd_matches_scalar(void) {
+    static const size_t lengths[] = {1, 2, 3, 15, 16, 17, 31, 32, 33, 48, 80};
+    size_t size = 4096;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+
+    unsigned seed = 12345;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (seed >> 16) % 7 == 0 ? '\n' : "ab"[(seed >> 8) & 1];
+    }
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        char needle[128];
+        memcpy(needle, data + 1000, lengths[l]);
+        needle[lengths[l]] = '\0';
+
+        Pattern* pattern = pattern_create(needle, 0, 0);
+        MatchList* scalar = matchlist_create();
+        MatchList* simd = matchlist_create();
+        if (!pattern || !scalar || !simd) {
+            printf("FAILED: allocation failed\n");
+            pattern_free(pattern);
+            matchlist_free(scalar);
+            matchlist_free(simd);
+            free(data);
+            return 0;
+        }
+
+        search_pattern_ascii(pattern, data, size, scalar);
+        search_pattern(pattern, data, size, simd);
+
+        int same = scalar->count == simd->count && scalar->count > 0;
+        for (size_t i = 0; same && i < scalar->count; i++) {
+            same = scalar->matches[i].start == simd->matches[i].start &&
+                   scalar->matches[i].end == simd->matches[i].end &&
+                   scalar->matches[i].line_num == simd->matches[i].line_num;
+        }
+
+        pattern_free(pattern);
+        matchlist_free(scalar);
+        matchlist_free(simd);
+
+        if (!same) {
+            printf("FAILED: SIMD and scalar results differ for length %zu\n", lengths[l]);
+            free(data);
+            return 0;
+        }
+    }
+
+    free(data);
+    printf("PASSED: test_simd_matches_scalar\n");
+    return 1;
+}
+
+int test_simd_case_matches_scalar(void) {
+    static const size_t lengths[] = {1, 2, 5, 16, 17, 33, 64};
+    size_t size = 4096;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+
+    unsigned seed = 777;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "aAbB@`\n"[(seed >> 16) % 7];
+    }
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        char needle[128];
+        for (size_t i = 0; i < lengths[l]; i++) {
+            char c = data[2000 + i];
+            needle[i] = (i % 2) ? (char)toupper((unsigned char)c) : (char)tolower((unsigned char)c);
+        }
+        needle[lengths[l]] = '\0';
+
+        Pattern* pattern = pattern_create(needle, 1, 0);
+        MatchList* scalar = matchlist_create();
+        MatchList* simd = matchlist_create();
+        if (!pattern || !scalar || !simd) {
+            printf("FAILED: allocation failed\n");
+            pattern_free(pattern);
+            matchlist_free(scalar);
+            matchlist_free(simd);
+            free(data);
+            return 0;
+        }
+
+        search_pattern_ascii(pattern, data, size, scalar);
+        search_pattern(pattern, data, size, simd);
+
+        int same = scalar->count == simd->count && scalar->count > 0;
+        for (size_t i = 0; same && i < scalar->count; i++) {
+            same = scalar->matches[i].start == simd->matches[i].start &&
+                   scalar->matches[i].line_num == simd->matches[i].line_num;
+        }
+
+        pattern_free(pattern);
+        matchlist_free(scalar);
+        matchlist_free(simd);
+
+        if (!same) {
+            printf("FAILED: case-insensitive SIMD and scalar results differ for length %zu\n", lengths[l]);
+            free(data);
+            return 0;
+        }
+    }
+
+    free(data);
+    printf("PASSED: test_simd_case_matches_scalar\n");
+    return 1;
+}
+
+int test_multi_literal(void) {
+    static const size_t set_sizes[] = {3, 40, 300};
+    size_t size = 8192;
+    char* data = (char*)malloc(size);
+    char** literals = (char**)malloc(sizeof(char*) * 300);
+    if (!data || !literals) {
+        printf("FAILED: malloc returned NULL\n");
+        free(data);
+        free(literals);
+        return 0;
+    }
+
+    unsigned seed = 4242;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "abcdABCD \n"[(seed >> 16) % 10];
+    }
+
+    for (size_t i = 0; i < 300; i++) {
+        size_t len = 2 + i % 9;
+        literals[i] = (char*)malloc(len + 1);
+        memcpy(literals[i], data + (i * 97) % (size - len), len);
+        literals[i][len] = '\0';
+    }
+
+    int ok = 1;
+    for (size_t s = 0; ok && s < sizeof(set_sizes) / sizeof(set_sizes[0]); s++) {
+        for (int ci = 0; ok && ci <= 1; ci++) {
+            Pattern* multi = pattern_create_multi((const char* const*)literals, set_sizes[s], ci, 0);
+            MatchList* matches = matchlist_create();
+            if (!multi || !matches) {
+                pattern_free(multi);
+                matchlist_free(matches);
+                ok = 0;
+                break;
+            }
+
+            if ((set_sizes[s] > TEDDY_MAX_LITERALS) != (multi->type == MATCH_DICT)) {
+                printf("FAILED: wrong engine for %zu literals\n", set_sizes[s]);
+                ok = 0;
+            }
+
+            search_pattern(multi, data, size, matches);
+
+            for (size_t i = 0; ok && i < set_sizes[s]; i++) {
+                Pattern* single = pattern_create(literals[i], ci, 0);
+                MatchList* expected = matchlist_create();
+                search_pattern(single, data, size, expected);
+
+                size_t found = 0;
+                for (size_t m = 0; m < matches->count; m++) {
+                    if (matches->matches[m].pattern_index == i) {
+                        if (found >= expected->count ||
+                            matches->matches[m].start != expected->matches[found].start ||
+                            matches->matches[m].line_num != expected->matches[found].line_num) {
+                            ok = 0;
+                            break;
+                        }
+                        found++;
+                    }
+                }
+                if (found != expected->count) {
+                    ok = 0;
+                }
+
+                if (!ok) {
+                    printf("FAILED: multi-literal mismatch for literal %zu of %zu (ci=%d)\n", i, set_sizes[s], ci);
+                }
+
+                pattern_free(single);
+                matchlist_free(expected);
+            }
+
+            pattern_free(multi);
+            matchlist_free(matches);
+        }
+    }
+
+    for (size_t i = 0; i < 300; i++) {
+        free(literals[i]);
+    }
+    free(literals);
+    free(data);
+
+    if (!ok) return 0;
+
+    /* Regex sets are one alternation: every match reports pattern_index 0, whichever alternative hit. */
+    static const char* regexes[] = {"ab+", "c[0-9]", "abb"};
+    static const Span expected[] = {{1, 4}, {5, 7}, {8, 10}};
+    const char text[] = "xabb c1\nc2\n";
+    Pattern* joined = pattern_create_multi(regexes, 3, 0, 1);
+    MatchList* regex_matches = matchlist_create();
+    if (joined) search_pattern(joined, text, sizeof(text) - 1, regex_matches);
+    ok = joined && regex_matches->count == 3;
+    for (size_t m = 0; ok && m < regex_matches->count; m++) {
+        const Match* match = &regex_matches->matches[m];
+        ok = match->start == expected[m].start && match->end == expected[m].end && match->pattern_index == 0;
+    }
+    pattern_free(joined);
+    matchlist_free(regex_matches);
+    if (!ok) {
+        printf("FAILED: regex pattern set should report pattern_index 0 for every match\n");
+        return 0;
+    }
+
+    printf("PASSED: test_multi_literal\n");
+    return 1;
+}
+
+int test_dictionary_short_entries(void) {
+    enum { LONG_ENTRIES = 400, SIZE = 16384 };
+    static const char* short_entries[] = {"zq", "Q", "ab", "f00d", "e"};
+    const size_t short_count = sizeof(short_entries) / sizeof(short_entries[0]);
+    size_t count = LONG_ENTRIES + short_count;
+    char** entries = (char**)malloc(sizeof(char*) * count);
+    char* data = (char*)malloc(SIZE);
+
+    /* Hex text with no 'z' or 'q', so only the long entries and a few short ones can hit. */
+    unsigned seed = 99;
+    for (size_t i = 0; i < SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "0123456789abcdef \n"[(seed >> 16) % 18];
+    }
+    for (size_t i = 0; i < LONG_ENTRIES; i++) {
+        size_t len = 8 + i % 25;
+        entries[i] = (char*)malloc(len + 1);
+        for (size_t j = 0; j < len; j++) {
+            seed = seed * 1103515245 + 12345;
+            entries[i][j] = "0123456789abcdef"[(seed >> 16) % 16];
+        }
+        entries[i][len] = '\0';
+        if (i % 40 == 0) {
+            memcpy(data + (i * 37) % (SIZE - len), entries[i], len);
+        }
+    }
+    for (size_t i = 0; i < short_count; i++) {
+        entries[LONG_ENTRIES + i] = strdup(short_entries[i]);
+    }
+    memcpy(data + 5000, "zq", 2);
+    memcpy(data + SIZE - 3, "zqQ", 3);
+
+    int ok = 1;
+    for (int ci = 0; ok && ci <= 1; ci++) {
+        Pattern* dict = pattern_create_multi((const char* const*)entries, count, ci, 0);
+        MatchList* matches = matchlist_create();
+        ok = dict && dict->type == MATCH_DICT && dict->dict->key_len == DICTIONARY_KEY_MAX &&
+             dict->dict->short_count == short_count;
+        if (!ok) {
+            printf("FAILED: dictionary layout (ci=%d)\n", ci);
+        }
+
+        /* A short entry mustn't weaken the screen for the long ones: only short leads and rare Bloom hits stop. */
+        size_t candidates = 0;
+        for (size_t pos = 0; ok && (pos = dictionary_find_candidate(dict->dict, data, SIZE, pos)) < SIZE; pos++) {
+            unsigned char c = (unsigned char)(ci ? tolower((unsigned char)data[pos]) : data[pos]);
+            if (c != 'e' && c != 'a' && c != 'f' && c != 'z' && c != 'q') {
+                candidates++;
+            }
+        }
+        if (ok && candidates > SIZE / 50) {
+            printf("FAILED: %zu long-entry candidates in %d bytes (ci=%d)\n", candidates, SIZE, ci);
+            ok = 0;
+        }
+
+        if (ok) search_pattern(dict, data, SIZE, matches);
+        for (size_t i = 0; ok && i < count; i++) {
+            Pattern* single = pattern_create(entries[i], ci, 0);
+            MatchList* expected = matchlist_create();
+            search_pattern(single, data, SIZE, expected);
+
+            size_t found = 0;
+            for (size_t m = 0; ok && m < matches->count; m++) {
+                if (matches->matches[m].pattern_index != i) continue;
+                ok = found < expected->count && matches->matches[m].start == expected->matches[found].start;
+                found++;
+            }
+            /* "zq" and "Q" were planted, the last ones in the final bytes. */
+            ok = ok && found == expected->count && (i < LONG_ENTRIES || i > LONG_ENTRIES + 1 || found > 0);
+            if (!ok) {
+                printf("FAILED: dictionary entry '%s' found %zu times, expected %zu (ci=%d)\n", entries[i], found,
+                       expected->count, ci);
+            }
+
+            pattern_free(single);
+            matchlist_free(expected);
+        }
+
+        pattern_free(dict);
+        matchlist_free(matches);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_dictionary_short_entries\n");
+    return 1;
+}
+
+int test_regex_dfa_matches_regexec(void) {
+    static const char* patterns[] = {
+        "ab|b", "a*", "^a", "b$", "^$", "(a|ab)(c|bcd)", "x?y+", "[a-c]+d", "[^ab]+",
+        "a{2,3}", "(ab){1,}c", "\\.", "[[:digit:]]+", "^(a|b)*$", "c.*a", "(a*)*b", "[]a]",
+        "ab[0-9]*c", "x(ab|cd)y1", "^ab.*1$", "abcd|c", "(^a|b)c|d$"
+    };
+    char data[64];
+    char copy[65];
+    const char alphabet[] = "abcdABxy. 1\n";
+    unsigned seed = 777;
+    int ok = 1;
+
+    for (size_t p = 0; ok && p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (int ci = 0; ok && ci <= 1; ci++) {
+            Pattern* pattern = pattern_create(patterns[p], ci, 1);
+            if (!pattern || !pattern->dfa) {
+                printf("FAILED: no DFA for /%s/\n", patterns[p]);
+                pattern_free(pattern);
+                ok = 0;
+                break;
+            }
+
+            for (int iter = 0; ok && iter < 200; iter++) {
+                seed = seed * 1103515245 + 12345;
+                size_t size = (seed >> 16) % sizeof(data);
+                for (size_t i = 0; i < size; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    data[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+                }
+                memcpy(copy, data, size);
+                copy[size] = '\0';
+
+                MatchList* matches = matchlist_create();
+                search_pattern_regex(pattern, data, size, matches);
+
+                /* Reference: regexec over the NUL-terminated copy, ignoring the phantom line after a final newline. */
+                size_t pos = 0;
+                size_t m = 0;
+                regmatch_t rm;
+                while (pos <= size) {
+                    int eflags = (pos == 0 || copy[pos - 1] == '\n') ? 0 : REG_NOTBOL;
+                    if (regexec(&pattern->regex_compiled, copy + pos, 1, &rm, eflags) != 0) break;
+
+                    size_t start = pos + rm.rm_so;
+                    size_t end = pos + rm.rm_eo;
+                    if (start == size && (size == 0 || copy[size - 1] == '\n')) break;
+
+                    if (m >= matches->count || matches->matches[m].start != start || matches->matches[m].end != end) {
+                        ok = 0;
+                        break;
+                    }
+                    m++;
+                    pos = end > start ? end : start + 1;
+                }
+                if (m != matches->count) {
+                    ok = 0;
+                }
+
+                if (!ok) {
+                    printf("FAILED: DFA and regexec disagree on /%s/ (ci=%d)\n", patterns[p], ci);
+                }
+                matchlist_free(matches);
+            }
+
+            pattern_free(pattern);
+        }
+    }
+
+    if (!ok) return 0;
+
+    Pattern* backref = pattern_create("(a)\\1", 0, 1);
+    if (!backref || backref->dfa) {
+        printf("FAILED: back-reference should fall back to regexec\n");
+        pattern_free(backref);
+        return 0;
+    }
+    pattern_free(backref);
+
+    Pattern* prefiltered = pattern_create("(x|y)*error[0-9]+ms", 0, 1);
+    if (!prefiltered || !prefiltered->prefilter || strcmp(prefiltered->prefilter->pattern, "error") != 0) {
+        printf("FAILED: expected required literal \"error\"\n");
+        pattern_free(prefiltered);
+        return 0;
+    }
+    pattern_free(prefiltered);
+
+    printf("PASSED: test_regex_dfa_matches_regexec\n");
+    return 1;
+}
+
+int test_regex_dfa_long_line(void) {
+    /*
+     * One long line where every position starts a partial match that dies at
+     * the end: trying each start in turn is quadratic (minutes at this size),
+     * so the alarm turns that regression into a failure.
+     */
+    enum { LINE = 200 * 1024 };
+    static const char* patterns[] = {"[a-z]*Z|q", "[a-z]*Z|q$", "(^|b)[a-z]*Z|aq"};
+    char* data = (char*)malloc(LINE + 1);
+    for (size_t i = 0; i < LINE - 1; i++) {
+        data[i] = "abcdefghijklmnoprstuvwxyz"[i % 25];
+    }
+    data[LINE - 2] = 'a';
+    data[LINE - 1] = 'q';
+    data[LINE] = '\n';
+
+    int ok = 1;
+    for (size_t p = 0; ok && p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (int jit = 0; ok && jit <= 1; jit++) {
+            Pattern* pattern = pattern_create(patterns[p], 0, 1);
+            if (!pattern || !pattern->dfa || (jit && (!regex_jit_available() || !pattern_enable_jit(pattern)))) {
+                ok = pattern && pattern->dfa && jit;
+                pattern_free(pattern);
+                continue;
+            }
+
+            MatchList* matches = matchlist_create();
+            alarm(30);
+            search_pattern_regex(pattern, data, LINE + 1, matches);
+            alarm(0);
+            size_t start = p == 2 ? LINE - 2 : LINE - 1;
+            ok = matches->count == 1 && matches->matches[0].start == start && matches->matches[0].end == LINE;
+            if (!ok) {
+                printf("FAILED: /%s/ on a %d-byte line (jit=%d)\n", patterns[p], LINE, jit);
+            }
+            matchlist_free(matches);
+            pattern_free(pattern);
+        }
+    }
+
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_regex_dfa_long_line\n");
+    return 1;
+}
+
+int test_regex_bounded(void) {
+    /* Only the first five bytes belong to the buffer; regexec must not see the rest. */
+    const char data[] = "ab\nabcdef";
+    size_t size = 5;
+
+    Pattern* pattern = pattern_create("\\<ab[a-z]*", 0, 1);
+    if (!pattern || pattern->dfa) {
+        printf("FAILED: expected a regexec-only pattern\n");
+        pattern_free(pattern);
+        return 0;
+    }
+
+    MatchList* matches = matchlist_create();
+    search_pattern_regex(pattern, data, size, matches);
+
+    int ok = matches->count == 2 &&
+             matches->matches[0].start == 0 && matches->matches[0].end == 2 &&
+             matches->matches[1].start == 3 && matches->matches[1].end == 5;
+
+    matchlist_free(matches);
+    pattern_free(pattern);
+
+    if (!ok) {
+        printf("FAILED: regexec matched outside [0, size)\n");
+        return 0;
+    }
+
+    printf("PASSED: test_regex_bounded\n");
+    return 1;
+}
+
+int test_two_way_matches_scalar(void) {
+    size_t size = 16384;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+
+    /* A two-letter alphabet makes periodic needles and near misses common. */
+    unsigned seed = 99;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "abAB\n"[(seed >> 16) % ((i / 4096) % 2 ? 2 : 5)];
+    }
+
+    int ok = 1;
+    for (size_t len = 40; ok && len <= 200; len += 23) {
+        for (int ci = 0; ok && ci <= 1; ci++) {
+            char needle[256];
+            seed = seed * 1103515245 + 12345;
+            memcpy(needle, data + (seed >> 16) % (size - len), len);
+            needle[len] = '\0';
+
+            Pattern* pattern = pattern_create(needle, ci, 0);
+            MatchList* expected = matchlist_create();
+            MatchList* actual = matchlist_create();
+
+            if (!pattern || !pattern->two_way) {
+                printf("FAILED: no two-way matcher for a %zu-byte needle\n", len);
+                ok = 0;
+            } else {
+                search_pattern_ascii(pattern, data, size, expected);
+                search_pattern(pattern, data, size, actual);
+
+                ok = expected->count > 0 && expected->count == actual->count;
+                for (size_t i = 0; ok && i < expected->count; i++) {
+                    ok = expected->matches[i].start == actual->matches[i].start &&
+                         expected->matches[i].line_num == actual->matches[i].line_num;
+                }
+                if (!ok) {
+                    printf("FAILED: two-way mismatch for %zu-byte needle (ci=%d)\n", len, ci);
+                }
+            }
+
+            pattern_free(pattern);
+            matchlist_free(expected);
+            matchlist_free(actual);
+        }
+    }
+
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_two_way_matches_scalar\n");
+    return 1;
+}
+
+int test_kernel_dispatch(void) {
+    static const char* literals[] = {"needle", "haystack", "NeEdLe", "a", "0123456789abcdef0123456789abcdef0123456789"};
+    size_t size = 8192;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+
+    unsigned seed = 31337;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "abcdefhklnestyNEDL0123456789 \n"[(seed >> 16) % 30];
+    }
+    memcpy(data + 4000, literals[4], strlen(literals[4]));
+
+    KernelLevel parsed;
+    if (!kernel_parse(kernel_name(KERNEL_SCALAR), &parsed) || parsed != KERNEL_SCALAR || kernel_parse("mmx", &parsed)) {
+        printf("FAILED: kernel_parse\n");
+        free(data);
+        return 0;
+    }
+
+    KernelLevel original = kernel_active();
+    int ok = 1;
+
+    for (int level = KERNEL_SCALAR; ok && level < KERNEL_COUNT; level++) {
+        if (!cpu_kernel_supported((KernelLevel)level)) continue;
+        kernel_select((KernelLevel)level);
+
+        for (size_t l = 0; ok && l < sizeof(literals) / sizeof(literals[0]); l++) {
+            for (int ci = 0; ok && ci <= 1; ci++) {
+                Pattern* pattern = pattern_create(literals[l], ci, 0);
+                Pattern* multi = pattern_create_multi(literals, sizeof(literals) / sizeof(literals[0]), ci, 0);
+                MatchList* expected = matchlist_create();
+                MatchList* actual = matchlist_create();
+                MatchList* multi_matches = matchlist_create();
+
+                search_pattern_ascii(pattern, data, size, expected);
+                search_pattern(pattern, data, size, actual);
+                search_pattern(multi, data, size, multi_matches);
+
+                ok = expected->count == actual->count;
+                for (size_t i = 0; ok && i < expected->count; i++) {
+                    ok = expected->matches[i].start == actual->matches[i].start;
+                }
+
+                size_t multi_count = 0;
+                for (size_t i = 0; i < multi_matches->count; i++) {
+                    if (multi_matches->matches[i].pattern_index == l) multi_count++;
+                }
+                ok = ok && multi_count == expected->count;
+
+                if (!ok) {
+                    printf("FAILED: %s kernel differs from scalar for '%s' (ci=%d)\n",
+                           kernel_name((KernelLevel)level), literals[l], ci);
+                }
+
+                pattern_free(pattern);
+                pattern_free(multi);
+                matchlist_free(expected);
+                matchlist_free(actual);
+                matchlist_free(multi_matches);
+            }
+        }
+    }
+
+    kernel_select(original);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_kernel_dispatch (up to %s)\n", kernel_name(cpu_detect_kernel()));
+    return 1;
+}
+
+int test_lazy_line_numbers(void) {
+    size_t size = 5000;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+
+    unsigned seed = 4242;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "ab\n"[(seed >> 16) % 3];
+    }
+
+    KernelLevel original = kernel_active();
+    int ok = 1;
+
+    for (int level = KERNEL_SCALAR; ok && level < KERNEL_COUNT; level++) {
+        if (!cpu_kernel_supported((KernelLevel)level)) continue;
+        kernel_select((KernelLevel)level);
+
+        for (size_t from = 0; ok && from < 70; from += 7) {
+            for (size_t to = from; ok && to <= size; to += 1 + to / 3) {
+                size_t expected = 0;
+                for (size_t i = from; i < to; i++) {
+                    expected += data[i] == '\n';
+                }
+                if (line_count_newlines(data, from, to) != expected) {
+                    printf("FAILED: %s newline count over [%zu, %zu)\n", kernel_name((KernelLevel)level), from, to);
+                    ok = 0;
+                }
+            }
+        }
+    }
+    kernel_select(original);
+    free(data);
+    if (!ok) return 0;
+
+    const char text[] = "one\ntwo needle\nthree\nneedle four needle\n";
+    Pattern* pattern = pattern_create("needle", 0, 0);
+    MatchList* matches = matchlist_create();
+    search_pattern(pattern, text, strlen(text), matches);
+
+    char printed[256] = {0};
+    FILE* out = tmpfile();
+    OutputConfig config;
+    output_init(&config);
+    config.output = out;
+    output_set_color(&config, 0);
+    output_set_line_numbers(&config, 1);
+    output_matches(&config, NULL, text, strlen(text), matches);
+    rewind(out);
+    size_t printed_len = fread(printed, 1, sizeof(printed) - 1, out);
+    printed[printed_len] = '\0';
+    fclose(out);
+
+    ok = matches->count == 3 && matches->matches[0].line_num == 0 &&
+         strcmp(printed, "2:two needle\n4:needle four needle\n4:needle four needle\n") == 0;
+
+    matchlist_free(matches);
+    pattern_free(pattern);
+
+    if (!ok) {
+        printf("FAILED: lazy line numbers, got '%s'\n", printed);
+        return 0;
+    }
+
+    printf("PASSED: test_lazy_line_numbers\n");
+    return 1;
+}
+
+static int check_line_records(const char* label, const MatchList* matches, const size_t* lines,
+                              const size_t* spans, size_t line_count) {
+    int ok = matches->count == line_count;
+    for (size_t i = 0; ok && i < line_count; i++) {
+        ok = matches->matches[i].start == lines[2 * i] && matches->matches[i].end == lines[2 * i + 1] &&
+             matches->matches[i].span_count == (matches->highlight ? spans[i] : 0);
+    }
+    if (!ok) {
+        printf("FAILED: line mode records for %s (highlight=%d)\n", label, matches->highlight);
+    }
+    return ok;
+}
+
+int test_line_mode(void) {
+    const char text[] = "ERROR a ERROR b ERROR\nok\nx ERROR ERROR\nERROR ERROR ERROR";
+    const size_t lines[] = {0, 21, 25, 38, 39, 56};
+    const size_t spans[] = {3, 2, 3};
+    const size_t multi_spans[] = {6, 4, 6};
+    const char* literals[] = {"ERROR", "RRO"};
+    size_t size = strlen(text);
+    int ok = 1;
+
+    for (int highlight = 0; ok && highlight <= 1; highlight++) {
+        Pattern* literal = pattern_create("ERROR", 0, 0);
+        Pattern* regex = pattern_create("E[R]+OR", 0, 1);
+        Pattern* multi = pattern_create_multi(literals, 2, 0, 0);
+        MatchList* literal_matches = matchlist_create();
+        MatchList* regex_matches = matchlist_create();
+        MatchList* multi_matches = matchlist_create();
+        matchlist_set_mode(literal_matches, MATCH_MODE_LINES, highlight);
+        matchlist_set_mode(regex_matches, MATCH_MODE_LINES, highlight);
+        matchlist_set_mode(multi_matches, MATCH_MODE_LINES, highlight);
+
+        search_pattern(literal, text, size, literal_matches);
+        search_pattern(regex, text, size, regex_matches);
+        search_pattern(multi, text, size, multi_matches);
+
+        ok = check_line_records("literal", literal_matches, lines, spans, 3) &&
+             check_line_records("regex", regex_matches, lines, spans, 3) &&
+             check_line_records("multi", multi_matches, lines, multi_spans, 3);
+
+        if (ok && highlight) {
+            char printed[256] = {0};
+            FILE* out = tmpfile();
+            OutputConfig config;
+            output_init(&config);
+            config.output = out;
+            output_set_color(&config, 1);
+            output_matches(&config, NULL, text, size, multi_matches);
+            rewind(out);
+            size_t printed_len = fread(printed, 1, sizeof(printed) - 1, out);
+            printed[printed_len] = '\0';
+            fclose(out);
+
+            ok = strcmp(printed, "\033[31mERROR\033[0m a \033[31mERROR\033[0m b \033[31mERROR\033[0m\n"
+                                 "x \033[31mERROR\033[0m \033[31mERROR\033[0m\n"
+                                 "\033[31mERROR\033[0m \033[31mERROR\033[0m \033[31mERROR\033[0m\n") == 0;
+            if (!ok) {
+                printf("FAILED: line mode output '%s'\n", printed);
+            }
+        }
+
+        pattern_free(literal);
+        pattern_free(regex);
+        pattern_free(multi);
+        matchlist_free(literal_matches);
+        matchlist_free(regex_matches);
+        matchlist_free(multi_matches);
+    }
+
+    if (!ok) return 0;
+
+    printf("PASSED: test_line_mode\n");
+    return 1;
+}
+
+int test_word_line_boundaries(void) {
+    const char text[] = "valid id\nid_x id\nid\n(id)";
+    const char* literals[] = {"id", "valid"};
+    size_t size = strlen(text);
+    int ok = 1;
+
+    /* pattern, regex, -w, -x, expected match starts */
+    struct {
+        const char* pattern;
+        int regex;
+        int words;
+        int lines;
+        size_t starts[4];
+        size_t count;
+    } cases[] = {
+        {"id", 0, 1, 0, {6, 14, 17, 21}, 4},
+        {"id", 0, 0, 1, {17}, 1},
+        {"ID", 0, 1, 0, {6, 14, 17, 21}, 4},
+        {"i[a-z]", 1, 1, 0, {6, 14, 17, 21}, 4},
+        {"id(_x)?", 1, 0, 1, {17}, 1},
+        {"[a-z]+ id", 1, 0, 1, {0}, 1},
+    };
+
+    for (size_t c = 0; ok && c < sizeof(cases) / sizeof(cases[0]); c++) {
+        Pattern* pattern = pattern_create(cases[c].pattern, cases[c].pattern[0] == 'I', cases[c].regex);
+        pattern_set_boundaries(pattern, cases[c].words, cases[c].lines);
+        MatchList* matches = matchlist_create();
+        search_pattern(pattern, text, size, matches);
+
+        ok = matches->count == cases[c].count;
+        for (size_t i = 0; ok && i < matches->count; i++) {
+            ok = matches->matches[i].start == cases[c].starts[i];
+        }
+        if (!ok) {
+            printf("FAILED: boundaries for '%s' (-w=%d -x=%d), %zu matches\n", cases[c].pattern,
+                   cases[c].words, cases[c].lines, matches->count);
+        }
+
+        pattern_free(pattern);
+        matchlist_free(matches);
+    }
+
+    if (ok) {
+        Pattern* multi = pattern_create_multi(literals, 2, 0, 0);
+        pattern_set_boundaries(multi, 1, 0);
+        MatchList* matches = matchlist_create();
+        search_pattern(multi, text, size, matches);
+
+        ok = matches->count == 5 && matches->matches[0].start == 0 && matches->matches[0].pattern_index == 1;
+        if (!ok) {
+            printf("FAILED: multi-literal -w, %zu matches\n", matches->count);
+        }
+
+        pattern_free(multi);
+        matchlist_free(matches);
+    }
+
+    /* Regex -w whose first match isn't a word: shorter ends, then later starts (starts from grep -w -o -b). */
+    const char retry_text[] = "ab c_\nx-ab\n";
+    struct {
+        const char* pattern;
+        size_t starts[3];
+        size_t count;
+    } retries[] = {
+        {"[a-z ]+", {0, 6, 8}, 3},
+        {"-?ab", {0, 8}, 2},
+        {".[^a]", {0, 3, 8}, 3},
+    };
+
+    for (size_t c = 0; ok && c < sizeof(retries) / sizeof(retries[0]); c++) {
+        Pattern* pattern = pattern_create(retries[c].pattern, 0, 1);
+        pattern_set_boundaries(pattern, 1, 0);
+
+        /* Once on the DFA and once with it hidden, on regexec. */
+        RegexDFA* dfa = pattern->dfa;
+        for (int pass = 0; ok && pass < 2; pass++) {
+            MatchList* matches = matchlist_create();
+            pattern->dfa = pass == 0 ? dfa : NULL;
+            search_pattern(pattern, retry_text, strlen(retry_text), matches);
+            pattern->dfa = dfa;
+
+            ok = matches->count == retries[c].count;
+            for (size_t i = 0; ok && i < matches->count; i++) {
+                ok = matches->matches[i].start == retries[c].starts[i];
+            }
+            if (!ok) {
+                printf("FAILED: -w retry for '%s', %zu matches\n", retries[c].pattern, matches->count);
+            }
+            matchlist_free(matches);
+        }
+        pattern_free(pattern);
+    }
+
+    if (!ok) return 0;
+
+    printf("PASSED: test_word_line_boundaries\n");
+    return 1;
+}
+
+int test_unicode_case_fold(void) {
+    struct {
+        const char* needle;
+        const char* text;
+        size_t start;
+        size_t end;
+    } cases[] = {
+        {"MÜLLER", "Herr müller kam", 5, 12},
+        {"straße", "STRAẞE 5", 0, 8},
+        {"ŞIŞLI", "şişli", 0, 7},
+        {"ΟΔΥΣΣΕΥΣ", "ο οδυσσευς", 3, 19},
+        {"kelvin", "273 \xE2\x84\xAA" "elvin", 4, 12},
+        {"\xE2\x84\xAA", "5k", 1, 2},
+        {"Ärger", "x\xFFÄrger", 2, 8},
+    };
+    int ok = 1;
+
+    for (size_t c = 0; ok && c < sizeof(cases) / sizeof(cases[0]); c++) {
+        Pattern* pattern = pattern_create(cases[c].needle, 1, 0);
+        MatchList* matches = matchlist_create();
+        search_pattern(pattern, cases[c].text, strlen(cases[c].text), matches);
+
+        ok = pattern->casefold && matches->count == 1 && matches->matches[0].start == cases[c].start &&
+             matches->matches[0].end == cases[c].end;
+        if (!ok) {
+            printf("FAILED: -i '%s' in '%s', %zu matches\n", cases[c].needle, cases[c].text, matches->count);
+        }
+
+        pattern_free(pattern);
+        matchlist_free(matches);
+    }
+
+    /* Turkish dotless i has no simple folding. */
+    Pattern* dotless = pattern_create("ışık", 1, 0);
+    MatchList* none = matchlist_create();
+    search_pattern(dotless, "ISIK isik", 9, none);
+    if (ok && none->count != 0) {
+        printf("FAILED: dotless i matched\n");
+        ok = 0;
+    }
+    pattern_free(dotless);
+    matchlist_free(none);
+    if (!ok) return 0;
+
+    /* Mostly ASCII text with scattered multibyte names, on every kernel. */
+    static const char* pieces[] = {"status ", "Müller ", "MÜLLER ", "\n", "ok ", "straße ", "Ş", "\xE2\x84\xAA",
+                                   "\xC5\xBF", "abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz "};
+    static const char* needles[] = {"müller", "STATUS", "ss", "k", "ş", "STRAẞE", "er sT"};
+    size_t size = 0;
+    char* data = (char*)malloc(200000);
+    if (!data) return 0;
+
+    unsigned seed = 99;
+    while (size < 190000) {
+        seed = seed * 1103515245 + 12345;
+        const char* piece = pieces[(seed >> 16) % 10];
+        memcpy(data + size, piece, strlen(piece));
+        size += strlen(piece);
+    }
+
+    KernelLevel original = kernel_active();
+    for (int level = KERNEL_SCALAR; ok && level < KERNEL_COUNT; level++) {
+        if (!cpu_kernel_supported((KernelLevel)level)) continue;
+        kernel_select((KernelLevel)level);
+
+        for (size_t n = 0; ok && n < sizeof(needles) / sizeof(needles[0]); n++) {
+            Pattern* pattern = pattern_create(needles[n], 1, 0);
+            MatchList* expected = matchlist_create();
+            MatchList* actual = matchlist_create();
+            search_pattern_ascii(pattern, data, size, expected);
+            search_pattern(pattern, data, size, actual);
+
+            ok = expected->count == actual->count && expected->count > 0;
+            for (size_t i = 0; ok && i < expected->count; i++) {
+                ok = expected->matches[i].start == actual->matches[i].start &&
+                     expected->matches[i].end == actual->matches[i].end;
+            }
+            if (!ok) {
+                printf("FAILED: %s case folding differs for '%s' (%zu vs %zu)\n", kernel_name((KernelLevel)level),
+                       needles[n], expected->count, actual->count);
+            }
+
+            pattern_free(pattern);
+            matchlist_free(expected);
+            matchlist_free(actual);
+        }
+    }
+    kernel_select(original);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_unicode_case_fold\n");
+    return 1;
+}
+
+/* Sellers' dynamic program: does some substring of line[0, len) lie within k edits of needle? */
+static int line_within_edits(const char* line, size_t len, const char* needle, size_t m, int k) {
+    size_t column[64];
+    for (size_t i = 0; i <= m; i++) column[i] = i;
+    if (column[m] <= (size_t)k) return 1;
+
+    for (size_t j = 0; j < len; j++) {
+        size_t diagonal = column[0];
+        column[0] = 0;
+        for (size_t i = 1; i <= m; i++) {
+            size_t above = column[i];
+            size_t best = diagonal + (needle[i - 1] != line[j]);
+            if (above + 1 < best) best = above + 1;
+            if (column[i - 1] + 1 < best) best = column[i - 1] + 1;
+            column[i] = best;
+            diagonal = above;
+        }
+        if (column[m] <= (size_t)k) return 1;
+    }
+    return 0;
+}
+
+int test_fuzzy_matches_edit_distance(void) {
+    static const char* needles[] = {"abcab", "abcabcba", "cab", "aabbccaabbcc"};
+    size_t size = 60000;
+    char* data = (char*)malloc(size);
+    if (!data) return 0;
+
+    unsigned seed = 2024;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = "aabbcc\n"[(seed >> 16) % 7];
+    }
+
+    int ok = 1;
+    for (size_t n = 0; ok && n < sizeof(needles) / sizeof(needles[0]); n++) {
+        size_t m = strlen(needles[n]);
+        for (int k = 0; ok && k <= 3 && (size_t)k < m; k++) {
+            Pattern* pattern = pattern_create_fuzzy(needles[n], k, 0);
+            MatchList* matches = matchlist_create();
+            matchlist_set_mode(matches, MATCH_MODE_LINES, 0);
+            search_pattern(pattern, data, size, matches);
+
+            size_t record = 0;
+            size_t line_start = 0;
+            while (ok && line_start < size) {
+                const char* newline = (const char*)memchr(data + line_start, '\n', size - line_start);
+                size_t line_end = newline ? (size_t)(newline - data) : size;
+                int expected = line_within_edits(data + line_start, line_end - line_start, needles[n], m, k);
+                int found = record < matches->count && matches->matches[record].start == line_start;
+
+                if (expected != found) {
+                    printf("FAILED: fuzzy '%s' k=%d on line at %zu: expected %d\n", needles[n], k, line_start, expected);
+                    ok = 0;
+                }
+                record += found;
+                line_start = line_end + 1;
+            }
+            ok = ok && record == matches->count;
+
+            pattern_free(pattern);
+            matchlist_free(matches);
+        }
+    }
+    free(data);
+
+    if (ok) {
+        const char text[] = "db01.example.com\ndb01.exmaple.com\nweb01.example.net";
+        Pattern* pattern = pattern_create_fuzzy("db01.example.com", 2, 0);
+        MatchList* matches = matchlist_create();
+        search_pattern(pattern, text, strlen(text), matches);
+        ok = pattern->prefilter && matches->count == 2 && matches->matches[0].start == 0 &&
+             matches->matches[0].end == 16 && matches->matches[1].start == 17 && matches->matches[1].end == 33;
+        if (!ok) {
+            printf("FAILED: fuzzy hostname spans, %zu matches\n", matches->count);
+        }
+        pattern_free(pattern);
+        matchlist_free(matches);
+    }
+
+    if (!ok) return 0;
+
+    printf("PASSED: test_fuzzy_matches_edit_distance\n");
+    return 1;
+}
+
+int test_regex_jit_matches_interpreter(void) {
+    static const char* patterns[] = {
+        "ab|b", "a*", "^a", "b$", "^$", "(a|ab)(c|bcd)", "x?y+", "[a-c]+d", "[^ab]+", "a{2,3}",
+        "^(a|b)*$", "c.*a", "ab[0-9]*c", "^ab.*1$", "[acxAC1.]+y", "[^\n]", "d.b"
+    };
+    char data[96];
+    const char alphabet[] = "abcdABxy. 1\n\xff";
+    unsigned seed = 4242;
+    int ok = 1;
+
+    if (!regex_jit_available()) {
+        printf("PASSED: test_regex_jit_matches_interpreter (no JIT on this platform)\n");
+        return 1;
+    }
+
+    for (size_t p = 0; ok && p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (int ci = 0; ok && ci <= 1; ci++) {
+            Pattern* interpreted = pattern_create(patterns[p], ci, 1);
+            Pattern* compiled = pattern_create(patterns[p], ci, 1);
+            if (!interpreted || !compiled || !pattern_enable_jit(compiled)) {
+                printf("FAILED: could not JIT /%s/ (ci=%d)\n", patterns[p], ci);
+                pattern_free(interpreted);
+                pattern_free(compiled);
+                return 0;
+            }
+
+            for (int iter = 0; ok && iter < 300; iter++) {
+                seed = seed * 1103515245 + 12345;
+                size_t size = (seed >> 16) % sizeof(data);
+                for (size_t i = 0; i < size; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    data[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+                }
+
+                MatchList* expected = matchlist_create();
+                MatchList* actual = matchlist_create();
+                search_pattern_regex(interpreted, data, size, expected);
+                search_pattern_regex(compiled, data, size, actual);
+
+                ok = expected->count == actual->count;
+                for (size_t m = 0; ok && m < expected->count; m++) {
+                    ok = expected->matches[m].start == actual->matches[m].start &&
+                         expected->matches[m].end == actual->matches[m].end;
+                }
+                if (!ok) {
+                    printf("FAILED: JIT and interpreter disagree on /%s/ (ci=%d): %zu vs %zu matches\n",
+                           patterns[p], ci, actual->count, expected->count);
+                }
+                matchlist_free(expected);
+                matchlist_free(actual);
+            }
+
+            pattern_free(interpreted);
+            pattern_free(compiled);
+        }
+    }
+
+    if (!ok) return 0;
+
+    /* 2^11 states: too many to expand, so the pattern stays on the lazy DFA. */
+    Pattern* large = pattern_create("(a|b)*a(a|b){10}", 0, 1);
+    if (!large || pattern_enable_jit(large) || large->dfa->jit) {
+        printf("FAILED: large automaton should not be compiled\n");
+        pattern_free(large);
+        return 0;
+    }
+    pattern_free(large);
+
+    printf("PASSED: test_regex_jit_matches_interpreter\n");
+    return 1;
+}
+
+int test_count_and_invert_modes(void) {
+    const char text[] = "error one\nok\nerror two error\n\nok again\nlast error";
+    size_t size = strlen(text);
+    static const char* specs[][2] = {{"error", "0"}, {"err[a-z]+", "1"}};
+    int ok = 1;
+
+    for (size_t p = 0; ok && p < sizeof(specs) / sizeof(specs[0]); p++) {
+        Pattern* pattern = pattern_create(specs[p][0], 0, specs[p][1][0] == '1');
+
+        MatchList* count = matchlist_create();
+        size_t capacity = count->capacity;
+        matchlist_set_mode(count, MATCH_MODE_COUNT, 0);
+        search_pattern(pattern, text, size, count);
+        ok = count->count == 3 && count->capacity == capacity;
+
+        MatchList* first = matchlist_create();
+        matchlist_set_mode(first, MATCH_MODE_COUNT, 0);
+        matchlist_set_limit(first, 1);
+        search_pattern(pattern, text, size, first);
+        ok = ok && first->count == 1;
+
+        MatchList* inverted_count = matchlist_create();
+        matchlist_set_mode(inverted_count, MATCH_MODE_COUNT, 0);
+        matchlist_set_invert(inverted_count, 1);
+        search_pattern(pattern, text, size, inverted_count);
+        ok = ok && inverted_count->count == 3;
+
+        /* Gaps: "ok\n" and "\nok again\n", as whole lines between the matching ones. */
+        MatchList* gaps = matchlist_create();
+        matchlist_set_mode(gaps, MATCH_MODE_LINES, 0);
+        matchlist_set_invert(gaps, 1);
+        search_pattern(pattern, text, size, gaps);
+        ok = ok && gaps->count == 2 && gaps->matches[0].start == 10 && gaps->matches[0].end == 13 &&
+             gaps->matches[1].start == 29 && gaps->matches[1].end == 39;
+
+        if (!ok) {
+            printf("FAILED: count/invert modes for /%s/: count %zu, first %zu, inverted %zu, gaps %zu\n",
+                   specs[p][0], count->count, first->count, inverted_count->count, gaps->count);
+        }
+        matchlist_free(count);
+        matchlist_free(first);
+        matchlist_free(inverted_count);
+        matchlist_free(gaps);
+        pattern_free(pattern);
+    }
+
+    if (ok) {
+        const char tail[] = "x\nerror\n";
+        Pattern* pattern = pattern_create("error", 0, 0);
+        MatchList* gaps = matchlist_create();
+        matchlist_set_mode(gaps, MATCH_MODE_LINES, 0);
+        matchlist_set_invert(gaps, 1);
+        search_pattern(pattern, tail, strlen(tail), gaps);
+        ok = gaps->count == 1 && gaps->matches[0].start == 0 && gaps->matches[0].end == 2;
+        if (!ok) {
+            printf("FAILED: inverted search should not select the empty line after a final newline\n");
+        }
+        matchlist_free(gaps);
+        pattern_free(pattern);
+    }
+
+    if (!ok) return 0;
+
+    printf("PASSED: test_count_and_invert_modes\n");
+    return 1;
+}
+
+static int same_records(const MatchList* a, const MatchList* b) {
+    if (a->count != b->count) return 0;
+
+    for (size_t i = 0; i < a->count; i++) {
+        const Match* x = &a->matches[i];
+        const Match* y = &b->matches[i];
+        if (x->start != y->start || x->end != y->end || x->span_count != y->span_count) return 0;
+        for (size_t s = 0; s < x->span_count; s++) {
+            if (a->spans[x->span_index + s].start != b->spans[y->span_index + s].start ||
+                a->spans[x->span_index + s].end != b->spans[y->span_index + s].end) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int test_limit_and_cancel(void) {
+    size_t size = 9 * 1024 * 1024;
+    char* data = (char*)malloc(size);
+    unsigned seed = 99;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = (seed >> 16) % 64;
+        data[i] = r == 0 ? '\n' : (char)('a' + r % 8);
+    }
+
+    Pattern* pattern = pattern_create("ab+c", 0, 1);
+    int ok = 1;
+    int cancel = 0;
+
+    /* Blocked scans (taken when a cancel flag is attached) must give the same records as one pass. */
+    for (int mode = 0; ok && mode < 3; mode++) {
+        MatchList* whole = matchlist_create();
+        MatchList* blocked = matchlist_create();
+        MatchMode match_mode = mode == 2 ? MATCH_MODE_COUNT : MATCH_MODE_LINES;
+        matchlist_set_mode(whole, match_mode, mode == 0);
+        matchlist_set_mode(blocked, match_mode, mode == 0);
+        matchlist_set_invert(whole, mode == 1);
+        matchlist_set_invert(blocked, mode == 1);
+        matchlist_set_cancel(blocked, &cancel);
+
+        search_pattern(pattern, data, size, whole);
+        search_pattern(pattern, data, size, blocked);
+
+        if (mode == 1) {
+            /* Gaps may split at block edges; compare the lines they cover. */
+            size_t a = 0, b = 0;
+            for (size_t i = 0; i < whole->count; i++) a += whole->matches[i].end - whole->matches[i].start;
+            for (size_t i = 0; i < blocked->count; i++) b += blocked->matches[i].end - blocked->matches[i].start;
+            ok = a == b && blocked->count >= whole->count;
+        } else if (mode == 2) {
+            ok = whole->count > 0 && whole->count == blocked->count;
+        } else {
+            ok = whole->count > 0 && same_records(whole, blocked);
+        }
+        if (!ok) {
+            printf("FAILED: blocked scan differs in mode %d: %zu vs %zu\n", mode, blocked->count, whole->count);
+        }
+        matchlist_free(whole);
+        matchlist_free(blocked);
+    }
+
+    if (ok) {
+        MatchList* limited = matchlist_create();
+        matchlist_set_mode(limited, MATCH_MODE_LINES, 1);
+        matchlist_set_limit(limited, 5);
+        search_pattern(pattern, data, size, limited);
+        ok = limited->count == 5;
+
+        MatchList* cancelled = matchlist_create();
+        matchlist_set_mode(cancelled, MATCH_MODE_COUNT, 0);
+        cancel = 1;
+        matchlist_set_cancel(cancelled, &cancel);
+        search_pattern(pattern, data, size, cancelled);
+        ok = ok && cancelled->count == 0;
+
+        if (!ok) {
+            printf("FAILED: limit gave %zu lines, cancelled scan %zu\n", limited->count, cancelled->count);
+        }
+        matchlist_free(limited);
+        matchlist_free(cancelled);
+    }
+
+    pattern_free(pattern);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_limit_and_cancel\n");
+    return 1;
+}
+
+int test_binary_detect(void) {
+    size_t size = BINARY_PROBE_SIZE + 4096;
+    char* data = (char*)malloc(size);
+    if (!data) {
+        printf("FAILED: malloc returned NULL\n");
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        data[i] = "text\n"[i % 5];
+    }
+
+    KernelLevel original = kernel_active();
+    int ok = 1;
+
+    for (int level = KERNEL_SCALAR; ok && level < KERNEL_COUNT; level++) {
+        if (!cpu_kernel_supported((KernelLevel)level)) continue;
+        kernel_select((KernelLevel)level);
+
+        ok = !binary_detect(data, size) && !binary_detect(data, 0);
+
+        /* Every position in the first blocks, every length, then the probe's far edge. */
+        for (size_t pos = 0; ok && pos < 300; pos++) {
+            data[pos] = '\0';
+            for (size_t len = 0; ok && len < 300; len++) {
+                if (binary_detect(data, len) != (pos < len)) {
+                    printf("FAILED: %s NUL at %zu, length %zu\n", kernel_name((KernelLevel)level), pos, len);
+                    ok = 0;
+                }
+            }
+            data[pos] = 't';
+        }
+
+        data[BINARY_PROBE_SIZE - 1] = '\0';
+        ok = ok && binary_detect(data, size);
+        data[BINARY_PROBE_SIZE - 1] = 't';
+        data[BINARY_PROBE_SIZE] = '\0';
+        if (ok && binary_detect(data, size)) {
+            printf("FAILED: %s looked past the probe\n", kernel_name((KernelLevel)level));
+            ok = 0;
+        }
+        data[BINARY_PROBE_SIZE] = 't';
+    }
+    kernel_select(original);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_binary_detect\n");
+    return 1;
+}
+
+static int count_windows(const char* data, size_t size, size_t first_line, const MatchList* matches,
+                         void* userdata) {
+    (void)data;
+    (void)size;
+    (void)first_line;
+    (void)matches;
+    (*(size_t*)userdata)++;
+    return 1;
+}
+
+int test_chunk_reader(void) {
+    /* Short lines, one longer than the window, and no final newline. */
+    size_t size = 20000;
+    char* data = (char*)malloc(size);
+    unsigned seed = 7;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = (seed >> 16) % 16;
+        data[i] = r == 0 ? '\n' : (char)('a' + r % 4);
+    }
+    memset(data + 5000, 'x', 300);
+    data[size - 1] = 'a';
+
+    FILE* tmp = tmpfile();
+    fwrite(data, 1, size, tmp);
+    fflush(tmp);
+
+    ChunkReader* reader = chunk_reader_create(64, 1);
+    chunk_reader_attach(reader, fileno(tmp));
+    lseek(fileno(tmp), 0, SEEK_SET);
+
+    int ok = 1;
+    size_t pos = 0;
+    while (ok && chunk_reader_next(reader)) {
+        size_t expected_line = 1 + line_count_newlines(data, 0, pos);
+        int aligned = reader->data[reader->size - 1] == '\n' || pos + reader->size == size;
+        if (reader->offset != pos || reader->first_line != expected_line || !aligned ||
+            memcmp(reader->data, data + pos, reader->size) != 0) {
+            printf("FAILED: window at %zu (line %zu, expected %zu)\n", pos, reader->first_line, expected_line);
+            ok = 0;
+        }
+        pos += reader->size;
+    }
+    if (ok && (pos != size || reader->error)) {
+        printf("FAILED: windows covered %zu of %zu bytes\n", pos, size);
+        ok = 0;
+    }
+
+    /* Windowed searches give the whole buffer's count, and the limit carries across windows. */
+    Pattern* pattern = pattern_create("abc", 0, 0);
+    SearchOptions options;
+    search_options_init(&options);
+    options.mode = MATCH_MODE_LINES;
+    for (int invert = 0; ok && invert < 2; invert++) {
+        MatchList* whole = matchlist_create();
+        matchlist_set_mode(whole, MATCH_MODE_COUNT, 0);
+        matchlist_set_invert(whole, invert);
+        search_pattern(pattern, data, size, whole);
+
+        size_t selected = 0;
+        size_t windows = 0;
+        options.invert = invert;
+        options.limit = 0;
+        lseek(fileno(tmp), 0, SEEK_SET);
+        chunk_reader_attach(reader, fileno(tmp));
+        ok = search_stream(pattern, reader, &options, count_windows, &windows, &selected) &&
+             selected == whole->count && windows > 1;
+
+        size_t limited = 0;
+        options.limit = 25;
+        lseek(fileno(tmp), 0, SEEK_SET);
+        chunk_reader_attach(reader, fileno(tmp));
+        ok = ok && search_stream(pattern, reader, &options, NULL, NULL, &limited) && limited == 25;
+        if (!ok) {
+            printf("FAILED: streamed %zu lines (limited %zu), whole buffer %zu, invert %d\n", selected, limited,
+                   whole->count, invert);
+        }
+        matchlist_free(whole);
+    }
+
+    pattern_free(pattern);
+    chunk_reader_free(reader);
+    fclose(tmp);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_chunk_reader\n");
+    return 1;
+}
+
+int test_pipe_input(void) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        printf("FAILED: pipe\n");
+        return 0;
+    }
+
+    /* A window must come back as soon as a line is complete, with the writer still open. */
+    ChunkReader* reader = chunk_reader_create(1024, 1);
+    chunk_reader_attach(reader, fds[0]);
+    int ok = write(fds[1], "a hit\npart", 10) == 10 && chunk_reader_next(reader) && reader->size == 6 &&
+             memcmp(reader->data, "a hit\n", 6) == 0;
+    ok = ok && write(fds[1], "ial", 3) == 3;
+    close(fds[1]);
+    ok = ok && chunk_reader_next(reader) && reader->size == 7 && memcmp(reader->data, "partial", 7) == 0 &&
+         reader->first_line == 2 && !chunk_reader_next(reader) && !reader->error;
+    close(fds[0]);
+    chunk_reader_free(reader);
+    if (!ok) {
+        printf("FAILED: pipe windows\n");
+        return 0;
+    }
+
+    if (pipe(fds) != 0) return 0;
+    FileData* file = file_open("(stdin)");
+    ok = write(fds[1], "x\0y\n", 4) == 4;
+    close(fds[1]);
+    ok = ok && file_read_fd(file, fds[0]) == READ_SUCCESS && file->size == 4 && file->is_binary;
+    close(fds[0]);
+    file_close(file);
+    if (!ok) {
+        printf("FAILED: file_read_fd\n");
+        return 0;
+    }
+
+    printf("PASSED: test_pipe_input\n");
+    return 1;
+}
+
+typedef struct {
+    char* text;
+    size_t length;
+    size_t last_line;
+    int ordered;
+} StreamCapture;
+
+/* Appends each record's text; first_line must grow from window to window. */
+static int capture_window(const char* data, size_t size, size_t first_line, const MatchList* matches,
+                          void* userdata) {
+    StreamCapture* capture = (StreamCapture*)userdata;
+    (void)size;
+
+    if (first_line < capture->last_line) {
+        capture->ordered = 0;
+    }
+    capture->last_line = first_line;
+
+    for (size_t i = 0; i < matches->count; i++) {
+        size_t n = matches->matches[i].end - matches->matches[i].start;
+        capture->text = (char*)realloc(capture->text, capture->length + n + 1);
+        memcpy(capture->text + capture->length, data + matches->matches[i].start, n);
+        capture->length += n;
+        /* Line records stop before the newline; inverted gaps are whole lines and may split anywhere. */
+        if (!matches->invert) {
+            capture->text[capture->length++] = '\n';
+        }
+    }
+    return 1;
+}
+
+int test_parallel_stream(void) {
+    size_t size = 200000;
+    char* data = (char*)malloc(size);
+    unsigned seed = 31;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = (seed >> 16) % 24;
+        data[i] = r == 0 ? '\n' : (char)('a' + r % 5);
+    }
+    memset(data + 90000, 'q', 3000);
+
+    FILE* tmp = tmpfile();
+    fwrite(data, 1, size, tmp);
+    fflush(tmp);
+
+    Pattern* pattern = pattern_create("cab", 0, 0);
+    int ok = 1;
+
+    /* Same lines in the same order for any thread count, with and without a limit. */
+    for (int run = 0; ok && run < 4; run++) {
+        SearchOptions options;
+        search_options_init(&options);
+        options.mode = MATCH_MODE_LINES;
+        options.invert = run % 2;
+        options.limit = run >= 2 ? 333 : 0;
+
+        StreamCapture serial = {NULL, 0, 0, 1};
+        StreamCapture parallel = {NULL, 0, 0, 1};
+        size_t serial_count = 0;
+        size_t parallel_count = 0;
+
+        ChunkReader* reader = chunk_reader_create(512, 1);
+        lseek(fileno(tmp), 0, SEEK_SET);
+        chunk_reader_attach(reader, fileno(tmp));
+        search_stream(pattern, reader, &options, capture_window, &serial, &serial_count);
+
+        lseek(fileno(tmp), 0, SEEK_SET);
+        chunk_reader_attach(reader, fileno(tmp));
+        reader->fill = 1;
+        ok = search_stream_parallel(pattern, reader, &options, 4, capture_window, &parallel, &parallel_count) &&
+             parallel.ordered && serial_count > 0 && serial_count == parallel_count &&
+             serial.length == parallel.length && memcmp(serial.text, parallel.text, serial.length) == 0;
+        if (!ok) {
+            printf("FAILED: parallel stream run %d: %zu lines vs %zu\n", run, parallel_count, serial_count);
+        }
+
+        chunk_reader_free(reader);
+        free(serial.text);
+        free(parallel.text);
+    }
+
+    pattern_free(pattern);
+    fclose(tmp);
+    free(data);
+    if (!ok) return 0;
+
+    printf("PASSED: test_parallel_stream\n");
+    return 1;
+}
+
+/* Writes size bytes of a repeating pattern to dir/name and returns the path. */
+static char* write_batch_file(const char* dir, const char* name, size_t size) {
+    char* path = (char*)malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    FILE* f = fopen(path, "wb");
+    for (size_t i = 0; f && i < size; i++) {
+        fputc(i % 61 == 60 ? '\n' : 'a' + (int)(i % 26), f);
+    }
+    if (f) fclose(f);
+    return path;
+}
+
+int test_read_batch(void) {
+    char dir[] = "/tmp/fstgrep_batchXXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("FAILED: mkdtemp\n");
+        return 0;
+    }
+
+    /* Small, empty, too large for a batch, missing, and a directory. */
+    size_t sizes[] = {5000, 0, (size_t)2 << 20};
+    char* paths[5];
+    paths[0] = write_batch_file(dir, "small", sizes[0]);
+    paths[1] = write_batch_file(dir, "empty", sizes[1]);
+    paths[2] = write_batch_file(dir, "large", sizes[2]);
+    paths[3] = write_batch_file(dir, "missing", 0);
+    unlink(paths[3]);
+    paths[4] = (char*)malloc(strlen(dir) + 8);
+    sprintf(paths[4], "%s/subdir", dir);
+    mkdir(paths[4], 0755);
+
+    int ok = 1;
+    ReadBackend backends[] = {READ_BACKEND_SYNC, READ_BACKEND_AUTO};
+    for (int b = 0; b < 2 && ok; b++) {
+        FileData* files[5];
+        ReadStatus statuses[5];
+        int errors[5];
+        for (int i = 0; i < 5; i++) {
+            files[i] = file_open(paths[i]);
+        }
+
+        UringReader* reader = backends[b] == READ_BACKEND_SYNC ? NULL : uring_reader_create();
+        ReadBackend used = file_read_batch(files, 5, reader, 0, statuses, errors);
+        uring_reader_free(reader);
+        if (backends[b] == READ_BACKEND_SYNC && used != READ_BACKEND_SYNC) ok = 0;
+
+        for (int i = 0; i < 3 && ok; i++) {
+            if (statuses[i] != READ_SUCCESS || files[i]->size != sizes[i]) {
+                ok = 0;
+                break;
+            }
+            for (size_t j = 0; j < sizes[i]; j++) {
+                if (files[i]->data[j] != (j % 61 == 60 ? '\n' : 'a' + (int)(j % 26))) {
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+        ok = ok && statuses[3] == READ_ERROR_OPEN && errors[3] == ENOENT && statuses[4] == READ_ERROR_DIRECTORY;
+        if (!ok) {
+            printf("FAILED: batch read (%s)\n", used == READ_BACKEND_URING ? "io_uring" : "sync");
+        }
+
+        for (int i = 0; i < 5; i++) {
+            file_close(files[i]);
+        }
+    }
+
+    /* A budget the first two files fill: the large file and everything after it are left unread. */
+    for (int b = 0; b < 2 && ok; b++) {
+        FileData* files[5];
+        ReadStatus statuses[5];
+        int errors[5];
+        for (int i = 0; i < 5; i++) {
+            files[i] = file_open(paths[i]);
+        }
+
+        UringReader* reader = backends[b] == READ_BACKEND_SYNC ? NULL : uring_reader_create();
+        ReadBackend used = file_read_batch(files, 5, reader, sizes[0], statuses, errors);
+        uring_reader_free(reader);
+
+        ok = statuses[0] == READ_SUCCESS && files[0]->size == sizes[0] && statuses[1] == READ_SUCCESS;
+        for (int i = 2; i < 5 && ok; i++) {
+            ok = statuses[i] == READ_DEFERRED && !files[i]->data && files[i]->fd < 0;
+        }
+        if (!ok) {
+            printf("FAILED: budgeted batch read (%s)\n", used == READ_BACKEND_URING ? "io_uring" : "sync");
+        }
+
+        for (int i = 0; i < 5; i++) {
+            file_close(files[i]);
+        }
+    }
+
+    for (int i = 0; i < 5; i++) {
+        i == 4 ? rmdir(paths[i]) : unlink(paths[i]);
+        free(paths[i]);
+    }
+    rmdir(dir);
+    if (!ok) return 0;
+
+    printf("PASSED: test_read_batch\n");
+    return 1;
+}
+
+typedef struct {
+    char** paths;
+    size_t seen;
+    size_t selected;
+    int ordered;
+    size_t stop_after;
+    /* Holds each callback up this long, as slow output would. */
+    unsigned pause_us;
+} PipelineCapture;
+
+/* Checks files come back in submission order with their own results. */
+static int capture_file(const FileData* file, ReadStatus status, int error, int named, const MatchList* matches,
+                        void* userdata) {
+    PipelineCapture* capture = (PipelineCapture*)userdata;
+    (void)error;
+
+    if (strcmp(file->filepath, capture->paths[capture->seen]) != 0) {
+        capture->ordered = 0;
+    }
+    if (status == READ_SUCCESS) {
+        capture->selected += matches->count;
+    } else if (!named) {
+        capture->ordered = 0;
+    }
+    capture->seen++;
+    if (capture->pause_us > 0) {
+        usleep(capture->pause_us);
+    }
+    return capture->stop_after == 0 || capture->seen < capture->stop_after;
+}
+
+int test_file_pipeline(void) {
+    char dir[] = "/tmp/fstgrep_pipelineXXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("FAILED: mkdtemp\n");
+        return 0;
+    }
+
+    /* File i holds i lines, every third one a hit; the last path doesn't exist. */
+    enum { FILES = 40 };
+    char* paths[FILES + 1];
+    size_t expected = 0;
+    for (int i = 0; i < FILES; i++) {
+        paths[i] = (char*)malloc(strlen(dir) + 16);
+        sprintf(paths[i], "%s/f%d", dir, i);
+        FILE* f = fopen(paths[i], "w");
+        for (int line = 0; f && line < i; line++) {
+            fprintf(f, line % 3 == 0 ? "a hit on line %d\n" : "nothing on line %d\n", line);
+            expected += line % 3 == 0;
+        }
+        if (f) fclose(f);
+    }
+    paths[FILES] = (char*)malloc(strlen(dir) + 16);
+    sprintf(paths[FILES], "%s/missing", dir);
+
+    Pattern* pattern = pattern_create("hit", 0, 0);
+    SearchOptions options;
+    search_options_init(&options);
+    options.mode = MATCH_MODE_LINES;
+
+    int ok = 1;
+    for (int round = 0; round < 2 && ok; round++) {
+        /* A tiny ring and byte budget make every stage wait on the next. */
+        PipelineConfig config;
+        pipeline_config_init(&config);
+        config.num_threads = 3;
+        config.max_files = 3;
+        config.max_bytes = 64;
+        config.backend = round == 0 ? READ_BACKEND_SYNC : READ_BACKEND_AUTO;
+
+        PipelineCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        capture.paths = paths;
+        capture.ordered = 1;
+
+        FilePipeline* pipeline = file_pipeline_create(pattern, &options, &config, capture_file, &capture);
+        for (int i = 0; pipeline && i <= FILES; i++) {
+            file_pipeline_submit(pipeline, file_open(paths[i]), i == FILES);
+        }
+        file_pipeline_finish(pipeline);
+        ok = pipeline && capture.ordered && capture.seen == FILES + 1 && capture.selected == expected &&
+             pipeline->peak_files <= 3;
+        file_pipeline_free(pipeline);
+        if (!ok) {
+            printf("FAILED: pipeline round %d (%zu files, %zu selected, expected %zu)\n", round, capture.seen,
+                   capture.selected, expected);
+        }
+    }
+
+    /* A callback that returns 0 stops the pipeline; later submits are turned away. */
+    if (ok) {
+        PipelineConfig config;
+        pipeline_config_init(&config);
+        config.num_threads = 2;
+        config.max_files = 4;
+
+        PipelineCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        capture.paths = paths;
+        capture.ordered = 1;
+        capture.stop_after = 5;
+
+        FilePipeline* pipeline = file_pipeline_create(pattern, &options, &config, capture_file, &capture);
+        int accepted = 0;
+        for (int i = 0; pipeline && i < FILES; i++) {
+            accepted += file_pipeline_submit(pipeline, file_open(paths[i]), 0);
+        }
+        file_pipeline_finish(pipeline);
+        file_pipeline_free(pipeline);
+        ok = capture.ordered && capture.seen == 5 && accepted < FILES;
+        if (!ok) {
+            printf("FAILED: pipeline stop (%zu reported, %d accepted)\n", capture.seen, accepted);
+        }
+    }
+
+    /* Under -q the first hit cancels the pipeline: searching stops and later submits are turned away. */
+    if (ok) {
+        SearchOptions quiet = options;
+        quiet.stop_on_match = 1;
+        PipelineConfig config;
+        pipeline_config_init(&config);
+        config.num_threads = 2;
+        config.max_files = 4;
+
+        PipelineCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        capture.paths = paths;
+        capture.ordered = 1;
+
+        FilePipeline* pipeline = file_pipeline_create(pattern, &quiet, &config, capture_file, &capture);
+        int accepted = 0;
+        for (int i = 0; pipeline && i < FILES; i++) {
+            accepted += file_pipeline_submit(pipeline, file_open(paths[i]), 0);
+        }
+        file_pipeline_finish(pipeline);
+        ok = pipeline && pipeline->cancelled && capture.ordered && capture.selected > 0 &&
+             capture.selected < expected && accepted < FILES;
+        file_pipeline_free(pipeline);
+        if (!ok) {
+            printf("FAILED: pipeline -q (%zu selected, %d accepted)\n", capture.selected, accepted);
+        }
+    }
+
+    pattern_free(pattern);
+    for (int i = 0; i <= FILES; i++) {
+        unlink(paths[i]);
+        free(paths[i]);
+    }
+    rmdir(dir);
+    if (!ok) return 0;
+
+    /*
+     * Many files against a byte cap a few files wide, with output slow
+     * enough that the reader fills the budget while a drain is reporting:
+     * it then parks on the cap with files queued and only the drain can
+     * wake it. A missed wakeup hangs, so the alarm turns that into a failure.
+     * The cap holds to within one file, not one batch.
+     */
+    enum { CAPPED_FILES = 3000 };
+    char capped_dir[] = "/tmp/fstgrep_cappedXXXXXX";
+    if (!mkdtemp(capped_dir)) {
+        printf("FAILED: mkdtemp\n");
+        return 0;
+    }
+    char** capped_paths = (char**)malloc(sizeof(char*) * CAPPED_FILES);
+    char name[16];
+    for (int i = 0; i < CAPPED_FILES; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        capped_paths[i] = write_batch_file(capped_dir, name, 12 * 1024);
+    }
+    pattern = pattern_create("abc", 0, 0);
+
+    for (int round = 0; round < 4 && ok; round++) {
+        PipelineConfig config;
+        pipeline_config_init(&config);
+        config.num_threads = 2 + (size_t)round % 2;
+        config.max_files = 512;
+        config.max_bytes = 2 * 1024 * 1024;
+        config.backend = round < 2 ? READ_BACKEND_SYNC : READ_BACKEND_AUTO;
+
+        PipelineCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        capture.paths = capped_paths;
+        capture.ordered = 1;
+        capture.pause_us = 20;
+
+        alarm(30);
+        FilePipeline* pipeline = file_pipeline_create(pattern, &options, &config, capture_file, &capture);
+        for (int i = 0; pipeline && i < CAPPED_FILES; i++) {
+            file_pipeline_submit(pipeline, file_open(capped_paths[i]), 0);
+        }
+        file_pipeline_finish(pipeline);
+        alarm(0);
+        ok = pipeline && capture.ordered && capture.seen == CAPPED_FILES && capture.selected > 0 &&
+             pipeline->peak_bytes <= config.max_bytes + 12 * 1024;
+        file_pipeline_free(pipeline);
+        if (!ok) {
+            printf("FAILED: byte-capped pipeline round %d (%zu files)\n", round, capture.seen);
+        }
+    }
+
+    pattern_free(pattern);
+    for (int i = 0; i < CAPPED_FILES; i++) {
+        unlink(capped_paths[i]);
+        free(capped_paths[i]);
+    }
+    free(capped_paths);
+    rmdir(capped_dir);
+    if (!ok) return 0;
+
+    printf("PASSED: test_file_pipeline\n");
+    return 1;
+}
+
+typedef struct {
+    char names[64][64];
+    size_t count;
+    size_t stop_after;
+    pthread_mutex_t mutex;
+} WalkCapture;
+
+/* Records each file relative to the walk root; walkers may call in at once. */
+static int capture_path(const char* filepath, void* userdata) {
+    WalkCapture* capture = (WalkCapture*)userdata;
+    const char* name = strstr(filepath, "/top/");
+
+    pthread_mutex_lock(&capture->mutex);
+    if (capture->count < 64) {
+        snprintf(capture->names[capture->count], 64, "%s", name ? name + 5 : filepath);
+    }
+    size_t count = ++capture->count;
+    pthread_mutex_unlock(&capture->mutex);
+    return capture->stop_after == 0 || count < capture->stop_after;
+}
+
+static int capture_has(const WalkCapture* capture, const char* name) {
+    for (size_t i = 0; i < capture->count && i < 64; i++) {
+        if (strcmp(capture->names[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+int test_dir_walker(void) {
+    char dir[] = "/tmp/fstgrep_walkXXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("FAILED: mkdtemp\n");
+        return 0;
+    }
+
+    /* Nested directories, a symlink to a file, one to a directory, and a loop back to the top; no symlink is followed. */
+    static const char* dirs[] = {"top", "top/a", "top/a/b", "top/c", "top/c/d", "top/c/d/e"};
+    static const char* files[] = {"top/f0", "top/a/f1", "top/a/b/f2", "top/c/f3", "top/c/d/e/f4", "top/c/d/e/f5"};
+    char path[256];
+    char target[256];
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, dirs[i]);
+        mkdir(path, 0755);
+    }
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        FILE* f = fopen(path, "w");
+        if (f) fclose(f);
+    }
+    snprintf(target, sizeof(target), "%s/top/a/f1", dir);
+    snprintf(path, sizeof(path), "%s/top/c/link", dir);
+    int ok = symlink(target, path) == 0;
+    snprintf(target, sizeof(target), "%s/top/a", dir);
+    snprintf(path, sizeof(path), "%s/top/c/dirlink", dir);
+    ok = ok && symlink(target, path) == 0;
+    snprintf(target, sizeof(target), "%s/top", dir);
+    snprintf(path, sizeof(path), "%s/top/a/b/loop", dir);
+    ok = ok && symlink(target, path) == 0;
+    if (!ok) {
+        printf("FAILED: building the tree\n");
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/top", dir);
+    size_t walkers[] = {1, 4};
+    for (size_t w = 0; w < 2 && ok; w++) {
+        WalkCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        pthread_mutex_init(&capture.mutex, NULL);
+        WalkStats stats;
+        memset(&stats, 0, sizeof(stats));
+
+        ok = walk_directory(path, 1, walkers[w], capture_path, &capture, &stats) && capture.count == 6 &&
+             capture_has(&capture, "c/d/e/f5") && !capture_has(&capture, "c/link") && stats.directories == 6 &&
+             stats.files == 6;
+        pthread_mutex_destroy(&capture.mutex);
+        if (!ok) {
+            printf("FAILED: walk with %zu walkers (%zu files, %zu directories)\n", walkers[w], capture.count,
+                   stats.directories);
+        }
+    }
+
+    /* A symlinked root is followed even though symlinks inside it are not. */
+    if (ok) {
+        WalkCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        pthread_mutex_init(&capture.mutex, NULL);
+        snprintf(target, sizeof(target), "%s/top/c/dirlink", dir);
+        ok = walk_directory(target, 1, 1, capture_path, &capture, NULL) && capture.count == 2;
+        pthread_mutex_destroy(&capture.mutex);
+        if (!ok) {
+            printf("FAILED: walk from a symlinked root (%zu files)\n", capture.count);
+        }
+    }
+
+    /* Without recursion only the top level is listed; a callback returning 0 ends the walk. */
+    if (ok) {
+        WalkCapture capture;
+        memset(&capture, 0, sizeof(capture));
+        pthread_mutex_init(&capture.mutex, NULL);
+        ok = walk_directory(path, 0, 2, capture_path, &capture, NULL) && capture.count == 1 &&
+             capture_has(&capture, "f0");
+
+        memset(capture.names, 0, sizeof(capture.names));
+        capture.count = 0;
+        capture.stop_after = 2;
+        ok = ok && walk_directory(path, 1, 1, capture_path, &capture, NULL) && capture.count == 2;
+        pthread_mutex_destroy(&capture.mutex);
+        ok = ok && !walk_directory("/nonexistent/fstgrep", 1, 2, capture_path, &capture, NULL);
+        if (!ok) {
+            printf("FAILED: non-recursive walk or stop\n");
+        }
+    }
+
+    char command[300];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (system(command) != 0) ok = 0;
+    if (!ok) return 0;
+
+    printf("PASSED: test_dir_walker\n");
+    return 1;
+}
+
 int main(int argc, char** argv) {
     (void)argc;
     (void)argv;
@@ -296,6 +2299,77 @@ int main(int argc, char** argv) {
     total++;
     if (test_pattern_overlapping()) passed++;
 
+    total++;
+    if (test_simd_matches_scalar()) passed++;
+
+    total++;
+    if (test_simd_case_matches_scalar()) passed++;
+
+    total++;
+    if (test_multi_literal()) passed++;
+
+    total++;
+    if (test_dictionary_short_entries()) passed++;
+
+    total++;
+    if (test_regex_dfa_matches_regexec()) passed++;
+    total++;
+    if (test_regex_dfa_long_line()) passed++;
+
+    total++;
+    if (test_regex_bounded()) passed++;
+
+    total++;
+    if (test_two_way_matches_scalar()) passed++;
+
+    total++;
+    if (test_kernel_dispatch()) passed++;
+
+    total++;
+    if (test_lazy_line_numbers()) passed++;
+
+    total++;
+    if (test_line_mode()) passed++;
+
+    total++;
+    if (test_word_line_boundaries()) passed++;
+
+    total++;
+    if (test_unicode_case_fold()) passed++;
+
+    total++;
+    if (test_fuzzy_matches_edit_distance()) passed++;
+
+    total++;
+    if (test_regex_jit_matches_interpreter()) passed++;
+
+    total++;
+    if (test_count_and_invert_modes()) passed++;
+
+    total++;
+    if (test_limit_and_cancel()) passed++;
+
+    total++;
+    if (test_binary_detect()) passed++;
+
+    total++;
+    if (test_chunk_reader()) passed++;
+
+    total++;
+    if (test_pipe_input()) passed++;
+
+    total++;
+    if (test_parallel_stream()) passed++;
+
+    total++;
+    if (test_read_batch()) passed++;
+
+    total++;
+    if (test_file_pipeline()) passed++;
+
+    total++;
+    if (test_dir_walker()) passed++;
+
     printf("\n");
     printf("================================\n");
     printf("Unit Test Results: %d/%d passed\n", passed, total);